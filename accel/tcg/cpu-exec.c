@@ -24,6 +24,7 @@
 #include "hw/core/cpu.h"
 #include "accel/tcg/cpu-ops.h"
 #include "accel/tcg/helper-retaddr.h"
+#include "accel/tcg/tb-cache.h"
 #include "trace.h"
 #include "disas/disas.h"
 #include "exec/cpu-common.h"
@@ -33,6 +34,7 @@
 #include "exec/translation-block.h"
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
+#include "qemu/lockable.h"
 #include "qemu/rcu.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
@@ -209,6 +211,147 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s)
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * When many vCPUs run the same code at the same time, e.g. while an SMP
+ * guest brings up its secondary cpus, they tend to miss on the same TB
+ * together.  Only one of them translates it: the others wait for the TB
+ * to be published in the QHT, instead of translating it again only for
+ * tb_link_page() to throw their copy away.
+ *
+ * The wait must not hold up RCU grace periods, exclusive sections or
+ * queued work, so a vCPU that finds the TB in flight leaves cpu_exec()
+ * with EXCP_YIELD and waits in tb_inflight_wait() on its next entry,
+ * outside the RCU critical section; a kick ends the wait.
+ *
+ * The key does not include the physical address, so that it can be
+ * computed without a TLB lookup; a collision only costs a short wait.
+ */
+static QemuMutex tb_inflight_lock;
+static QemuCond tb_inflight_cond;
+static GHashTable *tb_inflight;
+static __thread bool tb_inflight_claimed;
+static __thread bool tb_inflight_waiting;
+static __thread uint32_t tb_inflight_key;
+
+static void tb_inflight_init(void)
+{
+    qemu_mutex_init(&tb_inflight_lock);
+    qemu_cond_init(&tb_inflight_cond);
+    tb_inflight = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+/*
+ * Return true if the caller is now the one translating the TB for @s.
+ * Otherwise, another vCPU is translating it, and the caller must leave
+ * cpu_exec() to wait for it.
+ */
+static bool tb_inflight_claim(TCGTBCPUState s)
+{
+    uint32_t key = qemu_xxhash7(s.pc, s.cs_base, s.flags, s.cflags);
+
+    QEMU_LOCK_GUARD(&tb_inflight_lock);
+    tb_inflight_key = key;
+    if (g_hash_table_contains(tb_inflight, GUINT_TO_POINTER(key))) {
+        tb_inflight_waiting = true;
+        return false;
+    }
+    g_hash_table_add(tb_inflight, GUINT_TO_POINTER(key));
+    tb_inflight_claimed = true;
+    return true;
+}
+
+/* Also called on longjmp out of tb_gen_code(). */
+static void tb_inflight_release(void)
+{
+    if (tb_inflight_claimed) {
+        QEMU_LOCK_GUARD(&tb_inflight_lock);
+        g_hash_table_remove(tb_inflight, GUINT_TO_POINTER(tb_inflight_key));
+        tb_inflight_claimed = false;
+        qemu_cond_broadcast(&tb_inflight_cond);
+    }
+}
+
+/*
+ * Wait until the TB that made the last cpu_exec() yield is translated,
+ * or until @cpu is kicked.  Called outside the RCU critical section.
+ */
+static void tb_inflight_wait(CPUState *cpu)
+{
+    if (!tb_inflight_waiting) {
+        return;
+    }
+    tb_inflight_waiting = false;
+
+    QEMU_LOCK_GUARD(&tb_inflight_lock);
+    while (g_hash_table_contains(tb_inflight,
+                                 GUINT_TO_POINTER(tb_inflight_key)) &&
+           !qatomic_read(&cpu->exit_request)) {
+        qemu_cond_wait(&tb_inflight_cond, &tb_inflight_lock);
+    }
+}
+
+void tb_inflight_kick(void)
+{
+    QEMU_LOCK_GUARD(&tb_inflight_lock);
+    qemu_cond_broadcast(&tb_inflight_cond);
+}
+#endif /* !CONFIG_USER_ONLY */
+
+/*
+ * Translate the TB for @s, unless another vCPU is doing so already, in
+ * which case return NULL.  Called with mmap_lock held for user mode
+ * emulation.
+ */
+static TranslationBlock *tb_gen_code_shared(CPUState *cpu, TCGTBCPUState s)
+{
+#ifndef CONFIG_USER_ONLY
+    if (s.cflags & CF_PARALLEL) {
+        TranslationBlock *tb;
+
+        if (!tb_inflight_claim(s)) {
+            return NULL;
+        }
+        tb = tb_gen_code(cpu, s);
+        tb_inflight_release();
+        return tb;
+    }
+#endif
+    return tb_gen_code(cpu, s);
+}
+
+/*
+ * Execution has just reached the page of @s for the first time in this
+ * run: translate the other blocks that the previous run generated on
+ * that page, so that their first execution does not need to come back
+ * to the slow path.  Called with mmap_lock held for user mode emulation.
+ */
+static void tb_cache_prewarm(CPUState *cpu, TCGTBCPUState s)
+{
+    TBCacheEntry ents[TB_CACHE_PAGE_MAX];
+    size_t i, n;
+
+    n = tb_cache_take_page(s, ents);
+    for (i = 0; i < n; i++) {
+        TCGTBCPUState p = s;
+        tb_page_addr_t phys_pc;
+        void *host_pc;
+
+        /*
+         * The entry is on the same virtual page as @s, whose translation
+         * has just filled the TLB, so this cannot raise an exception.
+         */
+        p.pc = ents[i].pc;
+        phys_pc = get_page_addr_code_hostp(cpu_env(cpu), p.pc, &host_pc);
+        if (phys_pc == -1 || !tb_cache_check(&ents[i], phys_pc, host_pc)) {
+            continue;
+        }
+        if (!tb_htable_lookup(cpu, p)) {
+            tb_gen_code(cpu, p);
+        }
+    }
+}
+
 /**
  * tb_lookup:
  * @cpu: CPU that will execute the returned translation block
@@ -413,6 +556,18 @@ static vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
     }
 }
 
+/**
+ * helper_tb_hot: promote a bottom tier TB
+ * @env: current cpu state
+ * @ptr: the TB, whose execution counter has just reached zero
+ *
+ * Called on entry to @ptr, before its first insn_start.
+ */
+void HELPER(tb_hot)(CPUArchState *env, void *ptr)
+{
+    tb_tier_promote(ptr);
+}
+
 /* Execute a TB, and fix up the CPU state afterwards if necessary */
 /*
  * Disable CFI checks.
@@ -538,6 +693,7 @@ static void cpu_exec_longjmp_cleanup(CPUState *cpu)
         tb_unlock_pages(tcg_ctx->gen_tb);
         tcg_ctx->gen_tb = NULL;
     }
+    tb_inflight_release();
 #endif
     if (bql_locked()) {
         bql_unlock();
@@ -925,7 +1081,8 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
         while (!cpu_handle_interrupt(cpu, &last_tb)) {
             TranslationBlock *tb;
             TCGTBCPUState s = cpu->cc->tcg_ops->get_tb_cpu_state(cpu);
-            s.cflags = cpu->cflags_next_tb;
+            uint32_t cflags_next = cpu->cflags_next_tb;
+            s.cflags = cflags_next;
 
             /*
              * When requested, use an exact setting for cflags for the next
@@ -950,9 +1107,19 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 uint32_t h;
 
                 mmap_lock();
-                tb = tb_gen_code(cpu, s);
+                tb = tb_gen_code_shared(cpu, s);
+                if (tb && tb_cache_enabled()) {
+                    tb_cache_prewarm(cpu, s);
+                }
                 mmap_unlock();
 
+                if (tb == NULL) {
+                    /* Another vCPU is translating it, see tb_inflight_wait() */
+                    cpu->cflags_next_tb = cflags_next;
+                    cpu->exception_index = EXCP_YIELD;
+                    break;
+                }
+
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
@@ -1011,6 +1178,10 @@ int cpu_exec(CPUState *cpu)
         return EXCP_HALTED;
     }
 
+#ifndef CONFIG_USER_ONLY
+    tb_inflight_wait(cpu);
+#endif
+
     RCU_READ_LOCK_GUARD();
     cpu_exec_enter(cpu);
 
@@ -1045,6 +1216,9 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         assert(tcg_ops->get_tb_cpu_state);
         assert(tcg_ops->mmu_index);
         tcg_ops->initialize();
+#ifndef CONFIG_USER_ONLY
+        tb_inflight_init();
+#endif
         tcg_target_initialized = true;
     }
 
@@ -278,14 +278,31 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
-static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
+/* Flush the tlb of the current address space, but not the victim tlb. */
+static void tlb_mmu_flush_table_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
-    desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
+}
+
+/*
+ * Flush the tlbs of all address spaces.  The flush may come with a
+ * change of the address space that tlb_set_asid_by_mmuidx was not told
+ * about, e.g. on reset, so forget which one is current as well.
+ */
+static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
+{
+    int i;
+
+    tlb_mmu_flush_table_locked(desc, fast);
+    desc->vindex = 0;
     memset(desc->vtable, -1, sizeof(desc->vtable));
+    desc->asid = CPU_TLB_ASID_UNKNOWN;
+    for (i = 0; i < CPU_TLB_ASID_CTXS; i++) {
+        desc->ctx[i].asid = CPU_TLB_ASID_UNKNOWN;
+    }
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -337,7 +354,7 @@ void tlb_init(CPUState *cpu)
 
 void tlb_destroy(CPUState *cpu)
 {
-    int i;
+    int i, j;
 
     qemu_spin_destroy(&cpu->neg.tlb.c.lock);
     for (i = 0; i < NB_MMU_MODES; i++) {
@@ -346,6 +363,10 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        for (j = 0; j < CPU_TLB_ASID_CTXS; j++) {
+            g_free(desc->ctx[j].table);
+            g_free(desc->ctx[j].fulltlb);
+        }
     }
 }
 
@@ -501,6 +522,40 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/*
+ * Flush [@addr, @addr + @len) under @mask from the tlbs of the address
+ * spaces which are not current, or drop the tlbs when that is cheaper
+ * or covered by one of their large pages.  Called with tlb_c.lock held.
+ */
+static void tlb_flush_ctx_range_locked(CPUTLBDesc *desc, vaddr addr,
+                                       vaddr len, vaddr mask)
+{
+    int i;
+
+    for (i = 0; i < CPU_TLB_ASID_CTXS; i++) {
+        CPUTLBContext *ctx = &desc->ctx[i];
+        size_t size_mask = ctx->mask >> CPU_TLB_ENTRY_BITS;
+
+        if (ctx->asid == CPU_TLB_ASID_UNKNOWN) {
+            continue;
+        }
+        if (mask < ctx->mask || (len >> TARGET_PAGE_BITS) > size_mask ||
+            ((addr + len - 1) & ctx->large_page_mask) ==
+            ctx->large_page_addr) {
+            ctx->asid = CPU_TLB_ASID_UNKNOWN;
+            continue;
+        }
+        for (vaddr j = 0; j < len; j += TARGET_PAGE_SIZE) {
+            vaddr page = addr + j;
+            size_t index = (page >> TARGET_PAGE_BITS) & size_mask;
+
+            if (tlb_flush_entry_mask_locked(&ctx->table[index], page, mask)) {
+                ctx->n_used_entries--;
+            }
+        }
+    }
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
@@ -517,6 +572,8 @@ static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
             tlb_n_used_entries_dec(cpu, midx);
         }
         tlb_flush_vtlb_page_locked(cpu, midx, page);
+        tlb_flush_ctx_range_locked(&cpu->neg.tlb.d[midx], page,
+                                   TARGET_PAGE_SIZE, -1);
     }
 }
 
@@ -710,6 +767,7 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         }
         tlb_flush_vtlb_page_mask_locked(cpu, midx, page, mask);
     }
+    tlb_flush_ctx_range_locked(d, addr, len, mask);
 }
 
 typedef struct {
@@ -854,6 +912,215 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               idxmap, bits);
 }
 
+/* Called with tlb_c.lock held */
+static void tlb_flush_vtlb_asid_locked(CPUTLBDesc *desc, uint32_t asid)
+{
+    int k;
+
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        if (desc->vfulltlb[k].asid == asid) {
+            memset(&desc->vtable[k], -1, sizeof(desc->vtable[k]));
+        }
+    }
+}
+
+/* Exchange the current tlb of an MMU mode with a saved one. */
+static void tlb_swap_ctx_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
+                                CPUTLBContext *ctx)
+{
+    CPUTLBContext cur = {
+        .asid = desc->asid,
+        .lru = desc->asid_clock++,
+        .mask = fast->mask,
+        .table = fast->table,
+        .fulltlb = desc->fulltlb,
+        .large_page_addr = desc->large_page_addr,
+        .large_page_mask = desc->large_page_mask,
+        .n_used_entries = desc->n_used_entries,
+    };
+
+    desc->asid = ctx->asid;
+    fast->mask = ctx->mask;
+    fast->table = ctx->table;
+    desc->fulltlb = ctx->fulltlb;
+    desc->large_page_addr = ctx->large_page_addr;
+    desc->large_page_mask = ctx->large_page_mask;
+    desc->n_used_entries = ctx->n_used_entries;
+    *ctx = cur;
+}
+
+/*
+ * Make @asid the current address space of @mmu_idx, keeping the tlb
+ * of the previous one.  Return true if it was not already current.
+ * Called with tlb_c.lock held.
+ */
+static bool tlb_set_asid_locked(CPUState *cpu, int mmu_idx, uint32_t asid)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
+    CPUTLBContext *ctx = NULL;
+    size_t n_entries;
+    int i;
+
+    if (desc->asid == asid) {
+        return false;
+    }
+    if (desc->asid == CPU_TLB_ASID_UNKNOWN) {
+        /* These entries may belong to any address space: drop them.  */
+        tlb_mmu_flush_table_locked(desc, fast);
+        tlb_flush_vtlb_asid_locked(desc, CPU_TLB_ASID_UNKNOWN);
+        desc->asid = asid;
+        return true;
+    }
+
+    for (i = 0; i < CPU_TLB_ASID_CTXS; i++) {
+        if (desc->ctx[i].asid == asid) {
+            ctx = &desc->ctx[i];
+            break;
+        }
+    }
+    if (!ctx) {
+        /* Take a free slot, or else the least recently used one.  */
+        ctx = &desc->ctx[0];
+        for (i = 0; i < CPU_TLB_ASID_CTXS; i++) {
+            CPUTLBContext *c = &desc->ctx[i];
+
+            if (c->asid == CPU_TLB_ASID_UNKNOWN) {
+                ctx = c;
+                break;
+            }
+            if ((int32_t)(c->lru - ctx->lru) < 0) {
+                ctx = c;
+            }
+        }
+        if (!ctx->table) {
+            n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+            ctx->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+            ctx->table = g_new(CPUTLBEntry, n_entries);
+            ctx->fulltlb = g_new(CPUTLBEntryFull, n_entries);
+        }
+        n_entries = (ctx->mask >> CPU_TLB_ENTRY_BITS) + 1;
+        memset(ctx->table, -1, n_entries * sizeof(CPUTLBEntry));
+        ctx->asid = asid;
+        ctx->n_used_entries = 0;
+        ctx->large_page_addr = -1;
+        ctx->large_page_mask = -1;
+    }
+    tlb_swap_ctx_locked(desc, fast, ctx);
+    return true;
+}
+
+void tlb_set_asid_by_mmuidx(CPUState *cpu, uint16_t idxmap, uint32_t asid)
+{
+    bool switched = false;
+    uint16_t work;
+
+    tlb_debug("mmu_idx: 0x%" PRIx16 " asid: 0x%" PRIx32 "\n", idxmap, asid);
+
+    assert_cpu_is_self(cpu);
+    assert(asid != CPU_TLB_ASID_UNKNOWN);
+
+    qemu_spin_lock(&cpu->neg.tlb.c.lock);
+    for (work = idxmap; work != 0; work &= work - 1) {
+        int mmu_idx = ctz32(work);
+
+        if (tlb_set_asid_locked(cpu, mmu_idx, asid)) {
+            /* The saved tlbs must be dropped by the next flush.  */
+            cpu->neg.tlb.c.dirty |= 1 << mmu_idx;
+            switched = true;
+        }
+    }
+    qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+
+    /* The jump cache was filled through the previous address space.  */
+    if (switched) {
+        tcg_flush_jmp_cache(cpu);
+    }
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_asid_locked(CPUState *cpu, int mmu_idx, uint32_t asid,
+                                  int64_t now)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
+    int i;
+
+    /* An unknown current address space may well be @asid.  */
+    if (desc->asid == CPU_TLB_ASID_UNKNOWN) {
+        tlb_flush_vtlb_asid_locked(desc, CPU_TLB_ASID_UNKNOWN);
+    }
+    if (desc->asid == asid || desc->asid == CPU_TLB_ASID_UNKNOWN) {
+        tlb_mmu_resize_locked(desc, fast, now);
+        tlb_mmu_flush_table_locked(desc, fast);
+    }
+    tlb_flush_vtlb_asid_locked(desc, asid);
+    for (i = 0; i < CPU_TLB_ASID_CTXS; i++) {
+        if (desc->ctx[i].asid == asid) {
+            desc->ctx[i].asid = CPU_TLB_ASID_UNKNOWN;
+        }
+    }
+}
+
+typedef struct {
+    uint32_t asid;
+    uint16_t idxmap;
+} TLBFlushASIDData;
+
+static void tlb_flush_asid_by_mmuidx_async_0(CPUState *cpu,
+                                             TLBFlushASIDData d)
+{
+    int64_t now = get_clock_realtime();
+    uint16_t work;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("mmu_idx: 0x%" PRIx16 " asid: 0x%" PRIx32 "\n",
+              d.idxmap, d.asid);
+
+    qemu_spin_lock(&cpu->neg.tlb.c.lock);
+    for (work = d.idxmap; work != 0; work &= work - 1) {
+        tlb_flush_asid_locked(cpu, ctz32(work), d.asid, now);
+    }
+    qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+
+    tcg_flush_jmp_cache(cpu);
+}
+
+static void tlb_flush_asid_by_mmuidx_async_1(CPUState *cpu,
+                                             run_on_cpu_data data)
+{
+    TLBFlushASIDData *d = data.host_ptr;
+
+    tlb_flush_asid_by_mmuidx_async_0(cpu, *d);
+    g_free(d);
+}
+
+void tlb_flush_asid_by_mmuidx(CPUState *cpu, uint16_t idxmap, uint32_t asid)
+{
+    TLBFlushASIDData d = { .asid = asid, .idxmap = idxmap };
+
+    tlb_flush_asid_by_mmuidx_async_0(cpu, d);
+}
+
+void tlb_flush_asid_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                              uint16_t idxmap, uint32_t asid)
+{
+    TLBFlushASIDData d = { .asid = asid, .idxmap = idxmap };
+    CPUState *dst_cpu;
+
+    /* Allocate a separate data block for each destination cpu.  */
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            async_run_on_cpu(dst_cpu, tlb_flush_asid_by_mmuidx_async_1,
+                             RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+        }
+    }
+
+    async_safe_run_on_cpu(src_cpu, tlb_flush_asid_by_mmuidx_async_1,
+                          RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+}
+
 /* update the TLBs so that writes to code in the virtual page 'addr'
    can be detected */
 void tlb_protect_code(ram_addr_t ram_addr)
@@ -936,6 +1203,19 @@ void tlb_reset_dirty(CPUState *cpu, uintptr_t start, uintptr_t length)
             tlb_reset_dirty_range_locked(&desc->vfulltlb[i], &desc->vtable[i],
                                          start, length);
         }
+
+        for (int j = 0; j < CPU_TLB_ASID_CTXS; j++) {
+            CPUTLBContext *ctx = &desc->ctx[j];
+
+            if (ctx->asid == CPU_TLB_ASID_UNKNOWN) {
+                continue;
+            }
+            n = (ctx->mask >> CPU_TLB_ENTRY_BITS) + 1;
+            for (i = 0; i < n; i++) {
+                tlb_reset_dirty_range_locked(&ctx->fulltlb[i], &ctx->table[i],
+                                             start, length);
+            }
+        }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
@@ -964,9 +1244,14 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
         int k;
+
         for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
+            /* Other address spaces may map the page elsewhere.  */
+            if (desc->vfulltlb[k].asid == desc->asid) {
+                tlb_set_dirty1_locked(&desc->vtable[k], addr);
+            }
         }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
@@ -1155,6 +1440,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      */
     desc->fulltlb[index] = *full;
     full = &desc->fulltlb[index];
+    full->asid = desc->asid;
     full->xlat_section = iotlb - addr_page;
     full->phys_addr = paddr_page;
 
@@ -1307,14 +1593,15 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
     size_t vidx;
 
     assert_cpu_is_self(cpu);
     for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &cpu->neg.tlb.d[mmu_idx].vtable[vidx];
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         uint64_t cmp = tlb_read_idx(vtlb, access_type);
 
-        if (cmp == page) {
+        if (cmp == page && desc->vfulltlb[vidx].asid == desc->asid) {
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &cpu->neg.tlb.f[mmu_idx].table[index];
 
@@ -1324,8 +1611,8 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             copy_tlb_helper_locked(vtlb, &tmptlb);
             qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 
-            CPUTLBEntryFull *f1 = &cpu->neg.tlb.d[mmu_idx].fulltlb[index];
-            CPUTLBEntryFull *f2 = &cpu->neg.tlb.d[mmu_idx].vfulltlb[vidx];
+            CPUTLBEntryFull *f1 = &desc->fulltlb[index];
+            CPUTLBEntryFull *f2 = &desc->vfulltlb[vidx];
             CPUTLBEntryFull tmpf;
             tmpf = *f1; *f1 = *f2; *f2 = tmpf;
             return true;
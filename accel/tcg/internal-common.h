@@ -50,6 +50,10 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s);
 void page_init(void);
 void tb_htable_init(void);
+void tb_tier_init(unsigned threshold);
+uint16_t *tb_tier_counter(uint32_t h, uint32_t cflags);
+bool tb_tier_is_hot(uint32_t h);
+void tb_tier_promote(TranslationBlock *tb);
 void tb_reset_jump(TranslationBlock *tb, int n);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
@@ -69,6 +73,9 @@ void tlb_destroy(CPUState *cpu);
 bool tcg_exec_realizefn(CPUState *cpu, Error **errp);
 void tcg_exec_unrealizefn(CPUState *cpu);
 
+/* Wake up vCPUs waiting for another vCPU's translation */
+void tb_inflight_kick(void);
+
 /* current cflags for hashing/comparison */
 uint32_t curr_cflags(CPUState *cpu);
 
@@ -137,6 +144,16 @@ G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 #endif /* CONFIG_USER_ONLY */
 
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
+
+/**
+ * tb_evict_cold:
+ * @cpu: cpu whose TCG context has run out of space
+ *
+ * Make room in the code buffer by evicting the translation blocks of
+ * the least recently used regions, or everything if that is not possible.
+ * Like tb_flush(), this runs in an exclusive context.
+ */
+void tb_evict_cold(CPUState *cpu);
 void tb_set_jmp_target(TranslationBlock *tb, int n, uintptr_t addr);
 
 #endif
@@ -189,6 +189,8 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
@@ -206,6 +206,56 @@ static void gen_inline_store_u64_cb(struct qemu_plugin_inline_cb *cb)
     tcg_temp_free_ptr(ptr);
 }
 
+static void gen_inline_ring_append_u64_cb(struct qemu_plugin_inline_cb *cb,
+                                          TCGv_i64 key)
+{
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cb->entry);
+    TCGv_ptr slot = tcg_temp_ebb_new_ptr();
+    TCGv_i64 idx = tcg_temp_ebb_new_i64();
+    TCGv_i64 off = tcg_temp_ebb_new_i64();
+
+    tcg_gen_ld_i64(idx, ptr, 0);
+    tcg_gen_andi_i64(off, idx, cb->imm - 1);
+    tcg_gen_shli_i64(off, off, 3);
+    tcg_gen_trunc_i64_ptr(slot, off);
+    tcg_gen_add_ptr(slot, slot, ptr);
+    tcg_gen_st_i64(key, slot, sizeof(uint64_t));
+    tcg_gen_addi_i64(idx, idx, 1);
+    tcg_gen_st_i64(idx, ptr, 0);
+
+    tcg_temp_free_i64(off);
+    tcg_temp_free_i64(idx);
+    tcg_temp_free_ptr(slot);
+    tcg_temp_free_ptr(ptr);
+}
+
+static void gen_inline_hash_add_u64_cb(struct qemu_plugin_inline_cb *cb,
+                                       TCGv_i64 key)
+{
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cb->entry);
+    TCGv_ptr slot = tcg_temp_ebb_new_ptr();
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+
+    /* Must match plugin_inline_hash_slot(); folded for constant keys. */
+    if (cb->imm == 1) {
+        tcg_gen_movi_i64(val, 0);
+    } else {
+        tcg_gen_muli_i64(val, key, PLUGIN_INLINE_HASH_MUL);
+        tcg_gen_shri_i64(val, val, 64 - ctz64(cb->imm));
+        tcg_gen_shli_i64(val, val, 3);
+    }
+    tcg_gen_trunc_i64_ptr(slot, val);
+    tcg_gen_add_ptr(slot, slot, ptr);
+
+    tcg_gen_ld_i64(val, slot, 0);
+    tcg_gen_addi_i64(val, val, 1);
+    tcg_gen_st_i64(val, slot, 0);
+
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(slot);
+    tcg_temp_free_ptr(ptr);
+}
+
 static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
                        qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
 {
@@ -218,8 +268,122 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
-static void inject_cb(struct qemu_plugin_dyn_cb *cb)
+/*
+ * Records are appended inline without any branch, since the address of a
+ * memory callback may be held in an EBB temp.  Instead, at the start of
+ * each instruction we make sure that the buffer has room for all of the
+ * records the instruction can append, which are at most @max_records.
+ */
+static size_t mem_buffered_max_records(const GArray *cbs,
+                                       struct qemu_plugin_mem_buffer *buf,
+                                       size_t n_mem_ops)
+{
+    size_t i, n = 0;
+
+    for (i = 0; cbs && i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+        if (cb->type == PLUGIN_CB_MEM_BUFFERED && cb->buffered.buf == buf) {
+            n += n_mem_ops;
+        }
+    }
+    return n;
+}
+
+static void gen_mem_buffered_reserve(struct qemu_plugin_buffered_cb *cb,
+                                     size_t max_records)
+{
+    qemu_plugin_u64 head = { .score = cb->buf->score, .offset = 0 };
+    size_t reserved = qatomic_read(&cb->buf->reserved);
+    TCGv_ptr ptr;
+    TCGv_i64 count;
+    TCGLabel *has_room;
+
+    /*
+     * Helper appends may come in the middle of the instruction, and must
+     * not use up the room reserved here; see plugin_mem_buffer_append().
+     * TBs are published through the QHT, so this is visible to any vCPU
+     * that runs the code generated below.
+     */
+    while (reserved < max_records) {
+        size_t old = qatomic_cmpxchg(&cb->buf->reserved, reserved,
+                                     max_records);
+        if (old == reserved) {
+            break;
+        }
+        reserved = old;
+    }
+
+    ptr = gen_plugin_u64_ptr(head);
+    count = tcg_temp_ebb_new_i64();
+    has_room = gen_new_label();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_brcondi_i64(TCG_COND_LEU, count, cb->buf->n - max_records,
+                        has_room);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(qemu_plugin_mem_buffer_flush, cb->flush_info, NULL,
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->buf)),
+                  tcgv_i32_temp(cpu_index));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(has_room);
+
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+static void gen_mem_buffered_cb(struct qemu_plugin_buffered_cb *cb,
+                                qemu_plugin_meminfo_t meminfo, TCGv_i64 addr,
+                                size_t max_records)
+{
+    qemu_plugin_u64 head = { .score = cb->buf->score, .offset = 0 };
+    TCGv_ptr ptr, rec;
+    TCGv_i64 count, off;
+
+    if (max_records > cb->buf->n) {
+        /* Too many accesses to reserve room for: append out of line. */
+        TCGv_i32 cpu_index = gen_cpu_index();
+        tcg_gen_call5(plugin_mem_buffer_append, cb->append_info, NULL,
+                      tcgv_ptr_temp(tcg_constant_ptr(cb->buf)),
+                      tcgv_i32_temp(cpu_index),
+                      tcgv_i64_temp(addr),
+                      tcgv_i64_temp(tcg_constant_i64(cb->pc)),
+                      tcgv_i32_temp(tcg_constant_i32(meminfo)));
+        tcg_temp_free_i32(cpu_index);
+        return;
+    }
 
+    ptr = gen_plugin_u64_ptr(head);
+    rec = tcg_temp_ebb_new_ptr();
+    count = tcg_temp_ebb_new_i64();
+    off = tcg_temp_ebb_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_muli_i64(off, count, sizeof(qemu_plugin_mem_record));
+    tcg_gen_trunc_i64_ptr(rec, off);
+    tcg_gen_add_ptr(rec, rec, ptr);
+    tcg_gen_st_i64(addr, rec, PLUGIN_MEM_BUFFER_RECORDS_OFFSET +
+                   offsetof(qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(cb->pc), rec,
+                   PLUGIN_MEM_BUFFER_RECORDS_OFFSET +
+                   offsetof(qemu_plugin_mem_record, pc));
+    tcg_gen_st_i32(tcg_constant_i32(meminfo), rec,
+                   PLUGIN_MEM_BUFFER_RECORDS_OFFSET +
+                   offsetof(qemu_plugin_mem_record, info));
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+
+    tcg_temp_free_i64(off);
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(ptr);
+}
+
+/*
+ * @key is the vaddr of the block or instruction for execution
+ * callbacks, and the address of the access for memory callbacks.
+ */
+static void inject_cb(struct qemu_plugin_dyn_cb *cb, TCGv_i64 key)
 {
     switch (cb->type) {
     case PLUGIN_CB_REGULAR:
@@ -234,14 +398,21 @@ static void inject_cb(struct qemu_plugin_dyn_cb *cb)
     case PLUGIN_CB_INLINE_STORE_U64:
         gen_inline_store_u64_cb(&cb->inline_insn);
         break;
+    case PLUGIN_CB_INLINE_RING_APPEND_U64:
+        gen_inline_ring_append_u64_cb(&cb->inline_insn, key);
+        break;
+    case PLUGIN_CB_INLINE_HASH_ADD_U64:
+        gen_inline_hash_add_u64_cb(&cb->inline_insn, key);
+        break;
     default:
         g_assert_not_reached();
     }
 }
 
-static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
+static void inject_mem_cb(const GArray *cbs, struct qemu_plugin_dyn_cb *cb,
                           enum qemu_plugin_mem_rw rw,
-                          qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+                          qemu_plugin_meminfo_t meminfo, TCGv_i64 addr,
+                          size_t n_mem_ops)
 {
     switch (cb->type) {
     case PLUGIN_CB_MEM_REGULAR:
@@ -249,10 +420,20 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             gen_mem_cb(&cb->regular, meminfo, addr);
         }
         break;
+    case PLUGIN_CB_MEM_BUFFERED:
+        if (rw & cb->buffered.rw) {
+            gen_mem_buffered_cb(&cb->buffered, meminfo, addr,
+                                mem_buffered_max_records(cbs,
+                                                         cb->buffered.buf,
+                                                         n_mem_ops));
+        }
+        break;
     case PLUGIN_CB_INLINE_ADD_U64:
     case PLUGIN_CB_INLINE_STORE_U64:
+    case PLUGIN_CB_INLINE_RING_APPEND_U64:
+    case PLUGIN_CB_INLINE_HASH_ADD_U64:
         if (rw & cb->inline_insn.rw) {
-            inject_cb(cb);
+            inject_cb(cb, addr);
         }
         break;
     default:
@@ -260,10 +441,45 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
     }
 }
 
+static void inject_mem_buffered_reserve(const GArray *cbs, size_t n_mem_ops)
+{
+    size_t i;
+
+    for (i = 0; n_mem_ops && cbs && i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+        size_t max_records;
+
+        if (cb->type != PLUGIN_CB_MEM_BUFFERED) {
+            continue;
+        }
+        max_records = mem_buffered_max_records(cbs, cb->buffered.buf,
+                                               n_mem_ops);
+        if (max_records <= cb->buffered.buf->n) {
+            gen_mem_buffered_reserve(&cb->buffered, max_records);
+        }
+    }
+}
+
+/* Count the memory callback markers up to the next instruction. */
+static size_t insn_mem_ops(TCGOp *op)
+{
+    size_t n = 0;
+
+    for (op = QTAILQ_NEXT(op, link); op; op = QTAILQ_NEXT(op, link)) {
+        if (op->opc == INDEX_op_insn_start) {
+            break;
+        }
+        n += op->opc == INDEX_op_plugin_mem_cb;
+    }
+    return n;
+}
+
 static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
 {
     TCGOp *op, *next;
     int insn_idx = -1;
+    size_t n_mem_ops = 0;
 
     if (unlikely(qemu_loglevel_mask(LOG_TB_OP_PLUGIN)
                  && qemu_log_in_addr_range(tcg_ctx->plugin_db->pc_first))) {
@@ -322,7 +538,8 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 cbs = plugin_tb->cbs;
                 for (i = 0, n = (cbs ? cbs->len : 0); i < n; i++) {
                     inject_cb(
-                        &g_array_index(cbs, struct qemu_plugin_dyn_cb, i));
+                        &g_array_index(cbs, struct qemu_plugin_dyn_cb, i),
+                        tcg_constant_i64(tcg_ctx->plugin_db->pc_first));
                 }
                 break;
 
@@ -331,10 +548,14 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
 
                 gen_enable_mem_helper(plugin_tb, insn);
 
+                n_mem_ops = insn_mem_ops(op);
+                inject_mem_buffered_reserve(insn->mem_cbs, n_mem_ops);
+
                 cbs = insn->insn_cbs;
                 for (i = 0, n = (cbs ? cbs->len : 0); i < n; i++) {
                     inject_cb(
-                        &g_array_index(cbs, struct qemu_plugin_dyn_cb, i));
+                        &g_array_index(cbs, struct qemu_plugin_dyn_cb, i),
+                        tcg_constant_i64(insn->vaddr));
                 }
                 break;
 
@@ -365,8 +586,9 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
 
             cbs = insn->mem_cbs;
             for (i = 0, n = (cbs ? cbs->len : 0); i < n; i++) {
-                inject_mem_cb(&g_array_index(cbs, struct qemu_plugin_dyn_cb, i),
-                              rw, meminfo, addr);
+                inject_mem_cb(cbs,
+                              &g_array_index(cbs, struct qemu_plugin_dyn_cb, i),
+                              rw, meminfo, addr, n_mem_ops);
             }
 
             tcg_ctx->emit_before_op = NULL;
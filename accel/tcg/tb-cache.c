@@ -0,0 +1,554 @@
+/*
+ * Persistent TCG translation profile
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Host code cannot be reused across runs: the backends emit absolute
+ * addresses of helpers, of the TB itself and of the code_gen_buffer,
+ * none of which survive a restart with ASLR.  What does survive is the
+ * knowledge of which blocks were needed.  We record, for every block,
+ * the inputs of the translation (pc, cs_base, flags, cflags) together
+ * with a checksum of the guest code.  On the next run, the first miss
+ * on a page translates all of the blocks recorded for that page whose
+ * guest code is unchanged, so that the following misses on the page
+ * are satisfied from the QHT without going through the slow path.
+ *
+ * In user mode, blocks in executable file mappings are recorded by file
+ * and offset rather than by address, so that processes which map the
+ * same libraries at different addresses can share one profile.  Each
+ * process merges its record into the file on exit.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "qemu/interval-tree.h"
+#include "qemu/target-info.h"
+#include "qemu/thread.h"
+#include "qemu/xxhash.h"
+#include "qemu-version.h"
+#include "exec/target_page.h"
+#include "accel/tcg/tb-cache.h"
+#ifdef CONFIG_LINUX
+#include <link.h>
+#endif
+
+/* Stored in host byte order, so this also rejects foreign-endian files. */
+#define TB_CACHE_MAGIC   0x3243425455484551ull   /* "QEMUTBC2" */
+
+/* Bound the size of a profile shared by many different programs. */
+#define TB_CACHE_MAX_ENTRIES  (256 * 1024)
+
+typedef struct TBCacheHeader {
+    uint64_t magic;
+    char build[128];
+    uint32_t page_bits;
+    uint32_t nb_entries;
+} TBCacheHeader;
+
+/* Loaded entries which have not been prewarmed yet, by virtual page. */
+typedef struct TBCachePage {
+    uint64_t page;
+    GArray *ents;
+} TBCachePage;
+
+/* Loaded entries of a file which is not mapped yet. */
+typedef struct TBCacheFile {
+    uint64_t dev;
+    uint64_t ino;
+    GArray *ents;
+} TBCacheFile;
+
+/* A file mapping, by guest address. */
+typedef struct TBCacheMap {
+    IntervalTreeNode itree;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t offset;
+} TBCacheMap;
+
+static struct {
+    QemuMutex lock;
+    char *path;
+    bool loaded;
+    bool saved;
+    GHashTable *pages;
+    GHashTable *files;
+    GHashTable *recorded;
+    IntervalTreeRoot maps;
+} tb_cache;
+
+#ifdef CONFIG_LINUX
+static int tb_cache_find_build_id(struct dl_phdr_info *info, size_t size,
+                                  void *opaque)
+{
+    GString *id = opaque;
+    int i;
+
+    /* The main program comes first. */
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+        const uint8_t *p = (const uint8_t *)(info->dlpi_addr + ph->p_vaddr);
+        const uint8_t *end = p + ph->p_memsz;
+
+        if (ph->p_type != PT_NOTE) {
+            continue;
+        }
+        while (p + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *nh = (const ElfW(Nhdr) *)p;
+            const uint8_t *desc = p + sizeof(*nh) + ROUND_UP(nh->n_namesz, 4);
+
+            if (nh->n_type == NT_GNU_BUILD_ID && nh->n_namesz == 4 &&
+                !memcmp(p + sizeof(*nh), "GNU", 4) &&
+                desc + nh->n_descsz <= end) {
+                for (uint32_t j = 0; j < nh->n_descsz; j++) {
+                    g_string_append_printf(id, "%02x", desc[j]);
+                }
+                return 1;
+            }
+            p = desc + ROUND_UP(nh->n_descsz, 4);
+        }
+    }
+    return 1;
+}
+#endif
+
+/*
+ * Identify the binary, so that a rebuild with the same version string
+ * does not use the profile: its TB flags or cflags may mean something
+ * else.  Use the linker's build-id if there is one, otherwise the size
+ * and modification time of the executable.
+ */
+static void tb_cache_build_id(char *buf, size_t len)
+{
+    g_autoptr(GString) id = g_string_new(NULL);
+
+#ifdef CONFIG_LINUX
+    struct stat st;
+
+    dl_iterate_phdr(tb_cache_find_build_id, id);
+    if (id->len == 0 && stat("/proc/self/exe", &st) == 0) {
+        g_string_printf(id, "%" PRIx64 "-%" PRIx64,
+                        (uint64_t)st.st_size, (uint64_t)st.st_mtime);
+    }
+#endif
+    snprintf(buf, len, "%s %s %zu %s", QEMU_FULL_VERSION, target_name(),
+             sizeof(void *), id->str);
+}
+
+/*
+ * Entries come from a file, so check that the guest code they cover is
+ * within one page before tb_cache_check() computes its CRC.  Blocks that
+ * cross a page are never recorded.
+ */
+static bool tb_cache_entry_valid(const TBCacheEntry *e)
+{
+    return e->size > 0 &&
+           (e->phys_pc & ~TARGET_PAGE_MASK) + e->size <= TARGET_PAGE_SIZE &&
+           (e->pc & ~TARGET_PAGE_MASK) == (e->phys_pc & ~TARGET_PAGE_MASK);
+}
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return qemu_xxhash8(e->phys_pc ^ e->ino, e->pc ^ e->dev, e->cs_base,
+                        e->flags, e->cflags);
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *ea = a;
+    const TBCacheEntry *eb = b;
+
+    return ea->dev == eb->dev &&
+           ea->ino == eb->ino &&
+           ea->pc == eb->pc &&
+           ea->phys_pc == eb->phys_pc &&
+           ea->cs_base == eb->cs_base &&
+           ea->flags == eb->flags &&
+           ea->cflags == eb->cflags;
+}
+
+static void tb_cache_page_free(gpointer p)
+{
+    TBCachePage *pg = p;
+
+    g_array_free(pg->ents, true);
+    g_free(pg);
+}
+
+static guint tb_cache_file_hash(gconstpointer p)
+{
+    const TBCacheFile *f = p;
+
+    return qemu_xxhash4(f->dev, f->ino);
+}
+
+static gboolean tb_cache_file_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheFile *fa = a;
+    const TBCacheFile *fb = b;
+
+    return fa->dev == fb->dev && fa->ino == fb->ino;
+}
+
+static void tb_cache_file_free(gpointer p)
+{
+    TBCacheFile *f = p;
+
+    g_array_free(f->ents, true);
+    g_free(f);
+}
+
+void tb_cache_init(const char *path)
+{
+    qemu_mutex_init(&tb_cache.lock);
+    tb_cache.path = g_strdup(path);
+    tb_cache.pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                           NULL, tb_cache_page_free);
+    tb_cache.files = g_hash_table_new_full(tb_cache_file_hash,
+                                           tb_cache_file_equal,
+                                           NULL, tb_cache_file_free);
+    tb_cache.recorded = g_hash_table_new_full(tb_cache_entry_hash,
+                                              tb_cache_entry_equal,
+                                              g_free, NULL);
+    atexit(tb_cache_exit);
+}
+
+bool tb_cache_enabled(void)
+{
+    return tb_cache.path != NULL;
+}
+
+/* Return the entries of the profile in @buf, or NULL if it is not valid. */
+static const TBCacheEntry *tb_cache_parse(const char *buf, size_t len,
+                                          uint32_t *nb_entries)
+{
+    TBCacheHeader hdr;
+    char build[sizeof(hdr.build)];
+
+    if (len < sizeof(hdr)) {
+        return NULL;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    tb_cache_build_id(build, sizeof(build));
+    if (hdr.magic != TB_CACHE_MAGIC ||
+        strncmp(hdr.build, build, sizeof(build)) != 0 ||
+        hdr.page_bits != TARGET_PAGE_BITS ||
+        len != sizeof(hdr) + (size_t)hdr.nb_entries * sizeof(TBCacheEntry)) {
+        return NULL;
+    }
+    *nb_entries = hdr.nb_entries;
+    return (const TBCacheEntry *)(buf + sizeof(hdr));
+}
+
+/* Called with tb_cache.lock held. */
+static void tb_cache_add_page__locked(const TBCacheEntry *e)
+{
+    uint64_t page = e->pc & TARGET_PAGE_MASK;
+    TBCachePage *pg = g_hash_table_lookup(tb_cache.pages, &page);
+
+    if (!pg) {
+        pg = g_new(TBCachePage, 1);
+        pg->page = page;
+        pg->ents = g_array_new(false, false, sizeof(TBCacheEntry));
+        g_hash_table_insert(tb_cache.pages, &pg->page, pg);
+    }
+    g_array_append_val(pg->ents, *e);
+}
+
+/* Called with tb_cache.lock held. */
+static void tb_cache_add_file__locked(const TBCacheEntry *e)
+{
+    TBCacheFile key = { .dev = e->dev, .ino = e->ino };
+    TBCacheFile *f = g_hash_table_lookup(tb_cache.files, &key);
+
+    if (!f) {
+        f = g_new(TBCacheFile, 1);
+        f->dev = e->dev;
+        f->ino = e->ino;
+        f->ents = g_array_new(false, false, sizeof(TBCacheEntry));
+        g_hash_table_add(tb_cache.files, f);
+    }
+    g_array_append_val(f->ents, *e);
+}
+
+/*
+ * Move the loaded entries of the file mapped by @m to the pages where
+ * it is mapped.  Called with tb_cache.lock held.
+ */
+static void tb_cache_resolve__locked(TBCacheMap *m)
+{
+    TBCacheFile key = { .dev = m->dev, .ino = m->ino };
+    TBCacheFile *f = g_hash_table_lookup(tb_cache.files, &key);
+    uint64_t size = m->itree.last - m->itree.start;
+    guint i = 0;
+
+    if (!f) {
+        return;
+    }
+    while (i < f->ents->len) {
+        TBCacheEntry e = g_array_index(f->ents, TBCacheEntry, i);
+
+        /* Entries are valid, so e.size > 0 and this cannot overflow. */
+        if (e.pc >= m->offset && e.pc - m->offset <= size &&
+            e.size - 1 <= size - (e.pc - m->offset)) {
+            e.pc = m->itree.start + (e.pc - m->offset);
+            e.phys_pc = e.pc;
+            e.dev = 0;
+            e.ino = 0;
+            tb_cache_add_page__locked(&e);
+            g_array_remove_index_fast(f->ents, i);
+        } else {
+            i++;
+        }
+    }
+    if (f->ents->len == 0) {
+        g_hash_table_remove(tb_cache.files, &key);
+    }
+}
+
+/* Called with tb_cache.lock held. */
+static void tb_cache_load__locked(void)
+{
+    g_autofree char *buf = NULL;
+    g_autoptr(GError) err = NULL;
+    const TBCacheEntry *e;
+    IntervalTreeNode *n;
+    uint32_t nb_entries;
+    size_t len;
+    uint32_t i;
+
+    tb_cache.loaded = true;
+
+    if (!g_file_get_contents(tb_cache.path, &buf, &len, &err)) {
+        /* No profile yet: this run will create it. */
+        return;
+    }
+    e = tb_cache_parse(buf, len, &nb_entries);
+    if (!e) {
+        warn_report("TB cache %s is stale or corrupt, ignoring it",
+                    tb_cache.path);
+        return;
+    }
+
+    for (i = 0; i < nb_entries; i++, e++) {
+        if (!tb_cache_entry_valid(e)) {
+            warn_report("TB cache %s is corrupt, ignoring it", tb_cache.path);
+            g_hash_table_remove_all(tb_cache.pages);
+            g_hash_table_remove_all(tb_cache.files);
+            return;
+        }
+        if (e->ino) {
+            tb_cache_add_file__locked(e);
+        } else {
+            tb_cache_add_page__locked(e);
+        }
+    }
+    for (n = interval_tree_iter_first(&tb_cache.maps, 0, UINT64_MAX); n;
+         n = interval_tree_iter_next(n, 0, UINT64_MAX)) {
+        tb_cache_resolve__locked(container_of(n, TBCacheMap, itree));
+    }
+}
+
+/* Called with tb_cache.lock held. */
+static void tb_cache_unmap__locked(vaddr start, vaddr last)
+{
+    IntervalTreeNode *n, *next;
+
+    for (n = interval_tree_iter_first(&tb_cache.maps, start, last); n;
+         n = next) {
+        next = interval_tree_iter_next(n, start, last);
+        interval_tree_remove(n, &tb_cache.maps);
+        g_free(container_of(n, TBCacheMap, itree));
+    }
+}
+
+void tb_cache_map_file(vaddr start, vaddr len, uint64_t dev, uint64_t ino,
+                       uint64_t offset)
+{
+    TBCacheMap *m;
+
+    if (!tb_cache_enabled() || len == 0) {
+        return;
+    }
+
+    m = g_new0(TBCacheMap, 1);
+    m->itree.start = start;
+    m->itree.last = start + len - 1;
+    m->dev = dev;
+    m->ino = ino;
+    m->offset = offset;
+
+    qemu_mutex_lock(&tb_cache.lock);
+    tb_cache_unmap__locked(m->itree.start, m->itree.last);
+    interval_tree_insert(&m->itree, &tb_cache.maps);
+    if (tb_cache.loaded) {
+        tb_cache_resolve__locked(m);
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+void tb_cache_unmap(vaddr start, vaddr len)
+{
+    if (!tb_cache_enabled() || len == 0) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_cache.lock);
+    tb_cache_unmap__locked(start, start + len - 1);
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+void tb_cache_record(const TranslationBlock *tb, vaddr pc,
+                     const void *host_pc)
+{
+    IntervalTreeNode *n;
+    TBCacheEntry *e;
+
+    if (tb_page_addr1(tb) != -1) {
+        return;
+    }
+
+    e = g_new0(TBCacheEntry, 1);
+    e->pc = pc;
+    e->cs_base = tb->cs_base;
+    e->phys_pc = tb_page_addr0(tb);
+    e->flags = tb->flags;
+    e->cflags = tb->cflags;
+    e->size = tb->size;
+    e->crc = crc32c(0xffffffff, host_pc, tb->size);
+
+    qemu_mutex_lock(&tb_cache.lock);
+    n = interval_tree_iter_first(&tb_cache.maps, pc, pc + tb->size - 1);
+    if (n && n->start <= pc && pc + tb->size - 1 <= n->last) {
+        TBCacheMap *m = container_of(n, TBCacheMap, itree);
+
+        e->dev = m->dev;
+        e->ino = m->ino;
+        e->pc = m->offset + (pc - n->start);
+        e->phys_pc = e->pc;
+    }
+    if (tb_cache.saved) {
+        g_free(e);
+    } else {
+        g_hash_table_add(tb_cache.recorded, e);
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+size_t tb_cache_take_page(TCGTBCPUState s, TBCacheEntry *ents)
+{
+    uint64_t page = s.pc & TARGET_PAGE_MASK;
+    TBCachePage *pg;
+    size_t n = 0;
+    guint i;
+
+    qemu_mutex_lock(&tb_cache.lock);
+    if (unlikely(!tb_cache.loaded)) {
+        tb_cache_load__locked();
+    }
+
+    pg = g_hash_table_lookup(tb_cache.pages, &page);
+    if (pg) {
+        i = 0;
+        while (i < pg->ents->len && n < TB_CACHE_PAGE_MAX) {
+            TBCacheEntry *e = &g_array_index(pg->ents, TBCacheEntry, i);
+
+            if (e->cs_base == s.cs_base &&
+                e->flags == s.flags &&
+                e->cflags == s.cflags) {
+                if (e->pc != s.pc) {
+                    ents[n++] = *e;
+                }
+                g_array_remove_index_fast(pg->ents, i);
+            } else {
+                i++;
+            }
+        }
+        if (pg->ents->len == 0) {
+            g_hash_table_remove(tb_cache.pages, &page);
+        }
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+
+    return n;
+}
+
+bool tb_cache_check(const TBCacheEntry *e, tb_page_addr_t phys_pc,
+                    const void *host_pc)
+{
+    return e->phys_pc == phys_pc &&
+           e->crc == crc32c(0xffffffff, host_pc, e->size);
+}
+
+void tb_cache_exit(void)
+{
+    g_autoptr(GByteArray) out = NULL;
+    g_autoptr(GError) err = NULL;
+    g_autofree char *buf = NULL;
+    TBCacheHeader hdr = { .magic = TB_CACHE_MAGIC };
+    const TBCacheEntry *e;
+    GHashTableIter iter;
+    gpointer key;
+    uint32_t nb_entries;
+    size_t len;
+    uint32_t i;
+
+    if (!tb_cache_enabled()) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_cache.lock);
+    if (tb_cache.saved) {
+        qemu_mutex_unlock(&tb_cache.lock);
+        return;
+    }
+    tb_cache.saved = true;
+
+    /*
+     * Keep what other processes have added to the file since it was
+     * loaded, along with what was loaded but not needed by this run.
+     */
+    if (g_file_get_contents(tb_cache.path, &buf, &len, NULL)) {
+        e = tb_cache_parse(buf, len, &nb_entries);
+        for (i = 0; e && i < nb_entries; i++, e++) {
+            if (g_hash_table_size(tb_cache.recorded) >= TB_CACHE_MAX_ENTRIES) {
+                break;
+            }
+            /* Do not carry corrupt entries over to the next profile. */
+            if (tb_cache_entry_valid(e) &&
+                !g_hash_table_contains(tb_cache.recorded, e)) {
+                g_hash_table_add(tb_cache.recorded, g_memdup2(e, sizeof(*e)));
+            }
+        }
+    }
+
+    tb_cache_build_id(hdr.build, sizeof(hdr.build));
+    hdr.page_bits = TARGET_PAGE_BITS;
+    hdr.nb_entries = MIN(g_hash_table_size(tb_cache.recorded),
+                         TB_CACHE_MAX_ENTRIES);
+
+    out = g_byte_array_sized_new(sizeof(hdr) +
+                                 hdr.nb_entries * sizeof(TBCacheEntry));
+    g_byte_array_append(out, (const guint8 *)&hdr, sizeof(hdr));
+    g_hash_table_iter_init(&iter, tb_cache.recorded);
+    for (i = 0; i < hdr.nb_entries; i++) {
+        g_hash_table_iter_next(&iter, &key, NULL);
+        g_byte_array_append(out, key, sizeof(TBCacheEntry));
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+
+    /*
+     * g_file_set_contents() renames into place, so readers never see a
+     * partial profile even when several processes share one file.
+     * Two processes exiting at the same time may still drop each
+     * other's additions, which only costs translations next time.
+     */
+    if (!g_file_set_contents(tb_cache.path, (const char *)out->data,
+                             out->len, &err)) {
+        warn_report("Could not write TB cache %s: %s",
+                    tb_cache.path, err->message);
+    }
+}
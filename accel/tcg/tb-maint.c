@@ -68,6 +68,81 @@ void tb_htable_init(void)
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
 }
 
+/*
+ * Tiered translation.
+ *
+ * When enabled, a new TB starts at the bottom tier: on entry it
+ * decrements one of tb_tier_counters, selected by its QHT hash.  When
+ * the counter reaches zero, helper_tb_hot() marks the hash as hot and
+ * invalidates the TB.  The next lookup of the block misses, and the
+ * retranslation sees the hot mark and generates it at the top tier:
+ * without the counter, following direct jumps, and with a second round
+ * of optimization in tcg_gen_code().
+ *
+ * Blocks sharing a counter simply reach the threshold sooner, and
+ * blocks sharing a hot mark are generated at the top tier directly,
+ * which only costs translation time.  The hot marks are never
+ * cleared, so that hot code regenerated after a tb_flush() does not
+ * need to be counted again.
+ */
+#define TB_TIER_BITS    16
+#define TB_TIER_SIZE    (1u << TB_TIER_BITS)
+
+static unsigned tb_tier_threshold;
+static uint16_t tb_tier_counters[TB_TIER_SIZE];
+static unsigned long tb_tier_hot[BITS_TO_LONGS(TB_TIER_SIZE)];
+
+void tb_tier_init(unsigned threshold)
+{
+    unsigned i;
+
+    assert(threshold <= UINT16_MAX);
+    tb_tier_threshold = threshold;
+    for (i = 0; i < TB_TIER_SIZE; i++) {
+        tb_tier_counters[i] = threshold;
+    }
+}
+
+uint16_t *tb_tier_counter(uint32_t h, uint32_t cflags)
+{
+    h &= TB_TIER_SIZE - 1;
+
+    /* One-shot and icount-limited blocks are never worth promoting. */
+    if (tb_tier_threshold == 0 ||
+        (cflags & CF_COUNT_MASK) ||
+        test_bit(h, tb_tier_hot)) {
+        return NULL;
+    }
+    return &tb_tier_counters[h];
+}
+
+bool tb_tier_is_hot(uint32_t h)
+{
+    return tb_tier_threshold != 0 &&
+           test_bit(h & (TB_TIER_SIZE - 1), tb_tier_hot);
+}
+
+void tb_tier_promote(TranslationBlock *tb)
+{
+    uint32_t cflags = tb_cflags(tb) & ~CF_INVALID;
+    uint32_t h;
+
+    h = tb_hash_func(tb_page_addr0(tb), (cflags & CF_PCREL ? 0 : tb->pc),
+                     tb->flags, tb->cs_base, cflags);
+    h &= TB_TIER_SIZE - 1;
+
+    set_bit_atomic(h, tb_tier_hot);
+    qatomic_set(&tb_tier_counters[h], tb_tier_threshold);
+
+    /*
+     * The TB keeps running to its end: invalidation only unlinks it,
+     * the code stays in place until its region is evicted or flushed.
+     */
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+}
+
 typedef struct PageDesc PageDesc;
 
 #ifdef CONFIG_USER_ONLY
@@ -756,17 +831,10 @@ static void tb_remove(TranslationBlock *tb)
 }
 #endif /* CONFIG_USER_ONLY */
 
-/* flush all the translation blocks */
-static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+/* Call with mmap_lock held, from a safe-work context. */
+static void tb_flush__locked(void)
 {
-    bool did_flush = false;
-
-    mmap_lock();
-    /* If it is already been done on request of another CPU, just retry. */
-    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
-        goto done;
-    }
-    did_flush = true;
+    CPUState *cpu;
 
     CPU_FOREACH(cpu) {
         tcg_flush_jmp_cache(cpu);
@@ -778,6 +846,22 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
+    /* This also makes room, so pending tb_evict_cold() requests can go. */
+    qatomic_inc(&tb_ctx.tb_evict_count);
+}
+
+/* flush all the translation blocks */
+static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    bool did_flush = false;
+
+    mmap_lock();
+    /* If it is already been done on request of another CPU, just retry. */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+        goto done;
+    }
+    did_flush = true;
+    tb_flush__locked();
 
 done:
     mmap_unlock();
@@ -902,8 +986,11 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
+ * @rm_from_jmp_cache may only be clear if the caller flushes the jump
+ * caches of all cpus itself.
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list,
+                                  bool rm_from_jmp_cache)
 {
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -930,7 +1017,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    tb_jmp_cache_inval_tb(tb);
+    if (rm_from_jmp_cache) {
+        tb_jmp_cache_inval_tb(tb);
+    }
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -946,7 +1035,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
     qemu_thread_jit_write();
-    do_tb_phys_invalidate(tb, true);
+    do_tb_phys_invalidate(tb, true, true);
     qemu_thread_jit_execute();
 }
 
@@ -958,10 +1047,99 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     if (page_addr == -1 && tb_page_addr0(tb) != -1) {
         tb_lock_pages(tb);
-        do_tb_phys_invalidate(tb, true);
+        do_tb_phys_invalidate(tb, true, true);
+        tb_unlock_pages(tb);
+    } else {
+        do_tb_phys_invalidate(tb, false, true);
+    }
+}
+
+/*
+ * Unlink a TB of a region that is about to be reused.  Besides the TBs
+ * that are still live, this must also handle those that were already
+ * invalidated, or never linked: they may still jump to live TBs, and
+ * one-shot TBs may be the target of jumps.
+ */
+static void tb_evict(TranslationBlock *tb)
+{
+    int n;
+
+    if (!(tb_cflags(tb) & CF_INVALID) && tb_page_addr0(tb) != -1) {
+        tb_lock_pages(tb);
+        do_tb_phys_invalidate(tb, true, false);
         tb_unlock_pages(tb);
     } else {
-        do_tb_phys_invalidate(tb, false);
+        qemu_spin_lock(&tb->jmp_lock);
+        qatomic_set(&tb->cflags, tb->cflags | CF_INVALID);
+        qemu_spin_unlock(&tb->jmp_lock);
+    }
+
+    /* A set LSB means the jump was already taken off the list. */
+    for (n = 0; n < 2; n++) {
+        if (!(qatomic_read(&tb->jmp_dest[n]) & 1)) {
+            tb_remove_from_jmp_list(tb, n);
+        }
+    }
+    tb_jmp_unlink(tb);
+}
+
+/* evict the coldest part of the translation blocks */
+static void do_tb_evict_cold(CPUState *cpu, run_on_cpu_data tb_evict_count)
+{
+    bool did_evict = false;
+
+    mmap_lock();
+    /* If it is already been done on request of another CPU, just retry. */
+    if (tb_ctx.tb_evict_count != tb_evict_count.host_int) {
+        goto done;
+    }
+
+    /*
+     * What is in the jump caches ran recently: keep it.  The caches are
+     * then flushed once, rather than once per evicted TB.
+     */
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        for (int i = 0; jc && i < TB_JMP_CACHE_SIZE; i++) {
+            TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+
+            if (tb) {
+                tcg_region_mark_hot(tb->tc.ptr);
+            }
+        }
+        tcg_flush_jmp_cache(cpu);
+    }
+
+    qemu_thread_jit_write();
+    if (tcg_region_evict_cold(tb_evict)) {
+        qatomic_inc(&tb_ctx.tb_evict_count);
+    } else {
+        tb_flush__locked();
+    }
+    qemu_thread_jit_execute();
+    did_evict = true;
+
+done:
+    mmap_unlock();
+    /*
+     * Plugins may keep state per TB, and have no way to learn which TBs
+     * went away with the evicted regions: tell them as for a tb_flush().
+     */
+    if (did_evict) {
+        qemu_plugin_flush_cb();
+    }
+}
+
+void tb_evict_cold(CPUState *cpu)
+{
+    unsigned tb_evict_count = qatomic_read(&tb_ctx.tb_evict_count);
+
+    if (cpu_in_serial_context(cpu)) {
+        do_tb_evict_cold(cpu, RUN_ON_CPU_HOST_INT(tb_evict_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict_cold,
+                              RUN_ON_CPU_HOST_INT(tb_evict_count));
     }
 }
 
@@ -34,6 +34,7 @@
 #include "tcg/startup.h"
 #include "tcg-accel-ops.h"
 #include "tcg-accel-ops-mttcg.h"
+#include "internal-common.h"
 
 typedef struct MttcgForceRcuNotifier {
     Notifier notifier;
@@ -127,6 +128,7 @@ static void *mttcg_cpu_thread_fn(void *arg)
 void mttcg_kick_vcpu_thread(CPUState *cpu)
 {
     cpu_exit(cpu);
+    tb_inflight_kick();
 }
 
 void mttcg_start_vcpu_thread(CPUState *cpu)
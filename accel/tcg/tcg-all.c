@@ -40,6 +40,7 @@
 #include "hw/boards.h"
 #endif
 #include "accel/tcg/cpu-ops.h"
+#include "accel/tcg/tb-cache.h"
 #include "internal-common.h"
 
 
@@ -50,6 +51,8 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t tier_threshold;
+    char *tb_cache;
 };
 typedef struct TCGState TCGState;
 
@@ -128,7 +131,11 @@ static int tcg_init_machine(MachineState *ms)
 
     page_init();
     tb_htable_init();
+    tb_tier_init(s->tier_threshold);
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads);
+    if (s->tb_cache) {
+        tb_cache_init(s->tb_cache);
+    }
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -193,6 +200,49 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > UINT16_MAX) {
+        error_setg(errp, "tier-threshold must be at most %u", UINT16_MAX);
+        return;
+    }
+
+    s->tier_threshold = value;
+}
+
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -254,6 +304,19 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "tier-threshold", "int",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions after which a TB is retranslated without profiling"
+        " (0 disables tiered translation)");
+
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache,
+                                  tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File recording the translated blocks across runs");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -36,6 +36,7 @@
 #include "tb-internal.h"
 #include "internal-common.h"
 #include "tcg/perf.h"
+#include "accel/tcg/tb-cache.h"
 #include "tcg/insn-start-words.h"
 
 TBContext tb_ctx;
@@ -267,6 +268,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     int gen_code_size, search_size, max_insns;
     int64_t ti;
     void *host_pc;
+    uint32_t h;
 
     assert_memory_lock();
     qemu_thread_jit_write();
@@ -278,6 +280,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         s.cflags = (s.cflags & ~CF_COUNT_MASK) | 1;
     }
 
+    h = tb_hash_func(phys_pc, (s.cflags & CF_PCREL ? 0 : s.pc),
+                     s.flags, s.cs_base, s.cflags);
+
     max_insns = s.cflags & CF_COUNT_MASK;
     if (max_insns == 0) {
         max_insns = TCG_MAX_INSNS;
@@ -288,8 +293,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* make room: drop the coldest code, or flush everything */
+        tb_evict_cold(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -311,6 +316,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     }
 
     tcg_ctx->gen_tb = tb;
+    tcg_ctx->gen_tier_counter = tb_tier_counter(h, s.cflags);
+    tcg_ctx->gen_trace = tb_tier_is_hot(h);
     tcg_ctx->addr_type = target_long_bits() == 32 ? TCG_TYPE_I32 : TCG_TYPE_I64;
     tcg_ctx->guest_mo = cpu->cc->tcg_ops->guest_default_memory_order;
 
@@ -531,6 +538,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         tcg_tb_remove(tb);
         return existing_tb;
     }
+
+    /* Only remember blocks that a plain lookup on the next run will want. */
+    if (tb_cache_enabled() && s.cflags == curr_cflags(cpu)) {
+        tb_cache_record(tb, s.pc, host_pc);
+    }
     return tb;
 }
 
@@ -40,6 +40,25 @@ bool translator_io_start(DisasContextBase *db)
     return true;
 }
 
+/*
+ * Count the executions of a bottom tier TB, and ask for it to be
+ * retranslated once it becomes hot.  The counter is shared between
+ * vCPUs without atomics: a lost update only delays the promotion.
+ */
+static void gen_tb_tier_count(TranslationBlock *tb, uint16_t *counter)
+{
+    TCGv_ptr ptr = tcg_constant_ptr(counter);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *cold = gen_new_label();
+
+    tcg_gen_ld16u_i32(count, ptr, 0);
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st16_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, 0, cold);
+    gen_helper_tb_hot(tcg_env, tcg_constant_ptr(tb));
+    gen_set_label(cold);
+}
+
 static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
 {
     TCGv_i32 count = NULL;
@@ -82,6 +101,10 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
                          sizeof(CPUState));
     }
 
+    if (tcg_ctx->gen_tier_counter) {
+        gen_tb_tier_count(db->tb, tcg_ctx->gen_tier_counter);
+    }
+
     return icount_start_insn;
 }
 
@@ -119,6 +142,30 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     return translator_is_same_page(db, dest);
 }
 
+bool translator_follow_jump(DisasContextBase *db, vaddr dest)
+{
+    /* Only extend blocks that tiered translation found to be hot. */
+    if (!tcg_ctx->gen_trace || db->plugin_enabled) {
+        return false;
+    }
+    if (tb_cflags(db->tb) & (CF_NO_GOTO_TB | CF_SINGLE_STEP)) {
+        return false;
+    }
+
+    /*
+     * Only follow forward jumps within the first page, so that
+     * [pc_first, pc_first + tb->size) still covers every insn of the
+     * block for the purposes of invalidation.
+     */
+    if (dest <= db->pc_next || !translator_is_same_page(db, dest)) {
+        return false;
+    }
+    if (tb_page_addr0(db->tb) == -1 || tb_page_addr1(db->tb) != -1) {
+        return false;
+    }
+    return db->num_insns < db->max_insns && !tcg_op_buf_full();
+}
+
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
                      vaddr pc, void *host_pc, const TranslatorOps *ops,
                      DisasContextBase *db)
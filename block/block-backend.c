@@ -1576,6 +1576,50 @@ static void blk_aio_complete_bh(void *opaque)
     blk_aio_complete(acb);
 }
 
+static void coroutine_fn blk_aio_read_entry(void *opaque);
+
+static void blk_aio_read_direct_cb(void *opaque, int ret)
+{
+    BlkAioEmAIOCB *acb = opaque;
+
+    bdrv_graph_rdunlock();
+    acb->rwco.ret = ret;
+    blk_aio_complete(acb);
+}
+
+/*
+ * Most reads only need a coroutine in case they yield for something else
+ * than the I/O itself.  If blk_co_do_preadv_part() would have nothing to do
+ * but pass the request down, and the root node can submit it without a
+ * coroutine, skip creating one.
+ *
+ * Like blk_co_do_preadv_part(), hold the graph lock until the read
+ * completes.  Rather than wait for a writer, leave the request to the
+ * coroutine path.
+ */
+static bool TSA_NO_TSA blk_aio_read_direct(BlkAioEmAIOCB *acb)
+{
+    BlockBackend *blk = acb->rwco.blk;
+
+    if (qatomic_read(&blk->quiesce_counter) ||
+        blk->public.throttle_group_member.throttle_state ||
+        blk_dev_is_tray_open(blk)) {
+        return false;
+    }
+
+    if (!bdrv_graph_tryrdlock()) {
+        return false;
+    }
+    if (!blk->root ||
+        !bdrv_try_aio_preadv(blk->root, acb->rwco.offset, acb->bytes,
+                             acb->rwco.iobuf, acb->rwco.flags,
+                             blk_aio_read_direct_cb, acb)) {
+        bdrv_graph_rdunlock();
+        return false;
+    }
+    return true;
+}
+
 static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset,
                                 int64_t bytes,
                                 void *iobuf, CoroutineEntry co_entry,
@@ -1597,8 +1641,10 @@ static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset,
     acb->bytes = bytes;
     acb->has_returned = false;
 
-    co = qemu_coroutine_create(co_entry, acb);
-    aio_co_enter(qemu_get_current_aio_context(), co);
+    if (co_entry != blk_aio_read_entry || !blk_aio_read_direct(acb)) {
+        co = qemu_coroutine_create(co_entry, acb);
+        aio_co_enter(qemu_get_current_aio_context(), co);
+    }
 
     acb->has_returned = true;
     if (acb->rwco.ret != NOT_DONE) {
@@ -2533,6 +2533,9 @@ static inline bool raw_check_linux_io_uring(BDRVRawState *s)
     }
 
     ctx = qemu_get_current_aio_context();
+    if (aio_has_io_uring(ctx)) {
+        return true; /* luring_co_submit() uses the AioContext's own ring */
+    }
     if (unlikely(!aio_setup_linux_io_uring(ctx, &local_err))) {
         error_reportf_err(local_err, "Unable to use linux io_uring, "
                                      "falling back to thread pool: ");
@@ -2667,6 +2670,29 @@ static int coroutine_fn raw_co_preadv(BlockDriverState *bs, int64_t offset,
     return raw_co_prw(bs, &offset, bytes, qiov, QEMU_AIO_READ, flags);
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Reads that raw_co_prw() would submit to the AioContext's own io_uring can
+ * be submitted without a coroutine; the CQE handler then completes them.
+ */
+static bool GRAPH_RDLOCK
+raw_try_aio_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                   QEMUIOVector *qiov, BlockCompletionFunc *cb, void *opaque)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (!s->use_linux_io_uring || s->fd < 0 ||
+        !aio_has_io_uring(qemu_get_current_aio_context()) ||
+        (s->needs_alignment && !bdrv_qiov_is_aligned(bs, qiov))) {
+        return false;
+    }
+
+    assert(qiov->size == bytes);
+    luring_aio_submit(bs, s->fd, offset, qiov, QEMU_AIO_READ, cb, opaque);
+    return true;
+}
+#endif
+
 static int coroutine_fn raw_co_pwritev(BlockDriverState *bs, int64_t offset,
                                        int64_t bytes, QEMUIOVector *qiov,
                                        BdrvRequestFlags flags)
@@ -3997,6 +4023,9 @@ BlockDriver bdrv_file = {
     .bdrv_co_pwritev        = raw_co_pwritev,
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_co_pdiscard       = raw_co_pdiscard,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_try_aio_preadv    = raw_try_aio_preadv,
+#endif
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
@@ -4455,6 +4484,9 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_pwritev        = raw_co_pwritev,
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_co_pdiscard       = hdev_co_pdiscard,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_try_aio_preadv    = raw_try_aio_preadv,
+#endif
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
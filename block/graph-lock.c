@@ -233,7 +233,7 @@ void coroutine_fn bdrv_graph_co_rdlock(void)
     }
 }
 
-void coroutine_fn bdrv_graph_co_rdunlock(void)
+static void bdrv_graph_do_rdunlock(void)
 {
     BdrvGraphRWlock *bdrv_graph;
     bdrv_graph = qemu_get_current_aio_context()->bdrv_graph;
@@ -254,6 +254,33 @@ void coroutine_fn bdrv_graph_co_rdunlock(void)
     }
 }
 
+void coroutine_fn bdrv_graph_co_rdunlock(void)
+{
+    bdrv_graph_do_rdunlock();
+}
+
+bool bdrv_graph_tryrdlock(void)
+{
+    BdrvGraphRWlock *bdrv_graph;
+    bdrv_graph = qemu_get_current_aio_context()->bdrv_graph;
+
+    qatomic_set(&bdrv_graph->reader_count, bdrv_graph->reader_count + 1);
+    /* make sure writer sees reader_count before we check has_writer */
+    smp_mb();
+
+    /* As in bdrv_graph_co_rdlock(), but back off instead of sleeping */
+    if (!qatomic_read(&has_writer)) {
+        return true;
+    }
+    bdrv_graph_do_rdunlock();
+    return false;
+}
+
+void bdrv_graph_rdunlock(void)
+{
+    bdrv_graph_do_rdunlock();
+}
+
 void bdrv_graph_rdlock_main_loop(void)
 {
     GLOBAL_STATE_CODE();
@@ -586,7 +586,7 @@ void bdrv_drain_all(void)
  *
  * This function should be called when a tracked request is completing.
  */
-static void coroutine_fn tracked_request_end(BdrvTrackedRequest *req)
+static void coroutine_mixed_fn tracked_request_end(BdrvTrackedRequest *req)
 {
     if (req->serialising) {
         qatomic_dec(&req->bs->serialising_in_flight);
@@ -600,18 +600,19 @@ static void coroutine_fn tracked_request_end(BdrvTrackedRequest *req)
      * At this point qemu_co_queue_wait(&req->wait_queue, ...) won't be called
      * anymore because the request has been removed from the list, so it's safe
      * to restart the queue outside reqs_lock to minimize the critical section.
+     * Outside coroutine context (see bdrv_try_aio_preadv()) the waiters are
+     * entered right away.
      */
-    qemu_co_queue_restart_all(&req->wait_queue);
+    qemu_co_enter_all(&req->wait_queue, NULL);
 }
 
 /**
  * Add an active request to the tracked requests list
  */
-static void coroutine_fn tracked_request_begin(BdrvTrackedRequest *req,
-                                               BlockDriverState *bs,
-                                               int64_t offset,
-                                               int64_t bytes,
-                                               enum BdrvTrackedRequestType type)
+static void coroutine_mixed_fn
+tracked_request_begin(BdrvTrackedRequest *req, BlockDriverState *bs,
+                      int64_t offset, int64_t bytes,
+                      enum BdrvTrackedRequestType type)
 {
     bdrv_check_request(offset, bytes, &error_abort);
 
@@ -620,7 +621,7 @@ static void coroutine_fn tracked_request_begin(BdrvTrackedRequest *req,
         .offset         = offset,
         .bytes          = bytes,
         .type           = type,
-        .co             = qemu_coroutine_self(),
+        .co             = qemu_in_coroutine() ? qemu_coroutine_self() : NULL,
         .serialising    = false,
         .overlap_offset = offset,
         .overlap_bytes  = bytes,
@@ -1836,6 +1837,87 @@ fail:
     return ret;
 }
 
+typedef struct BdrvTryAIOPreadv {
+    BdrvTrackedRequest req;
+    BlockCompletionFunc *cb;
+    void *opaque;
+} BdrvTryAIOPreadv;
+
+static void bdrv_try_aio_preadv_cb(void *opaque, int ret)
+{
+    BdrvTryAIOPreadv *r = opaque;
+    BlockDriverState *bs = r->req.bs;
+
+    tracked_request_end(&r->req);
+    bdrv_dec_in_flight(bs);
+    r->cb(r->opaque, ret);
+    g_free(r);
+}
+
+bool GRAPH_RDLOCK
+bdrv_try_aio_preadv(BdrvChild *child, int64_t offset, int64_t bytes,
+                    QEMUIOVector *qiov, BdrvRequestFlags flags,
+                    BlockCompletionFunc *cb, void *opaque)
+{
+    BlockDriverState *bs = child->bs;
+    BlockDriver *drv = bs->drv;
+    BdrvTryAIOPreadv *r;
+    int64_t max_transfer;
+    IO_CODE();
+
+    /*
+     * Anything that bdrv_co_preadv_part() and bdrv_aligned_preadv() would
+     * do besides calling the driver: copy-on-read, waiting for serialising
+     * requests, padding, splitting, zeroing past the end of the node.
+     */
+    if (!drv || !drv->bdrv_try_aio_preadv ||
+        (flags & ~BDRV_REQ_REGISTERED_BUF) ||
+        (bs->open_flags & BDRV_O_NO_IO) ||
+        bs->bl.has_variable_length ||
+        qatomic_read(&bs->copy_on_read) ||
+        qatomic_read(&bs->serialising_in_flight)) {
+        return false;
+    }
+
+    max_transfer = QEMU_ALIGN_DOWN(MIN_NON_ZERO(bs->bl.max_transfer, INT_MAX),
+                                   bs->bl.request_alignment);
+    if (bytes <= 0 || bytes > max_transfer || offset < 0 ||
+        !QEMU_IS_ALIGNED(offset | bytes, bs->bl.request_alignment) ||
+        offset > bs->total_sectors * BDRV_SECTOR_SIZE - bytes ||
+        qiov->size != bytes) {
+        return false;
+    }
+
+    bdrv_inc_in_flight(bs);
+    r = g_new(BdrvTryAIOPreadv, 1);
+    r->cb = cb;
+    r->opaque = opaque;
+
+    /*
+     * Serialising requests that start from now on wait for this one.  Those
+     * which started before made themselves serialising under reqs_lock, as
+     * tracked_request_begin() adds this one, so the check below sees them.
+     */
+    tracked_request_begin(&r->req, bs, offset, bytes, BDRV_TRACKED_READ);
+    if (qatomic_read(&bs->serialising_in_flight)) {
+        goto fail;
+    }
+
+    trace_bdrv_try_aio_preadv(bs, offset, bytes);
+
+    if (!drv->bdrv_try_aio_preadv(bs, offset, bytes, qiov,
+                                  bdrv_try_aio_preadv_cb, r)) {
+        goto fail;
+    }
+    return true;
+
+fail:
+    tracked_request_end(&r->req);
+    g_free(r);
+    bdrv_dec_in_flight(bs);
+    return false;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 bdrv_co_do_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
                          BdrvRequestFlags flags)
@@ -7,6 +7,11 @@
  *
  * This work is licensed under the terms of the GNU GPL, version 2 or later.
  * See the COPYING file in the top-level directory.
+ *
+ * When the AioContext already monitors file descriptors with io_uring,
+ * requests are submitted on that ring with aio_add_sqe() so that submission
+ * and completion share the event loop's io_uring_enter(2) calls.  Otherwise
+ * the AioContext gets a LuringState with a ring of its own.
  */
 #include "qemu/osdep.h"
 #include <liburing.h>
@@ -28,15 +33,23 @@
 
 typedef struct LuringAIOCB {
     Coroutine *co;
+
+    /* Only used when submitted with luring_aio_submit() */
+    BlockCompletionFunc *cb;
+    void *opaque;
+
     struct io_uring_sqe sqeq;
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
+    /* Only used when submitted with aio_add_sqe() */
+    CqeHandler cqe_handler;
+
     /*
      * Buffered reads may require resubmission, see
-     * luring_resubmit_short_read().
+     * luring_prep_short_read().
      */
     int total_read;
     QEMUIOVector resubmit_qiov;
@@ -73,18 +86,17 @@ static void luring_resubmit(LuringState *s, LuringAIOCB *luringcb)
 }
 
 /**
- * luring_resubmit_short_read:
+ * luring_prep_short_read:
  *
- * Short reads are rare but may occur. The remaining read request needs to be
- * resubmitted.
+ * Short reads are rare but may occur. Update the sqe so that the remaining
+ * read request can be resubmitted.
  */
-static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
-                                       int nread)
+static void luring_prep_short_read(LuringAIOCB *luringcb, int nread)
 {
     QEMUIOVector *resubmit_qiov;
     size_t remaining;
 
-    trace_luring_resubmit_short_read(s, luringcb, nread);
+    trace_luring_resubmit_short_read(luringcb, nread);
 
     /* Update read position */
     luringcb->total_read += nread;
@@ -104,8 +116,66 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luringcb->sqeq.off += nread;
     luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
     luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+}
+
+/**
+ * luring_complete:
+ * @luringcb: the request
+ * @ret: result from the request's cqe
+ *
+ * Fill in luringcb->ret from the cqe result.
+ *
+ * Returns: true if the request has completed, false if its sqe must be
+ * resubmitted
+ */
+static bool luring_complete(LuringAIOCB *luringcb, int ret)
+{
+    /* total_read is non-zero only for resubmitted read requests */
+    int total_bytes = ret + luringcb->total_read;
 
-    luring_resubmit(s, luringcb);
+    if (ret < 0) {
+        /*
+         * Only writev/readv/fsync requests on regular files or host block
+         * devices are submitted. Therefore -EAGAIN is not expected but it's
+         * known to happen sometimes with Linux SCSI. Submit again and hope
+         * the request completes successfully.
+         *
+         * For more information, see:
+         * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
+         *
+         * If the code is changed to submit other types of requests in the
+         * future, then this workaround may need to be extended to deal with
+         * genuine -EAGAIN results that should not be resubmitted
+         * immediately.
+         */
+        if (ret == -EINTR || ret == -EAGAIN) {
+            return false;
+        }
+    } else if (!luringcb->qiov) {
+        goto end;
+    } else if (total_bytes == luringcb->qiov->size) {
+        ret = 0;
+    /* Only read/write */
+    } else {
+        /* Short Read/Write */
+        if (luringcb->is_read) {
+            if (ret > 0) {
+                luring_prep_short_read(luringcb, ret);
+                return false;
+            } else {
+                /* Pad with zeroes */
+                qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
+                                  luringcb->qiov->size - total_bytes);
+                ret = 0;
+            }
+        } else {
+            ret = -ENOSPC;
+        }
+    }
+end:
+    luringcb->ret = ret;
+    qemu_iovec_destroy(&luringcb->resubmit_qiov);
+    return true;
 }
 
 /**
@@ -124,7 +194,6 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 static void luring_process_completions(LuringState *s)
 {
     struct io_uring_cqe *cqes;
-    int total_bytes;
 
     defer_call_begin();
 
@@ -162,52 +231,10 @@ static void luring_process_completions(LuringState *s)
         s->io_q.in_flight--;
         trace_luring_process_completion(s, luringcb, ret);
 
-        /* total_read is non-zero only for resubmitted read requests */
-        total_bytes = ret + luringcb->total_read;
-
-        if (ret < 0) {
-            /*
-             * Only writev/readv/fsync requests on regular files or host block
-             * devices are submitted. Therefore -EAGAIN is not expected but it's
-             * known to happen sometimes with Linux SCSI. Submit again and hope
-             * the request completes successfully.
-             *
-             * For more information, see:
-             * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
-             *
-             * If the code is changed to submit other types of requests in the
-             * future, then this workaround may need to be extended to deal with
-             * genuine -EAGAIN results that should not be resubmitted
-             * immediately.
-             */
-            if (ret == -EINTR || ret == -EAGAIN) {
-                luring_resubmit(s, luringcb);
-                continue;
-            }
-        } else if (!luringcb->qiov) {
-            goto end;
-        } else if (total_bytes == luringcb->qiov->size) {
-            ret = 0;
-        /* Only read/write */
-        } else {
-            /* Short Read/Write */
-            if (luringcb->is_read) {
-                if (ret > 0) {
-                    luring_resubmit_short_read(s, luringcb, ret);
-                    continue;
-                } else {
-                    /* Pad with zeroes */
-                    qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
-                                      luringcb->qiov->size - total_bytes);
-                    ret = 0;
-                }
-            } else {
-                ret = -ENOSPC;
-            }
+        if (!luring_complete(luringcb, ret)) {
+            luring_resubmit(s, luringcb);
+            continue;
         }
-end:
-        luringcb->ret = ret;
-        qemu_iovec_destroy(&luringcb->resubmit_qiov);
 
         /*
          * If the coroutine is already entered it must be in ioq_submit()
@@ -324,20 +351,18 @@ static void luring_deferred_fn(void *opaque)
 }
 
 /**
- * luring_do_submit:
+ * luring_prep_sqeq:
  * @fd: file descriptor for I/O
  * @luringcb: AIO control block
- * @s: AIO state
  * @offset: offset for request
  * @type: type of request
  *
- * Fetches sqes from ring, adds to pending queue and preps them
+ * Preps luringcb->sqeq for the request
  *
  */
-static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
-                            uint64_t offset, int type, BdrvRequestFlags flags)
+static void luring_prep_sqeq(int fd, LuringAIOCB *luringcb, uint64_t offset,
+                             int type, BdrvRequestFlags flags)
 {
-    int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
 
     switch (type) {
@@ -371,6 +396,25 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
         abort();
     }
     io_uring_sqe_set_data(sqes, luringcb);
+}
+
+/**
+ * luring_do_submit:
+ * @fd: file descriptor for I/O
+ * @luringcb: AIO control block
+ * @s: AIO state
+ * @offset: offset for request
+ * @type: type of request
+ *
+ * Fetches sqes from ring, adds to pending queue and preps them
+ *
+ */
+static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
+                            uint64_t offset, int type, BdrvRequestFlags flags)
+{
+    int ret;
+
+    luring_prep_sqeq(fd, luringcb, offset, type, flags);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
     s->io_q.in_queue++;
@@ -388,19 +432,85 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     return 0;
 }
 
+static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
+{
+    LuringAIOCB *luringcb = opaque;
+
+    *sqe = luringcb->sqeq;
+}
+
+/* Completion callback for requests submitted with aio_add_sqe() */
+static void luring_cqe_handler(CqeHandler *cqe_handler)
+{
+    LuringAIOCB *luringcb = container_of(cqe_handler, LuringAIOCB,
+                                         cqe_handler);
+    int ret = cqe_handler->cqe.res;
+
+    trace_luring_process_completion(NULL, luringcb, ret);
+
+    if (!luring_complete(luringcb, ret)) {
+        aio_add_sqe(luring_prep_sqe, luringcb, cqe_handler);
+        return;
+    }
+
+    if (luringcb->cb) {
+        luringcb->cb(luringcb->opaque, luringcb->ret);
+        g_free(luringcb);
+        return;
+    }
+
+    assert(luringcb->co->ctx == qemu_get_current_aio_context());
+    aio_co_wake(luringcb->co);
+}
+
+void luring_aio_submit(BlockDriverState *bs, int fd, uint64_t offset,
+                       QEMUIOVector *qiov, int type,
+                       BlockCompletionFunc *cb, void *opaque)
+{
+    LuringAIOCB *luringcb = g_new(LuringAIOCB, 1);
+
+    assert(aio_has_io_uring(qemu_get_current_aio_context()));
+
+    *luringcb = (LuringAIOCB) {
+        .cb         = cb,
+        .opaque     = opaque,
+        .ret        = -EINPROGRESS,
+        .qiov       = qiov,
+        .is_read    = (type == QEMU_AIO_READ),
+        .cqe_handler.cb = luring_cqe_handler,
+    };
+
+    trace_luring_aio_submit(bs, luringcb, fd, offset, qiov->size, type);
+    luring_prep_sqeq(fd, luringcb, offset, type, 0);
+    aio_add_sqe(luring_prep_sqe, luringcb, &luringcb->cqe_handler);
+}
+
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type,
                                   BdrvRequestFlags flags)
 {
     int ret;
     AioContext *ctx = qemu_get_current_aio_context();
-    LuringState *s = aio_get_linux_io_uring(ctx);
+    LuringState *s;
     LuringAIOCB luringcb = {
         .co         = qemu_coroutine_self(),
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
         .is_read    = (type == QEMU_AIO_READ),
+        .cqe_handler.cb = luring_cqe_handler,
     };
+
+    /* Completion is only reported by the event loop, so always yield */
+    if (aio_has_io_uring(ctx)) {
+        trace_luring_co_submit(bs, NULL, &luringcb, fd, offset,
+                               qiov ? qiov->size : 0, type);
+        luring_prep_sqeq(fd, &luringcb, offset, type, flags);
+        aio_add_sqe(luring_prep_sqe, &luringcb, &luringcb.cqe_handler);
+        qemu_coroutine_yield();
+        return luringcb.ret;
+    }
+
+    s = aio_get_linux_io_uring(ctx);
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
     ret = luring_do_submit(fd, &luringcb, s, offset, type, flags);
@@ -221,6 +221,18 @@ raw_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     return bdrv_co_preadv(bs->file, offset, bytes, qiov, flags);
 }
 
+static bool GRAPH_RDLOCK
+raw_try_aio_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                   QEMUIOVector *qiov, BlockCompletionFunc *cb, void *opaque)
+{
+    /* Out-of-range requests fail in raw_co_preadv() */
+    if (raw_adjust_offset(bs, &offset, bytes, false)) {
+        return false;
+    }
+
+    return bdrv_try_aio_preadv(bs->file, offset, bytes, qiov, 0, cb, opaque);
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 raw_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
                QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -648,6 +660,7 @@ BlockDriver bdrv_raw = {
     .bdrv_co_create_opts  = &raw_co_create_opts,
     .bdrv_co_preadv       = &raw_co_preadv,
     .bdrv_co_pwritev      = &raw_co_pwritev,
+    .bdrv_try_aio_preadv  = &raw_try_aio_preadv,
     .bdrv_co_pwrite_zeroes = &raw_co_pwrite_zeroes,
     .bdrv_co_pdiscard     = &raw_co_pdiscard,
     .bdrv_co_zone_report  = &raw_co_zone_report,
@@ -215,8 +215,17 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 /*
  * Some targets clear the FP flags before most FP operations. This prevents
  * the use of hardfloat, since hardfloat relies on the inexact flag being
- * already set.
+ * already set.  Operations whose rounding error can be computed cheaply on
+ * the host (see the *_exact functions below) use hardfloat anyway, and
+ * raise inexact themselves.  That computation is only correct when the host
+ * evaluates float and double expressions in their own precision.
  */
+#if FLT_EVAL_METHOD == 0
+# define QEMU_HARDFLOAT_EXACT 1
+#else
+# define QEMU_HARDFLOAT_EXACT 0
+#endif
+
 # if defined(__FAST_MATH__)
 #  warning disabling hardfloat due to -ffast-math: hardfloat requires an exact \
     IEEE implementation
@@ -236,6 +245,15 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/* As can_use_fpu, for an operation which computes inexact itself. */
+static inline bool can_use_fpu_exact(const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT || !QEMU_HARDFLOAT_EXACT) {
+        return false;
+    }
+    return s->float_rounding_mode == float_round_nearest_even;
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -260,6 +278,10 @@ typedef union {
 
 typedef bool (*f32_check_fn)(union_float32 a, union_float32 b);
 typedef bool (*f64_check_fn)(union_float64 a, union_float64 b);
+typedef bool (*f32_exact_fn)(union_float32 a, union_float32 b,
+                             union_float32 r);
+typedef bool (*f64_exact_fn)(union_float64 a, union_float64 b,
+                             union_float64 r);
 
 typedef float32 (*soft_f32_op2_fn)(float32 a, float32 b, float_status *s);
 typedef float64 (*soft_f64_op2_fn)(float64 a, float64 b, float_status *s);
@@ -334,18 +356,26 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+/*
+ * @exact, if not NULL, returns true if @r is the exact result of the
+ * operation on @a and @b.  It is only called for normal results.
+ */
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
-             f32_check_fn pre, f32_check_fn post)
+             f32_check_fn pre, f32_check_fn post, f32_exact_fn exact)
 {
     union_float32 ua, ub, ur;
+    bool check_inexact = false;
 
     ua.s = xa;
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
-        goto soft;
+        if (!exact || !can_use_fpu_exact(s)) {
+            goto soft;
+        }
+        check_inexact = true;
     }
 
     float32_input_flush2(&ua.s, &ub.s, s);
@@ -355,9 +385,11 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 
     ur.h = hard(ua.h, ub.h);
     if (unlikely(f32_is_inf(ur))) {
-        float_raise(float_flag_overflow, s);
+        float_raise(float_flag_overflow | float_flag_inexact, s);
     } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (check_inexact && !exact(ua, ub, ur)) {
+        float_raise(float_flag_inexact, s);
     }
     return ur.s;
 
@@ -368,15 +400,19 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 static inline float64
 float64_gen2(float64 xa, float64 xb, float_status *s,
              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
-             f64_check_fn pre, f64_check_fn post)
+             f64_check_fn pre, f64_check_fn post, f64_exact_fn exact)
 {
     union_float64 ua, ub, ur;
+    bool check_inexact = false;
 
     ua.s = xa;
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
-        goto soft;
+        if (!exact || !can_use_fpu_exact(s)) {
+            goto soft;
+        }
+        check_inexact = true;
     }
 
     float64_input_flush2(&ua.s, &ub.s, s);
@@ -386,9 +422,11 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
 
     ur.h = hard(ua.h, ub.h);
     if (unlikely(f64_is_inf(ur))) {
-        float_raise(float_flag_overflow, s);
+        float_raise(float_flag_overflow | float_flag_inexact, s);
     } else if (unlikely(fabs(ur.h) <= DBL_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (check_inexact && !exact(ua, ub, ur)) {
+        float_raise(float_flag_inexact, s);
     }
     return ur.s;
 
@@ -396,6 +434,97 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     return soft(ua.s, ub.s, s);
 }
 
+/*
+ * Batched flavor of the above, for the add, sub and mul vector helpers.
+ * A chunk of lanes is computed on the host FPU and checked in loops that
+ * the compiler can vectorize.  The lanes that fail the checks are redone
+ * with the scalar function, which takes care of NaNs, denormals, overflow
+ * and underflow exactly like it does outside of vectors.
+ */
+#define GEN2_VEC_CHUNK  16
+
+static inline void
+float32_gen2_vec(float32 *d, const float32 *a, const float32 *b, size_t n,
+                 float_status *s, hard_f32_op2_fn hard,
+                 soft_f32_op2_fn scalar, f32_check_fn post)
+{
+    union_float32 ur[GEN2_VEC_CHUNK];
+    bool ok[GEN2_VEC_CHUNK];
+    size_t i, j, k;
+
+    if (unlikely(!can_use_fpu(s))) {
+        for (i = 0; i < n; i++) {
+            d[i] = scalar(a[i], b[i], s);
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i += k) {
+        bool all = true;
+
+        k = MIN(n - i, GEN2_VEC_CHUNK);
+        for (j = 0; j < k; j++) {
+            union_float32 ua = { .s = a[i + j] };
+            union_float32 ub = { .s = b[i + j] };
+
+            ur[j].h = hard(ua.h, ub.h);
+            ok[j] = f32_is_zon2(ua, ub) & !f32_is_inf(ur[j]) &
+                    ((fabsf(ur[j].h) > FLT_MIN) | !post(ua, ub));
+            all &= ok[j];
+        }
+        if (likely(all)) {
+            for (j = 0; j < k; j++) {
+                d[i + j] = ur[j].s;
+            }
+        } else {
+            for (j = 0; j < k; j++) {
+                d[i + j] = ok[j] ? ur[j].s : scalar(a[i + j], b[i + j], s);
+            }
+        }
+    }
+}
+
+static inline void
+float64_gen2_vec(float64 *d, const float64 *a, const float64 *b, size_t n,
+                 float_status *s, hard_f64_op2_fn hard,
+                 soft_f64_op2_fn scalar, f64_check_fn post)
+{
+    union_float64 ur[GEN2_VEC_CHUNK];
+    bool ok[GEN2_VEC_CHUNK];
+    size_t i, j, k;
+
+    if (unlikely(!can_use_fpu(s))) {
+        for (i = 0; i < n; i++) {
+            d[i] = scalar(a[i], b[i], s);
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i += k) {
+        bool all = true;
+
+        k = MIN(n - i, GEN2_VEC_CHUNK);
+        for (j = 0; j < k; j++) {
+            union_float64 ua = { .s = a[i + j] };
+            union_float64 ub = { .s = b[i + j] };
+
+            ur[j].h = hard(ua.h, ub.h);
+            ok[j] = f64_is_zon2(ua, ub) & !f64_is_inf(ur[j]) &
+                    ((fabs(ur[j].h) > DBL_MIN) | !post(ua, ub));
+            all &= ok[j];
+        }
+        if (likely(all)) {
+            for (j = 0; j < k; j++) {
+                d[i + j] = ur[j].s;
+            }
+        } else {
+            for (j = 0; j < k; j++) {
+                d[i + j] = ok[j] ? ur[j].s : scalar(a[i + j], b[i + j], s);
+            }
+        }
+    }
+}
+
 /*
  * Classify a floating point number. Everything above float_class_qnan
  * is a NaN so cls >= float_class_qnan is any NaN.
@@ -1968,6 +2097,38 @@ static double hard_f64_sub(double a, double b)
     return a - b;
 }
 
+/*
+ * Knuth's TwoSum: the rounding error of r = a + b, computed exactly with
+ * round-to-nearest arithmetic.
+ */
+static bool f32_add_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    float bv = r.h - a.h;
+
+    return (a.h - (r.h - bv)) + (b.h - bv) == 0;
+}
+
+static bool f32_sub_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    float bv = r.h - a.h;
+
+    return (a.h - (r.h - bv)) + (-b.h - bv) == 0;
+}
+
+static bool f64_add_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    double bv = r.h - a.h;
+
+    return (a.h - (r.h - bv)) + (b.h - bv) == 0;
+}
+
+static bool f64_sub_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    double bv = r.h - a.h;
+
+    return (a.h - (r.h - bv)) + (-b.h - bv) == 0;
+}
+
 static bool f32_addsubmul_post(union_float32 a, union_float32 b)
 {
     if (QEMU_HARDFLOAT_2F32_USE_FP) {
@@ -1986,41 +2147,47 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
 }
 
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
-                              hard_f32_op2_fn hard, soft_f32_op2_fn soft)
+                              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+                              f32_exact_fn exact)
 {
     return float32_gen2(a, b, s, hard, soft,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, exact);
 }
 
 static float64 float64_addsub(float64 a, float64 b, float_status *s,
-                              hard_f64_op2_fn hard, soft_f64_op2_fn soft)
+                              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+                              f64_exact_fn exact)
 {
     return float64_gen2(a, b, s, hard, soft,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post, exact);
 }
 
 float32 QEMU_FLATTEN
 float32_add(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add);
+    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add,
+                          f32_add_exact);
 }
 
 float32 QEMU_FLATTEN
 float32_sub(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub);
+    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub,
+                          f32_sub_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_add(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add);
+    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add,
+                          f64_add_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_sub(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub);
+    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub,
+                          f64_sub_exact);
 }
 
 static float64 float64r32_addsub(float64 a, float64 b, float_status *status,
@@ -2162,18 +2329,76 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+/* The product of two floats is exact in double precision. */
+static bool f32_mul_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return (double)a.h * b.h == r.h;
+}
+
+/*
+ * There is no cheap equivalent for float64: the error of the product
+ * needs a fused multiply-add, which underflows for some normal results.
+ */
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_mul, soft_f32_mul,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, f32_mul_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_mul(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_mul, soft_f64_mul,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post, NULL);
+}
+
+void QEMU_FLATTEN
+float32_add_vec(float32 *d, const float32 *a, const float32 *b,
+                size_t n, float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32_add, float32_add,
+                     f32_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float32_sub_vec(float32 *d, const float32 *a, const float32 *b,
+                size_t n, float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32_sub, float32_sub,
+                     f32_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float32_mul_vec(float32 *d, const float32 *a, const float32 *b,
+                size_t n, float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32_mul, float32_mul,
+                     f32_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float64_add_vec(float64 *d, const float64 *a, const float64 *b,
+                size_t n, float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64_add, float64_add,
+                     f64_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float64_sub_vec(float64 *d, const float64 *a, const float64 *b,
+                size_t n, float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64_sub, float64_sub,
+                     f64_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float64_mul_vec(float64 *d, const float64 *a, const float64 *b,
+                size_t n, float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64_mul, float64_mul,
+                     f64_addsubmul_post);
 }
 
 float64 float64r32_mul(float64 a, float64 b, float_status *status)
@@ -2540,18 +2765,24 @@ static bool f64_div_post(union_float64 a, union_float64 b)
     return !float64_is_zero(a.s);
 }
 
+/* As for f32_mul_exact: the quotient is exact iff r * b == a. */
+static bool f32_div_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return (double)r.h * b.h == a.h;
+}
+
 float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_div, soft_f32_div,
-                        f32_div_pre, f32_div_post);
+                        f32_div_pre, f32_div_post, f32_div_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_div(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_div, soft_f64_div,
-                        f64_div_pre, f64_div_post);
+                        f64_div_pre, f64_div_post, NULL);
 }
 
 float64 float64r32_div(float64 a, float64 b, float_status *status)
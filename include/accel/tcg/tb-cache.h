@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Persistent TCG translation profile
+ *
+ * Records which translation blocks were generated during a run, and
+ * uses that record on the next run to translate a page's known TBs in
+ * one batch on the first miss within that page.
+ *
+ * In user mode, blocks in executable file mappings are recorded by
+ * file and offset, so that the record is shared by every process that
+ * maps the same file, wherever it is mapped.
+ */
+
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+#include "exec/translation-block.h"
+#include "accel/tcg/tb-cpu-state.h"
+
+/* Upper bound on the number of TBs prewarmed for one page. */
+#define TB_CACHE_PAGE_MAX  64
+
+/*
+ * When @ino is not zero, @pc and @phys_pc are the offset of the block in
+ * the file identified by @dev and @ino, rather than addresses.
+ */
+typedef struct TBCacheEntry {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t phys_pc;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t size;
+    uint32_t crc;
+} TBCacheEntry;
+
+/**
+ * tb_cache_init:
+ * @path: file to load the profile from, and to save it to on exit
+ *
+ * Enable the translation profile.  The file is only read once the
+ * first translation is requested, when the target page size is final.
+ */
+void tb_cache_init(const char *path);
+
+/**
+ * tb_cache_enabled:
+ *
+ * Return true if tb_cache_init() has been called.
+ */
+bool tb_cache_enabled(void);
+
+/**
+ * tb_cache_record:
+ * @tb: freshly linked translation block
+ * @pc: virtual pc the block was translated for
+ * @host_pc: host address of the guest code at @pc
+ *
+ * Remember @tb so that it can be saved by tb_cache_exit().  Blocks
+ * which span two pages are ignored.
+ */
+void tb_cache_record(const TranslationBlock *tb, vaddr pc,
+                     const void *host_pc);
+
+/**
+ * tb_cache_take_page:
+ * @s: cpu state of a translation block that missed in the QHT
+ * @ents: array of TB_CACHE_PAGE_MAX entries to fill
+ *
+ * Move the loaded entries on the virtual page of @s.pc that were
+ * recorded with the same cs_base, flags and cflags as @s into @ents.
+ * Each entry is returned at most once per run.
+ *
+ * Returns the number of entries filled in.
+ */
+size_t tb_cache_take_page(TCGTBCPUState s, TBCacheEntry *ents);
+
+/**
+ * tb_cache_check:
+ * @e: loaded entry
+ * @phys_pc: current result of get_page_addr_code() for @e->pc
+ * @host_pc: host address of the guest code at @e->pc
+ *
+ * Return true if the guest code at @e->pc is unchanged since @e was
+ * recorded, and it is therefore worth translating ahead of time.
+ */
+bool tb_cache_check(const TBCacheEntry *e, tb_page_addr_t phys_pc,
+                    const void *host_pc);
+
+/**
+ * tb_cache_map_file:
+ * @start: guest address of the new mapping
+ * @len: length of the mapping
+ * @dev: device of the mapped file
+ * @ino: inode of the mapped file
+ * @offset: file offset mapped at @start
+ *
+ * Note that the guest mapped a file read-only and executable.  Blocks
+ * in the mapping will be recorded by file offset, and blocks recorded
+ * for the file by other processes are made available at @start.
+ * Only for user mode, where guest addresses are also phys_pc.
+ */
+void tb_cache_map_file(vaddr start, vaddr len, uint64_t dev, uint64_t ino,
+                       uint64_t offset);
+
+/**
+ * tb_cache_unmap:
+ * @start: guest address
+ * @len: length
+ *
+ * Forget the file mappings that overlap [@start, @start + @len).
+ */
+void tb_cache_unmap(vaddr start, vaddr len);
+
+/**
+ * tb_cache_exit:
+ *
+ * Merge the TBs recorded during this run into the profile file, which
+ * may have been updated by other processes in the meantime.
+ * Only the first call has any effect.
+ */
+void tb_cache_exit(void);
+
+#endif
@@ -106,6 +106,42 @@ typedef struct {
      * Returns: true if ->wait() should be called, false otherwise.
      */
     bool (*need_wait)(AioContext *ctx);
+
+    /*
+     * gsource_prepare:
+     * @ctx: the AioContext
+     *
+     * Prepare for the glib event loop to wait for events instead of the usual
+     * ->wait() call.  See glib's GSourceFuncs->prepare().
+     *
+     * The three gsource callbacks are optional.  Without them, glib polls the
+     * file descriptors of the AioHandlers itself.
+     *
+     * Returns: true if ->gsource_dispatch() has work to do without waiting.
+     */
+    bool (*gsource_prepare)(AioContext *ctx);
+
+    /*
+     * gsource_check:
+     * @ctx: the AioContext
+     *
+     * Called by glib when returning from poll().  See glib's
+     * GSourceFuncs->check().
+     *
+     * Returns: true if ->gsource_dispatch() should be called.
+     */
+    bool (*gsource_check)(AioContext *ctx);
+
+    /*
+     * gsource_dispatch:
+     * @ctx: the AioContext
+     * @ready_list: list for handlers that became ready
+     *
+     * Place the handlers that became ready while glib waited on ready_list.
+     *
+     * Called with ctx->list_lock incremented but not locked.
+     */
+    void (*gsource_dispatch)(AioContext *ctx, AioHandlerList *ready_list);
 } FDMonOps;
 
 /*
@@ -123,10 +159,54 @@ struct BHListSlice {
 
 typedef QSLIST_HEAD(, AioHandler) AioHandlerSList;
 
+/* Number of buckets in AioPolledEvent::hist */
+#define AIO_POLL_HIST_BUCKETS 16
+
 typedef struct AioPolledEvent {
     int64_t ns;        /* current polling time in nanoseconds */
+
+    /* Statistics for adaptive polling, see adjust_polling_time() */
+    uint64_t hits;     /* events that arrived within the polling time */
+    uint64_t misses;   /* events that arrived after the polling time */
+    unsigned idle_rounds; /* polling rounds without an event */
+    unsigned hist_total;  /* sum of hist[] */
+
+    /*
+     * Decayed histogram of event latencies.  Bucket i counts latencies below
+     * 2^(i + 10) ns, the last bucket also counts longer latencies.
+     */
+    unsigned hist[AIO_POLL_HIST_BUCKETS];
 } AioPolledEvent;
 
+/* Adaptive polling state of an AioHandler, see aio_context_foreach_poll() */
+typedef struct AioPollInfo {
+    int fd;
+    bool polling;       /* is the handler polled from userspace? */
+    AioPolledEvent poll;
+} AioPollInfo;
+
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * CqeHandler:
+ *
+ * Completion callback for a request submitted with aio_add_sqe().
+ */
+typedef struct CqeHandler CqeHandler;
+struct CqeHandler {
+    /*
+     * Called by aio_poll() or the GSource in the AioContext's home thread, or
+     * when the AioContext is destroyed with the request still in flight
+     */
+    void (*cb)(CqeHandler *handler);
+
+    /* Filled in before ->cb() is called */
+    struct io_uring_cqe cqe;
+
+    /* Used internally, do not access this */
+    QSIMPLEQ_ENTRY(CqeHandler) next;
+};
+#endif
+
 struct AioContext {
     GSource source;
 
@@ -222,6 +302,16 @@ struct AioContext {
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+    bool fdmon_io_uring_multishot; /* can poll eventfds with multishot? */
+
+    /* Completed aio_add_sqe() requests waiting for their ->cb() */
+    QSIMPLEQ_HEAD(, CqeHandler) cqe_handler_ready_list;
+
+    /* Number of aio_add_sqe() requests whose cqe has not been reaped yet */
+    unsigned cqe_handler_in_flight;
+
+    /* The ring fd in the GSource, see fdmon_io_uring_gsource_prepare() */
+    gpointer fdmon_io_uring_tag;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -517,6 +607,33 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
 
 /* Return the LuringState bound to this AioContext */
 LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+#ifdef CONFIG_LINUX_IO_URING
+/**
+ * aio_has_io_uring:
+ * @ctx: the AioContext
+ *
+ * Return true if @ctx monitors file descriptors with io_uring, in which case
+ * aio_add_sqe() can be used from its home thread.
+ */
+bool aio_has_io_uring(AioContext *ctx);
+
+/**
+ * aio_add_sqe:
+ * @prep_sqe: function to fill in the sqe
+ * @opaque: data to pass to @prep_sqe
+ * @cqe_handler: called when the request completes
+ *
+ * Submit an io_uring request on the current AioContext's ring, which must
+ * satisfy aio_has_io_uring().  The sqe is submitted the next time the event
+ * loop waits for events, together with any other pending sqes, and
+ * @cqe_handler->cb() is called from aio_poll() or the AioContext's GSource
+ * once the request has completed.  @cqe_handler must stay valid until then.
+ */
+void aio_add_sqe(void (*prep_sqe)(struct io_uring_sqe *sqe, void *opaque),
+                 void *opaque, CqeHandler *cqe_handler);
+#endif
+
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
@@ -702,12 +819,29 @@ void aio_context_use_g_source(AioContext *ctx);
  * @grow: polling time growth factor
  * @shrink: polling time shrink factor
  *
- * Poll mode can be disabled by setting poll_max_ns to 0.
+ * Poll mode can be disabled by setting poll_max_ns to 0.  If both @grow and
+ * @shrink are 0, the polling time of each handler is derived from the
+ * latencies of its recent events instead.
  */
 void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_foreach_poll:
+ * @ctx: the aio context
+ * @fn: function to call
+ * @opaque: data to pass to @fn
+ *
+ * Call @fn for each handler of @ctx that supports userspace polling, with a
+ * snapshot of its adaptive polling state.  May be called from any thread, in
+ * which case the statistics can be slightly out of date.
+ */
+void aio_context_foreach_poll(AioContext *ctx,
+                              void (*fn)(const AioPollInfo *info,
+                                         void *opaque),
+                              void *opaque);
+
 /**
  * aio_context_set_aio_params:
  * @ctx: the aio context
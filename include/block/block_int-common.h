@@ -506,6 +506,27 @@ struct BlockDriver {
     BlockAIOCB * GRAPH_RDLOCK_PTR (*bdrv_aio_flush)(
         BlockDriverState *bs, BlockCompletionFunc *cb, void *opaque);
 
+    /**
+     * Start a read without a coroutine, see bdrv_try_aio_preadv().  The
+     * request has already passed the checks of bdrv_co_preadv_part() and
+     * needs no padding, splitting or serialisation: @offset and @bytes are
+     * aligned to 'request_alignment', @bytes is no larger than
+     * 'max_transfer' and equals the size of @qiov, and the request is
+     * within the node.
+     *
+     * Return false, without side effects, if the request must go through
+     * the coroutine path instead.  Otherwise @cb is called from the
+     * current AioContext once the request completes, never before this
+     * function returns.
+     *
+     * Only for drivers whose read path never yields for anything but the
+     * I/O itself.  The caller holds the graph lock, taken with
+     * bdrv_graph_tryrdlock(), until @cb is called.
+     */
+    bool GRAPH_RDLOCK_PTR (*bdrv_try_aio_preadv)(BlockDriverState *bs,
+        int64_t offset, int64_t bytes, QEMUIOVector *qiov,
+        BlockCompletionFunc *cb, void *opaque);
+
     int coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_readv)(BlockDriverState *bs,
         int64_t sector_num, int nb_sectors, QEMUIOVector *qiov);
 
@@ -53,6 +53,22 @@ int coroutine_fn GRAPH_RDLOCK bdrv_co_preadv_part(BdrvChild *child,
 int coroutine_fn GRAPH_RDLOCK bdrv_co_pwritev(BdrvChild *child,
     int64_t offset, int64_t bytes, QEMUIOVector *qiov,
     BdrvRequestFlags flags);
+
+/*
+ * Start a read without a coroutine if @child's driver can complete it on its
+ * own, i.e. bdrv_co_preadv_part() would only count it as in flight and pass
+ * it down.  Return false, without side effects, otherwise.  @cb is called
+ * from the current AioContext, never before this function returns.
+ *
+ * The caller must be in @child's AioContext, and hold the graph lock until
+ * @cb is called.  Outside coroutines, it takes it with bdrv_graph_tryrdlock().
+ * The request is tracked like one from bdrv_co_preadv_part(), so that
+ * serialising requests wait for it.
+ */
+bool GRAPH_RDLOCK
+bdrv_try_aio_preadv(BdrvChild *child, int64_t offset, int64_t bytes,
+                    QEMUIOVector *qiov, BdrvRequestFlags flags,
+                    BlockCompletionFunc *cb, void *opaque);
 int coroutine_fn GRAPH_RDLOCK bdrv_co_pwritev_part(BdrvChild *child,
     int64_t offset, int64_t bytes,
     QEMUIOVector *qiov, size_t qiov_offset, BdrvRequestFlags flags);
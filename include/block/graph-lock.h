@@ -154,6 +154,22 @@ bdrv_graph_co_rdlock(void);
 void coroutine_fn TSA_RELEASE_SHARED(graph_lock) TSA_NO_TSA
 bdrv_graph_co_rdunlock(void);
 
+/*
+ * bdrv_graph_tryrdlock:
+ * Like bdrv_graph_co_rdlock, for code outside coroutines, which cannot wait
+ * for the writer.  Return false without taking the lock if a writer is
+ * active or waiting for readers.  Otherwise the lock must be released with
+ * bdrv_graph_rdunlock, in the same AioContext.
+ */
+bool no_coroutine_fn TSA_NO_TSA bdrv_graph_tryrdlock(void);
+
+/*
+ * bdrv_graph_rdunlock:
+ * Release a lock taken with bdrv_graph_tryrdlock.
+ */
+void no_coroutine_fn TSA_RELEASE_SHARED(graph_lock) TSA_NO_TSA
+bdrv_graph_rdunlock(void);
+
 /*
  * bdrv_graph_rd{un}lock_main_loop:
  * Just a placeholder to mark where the graph rdlock should be taken
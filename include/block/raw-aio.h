@@ -81,6 +81,14 @@ void luring_cleanup(LuringState *s);
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type,
                                   BdrvRequestFlags flags);
+/*
+ * luring_aio_submit: submit a request on the ring of the thread's current
+ * AioContext, which must monitor file descriptors with io_uring (see
+ * aio_has_io_uring()).  @cb is called from the AioContext on completion.
+ */
+void luring_aio_submit(BlockDriverState *bs, int fd, uint64_t offset,
+                       QEMUIOVector *qiov, int type,
+                       BlockCompletionFunc *cb, void *opaque);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 bool luring_has_fua(void);
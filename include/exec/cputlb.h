@@ -229,6 +229,43 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                vaddr len,
                                                uint16_t idxmap,
                                                unsigned bits);
+
+/**
+ * tlb_set_asid_by_mmuidx:
+ * @cpu: CPU whose TLB should be switched
+ * @idxmap: bitmap of MMU indexes to switch
+ * @asid: address space identifier, as defined by the target
+ *
+ * Switch the specified MMU indexes of the TLB of @cpu to the address
+ * space @asid, without flushing the entries of the previous one.
+ * A few recently used address spaces are kept per MMU index, so
+ * switching back to one of them finds its entries still in the TLB.
+ * @asid may combine any identifiers which tag the target's TLB
+ * entries, e.g. an ASID and a VMID; UINT32_MAX is reserved.
+ *
+ * The target must call this whenever the identifier of the current
+ * address space changes without a flush of the MMU indexes.  Entries
+ * of all address spaces are still subject to the other flush functions,
+ * which therefore behave as the "all ASIDs" variants of the
+ * architecture's TLB maintenance operations.
+ */
+void tlb_set_asid_by_mmuidx(CPUState *cpu, uint16_t idxmap, uint32_t asid);
+
+/**
+ * tlb_flush_asid_by_mmuidx:
+ * @cpu: CPU whose TLB should be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ * @asid: address space identifier, as passed to tlb_set_asid_by_mmuidx()
+ *
+ * Flush all entries of the address space @asid from the TLB of the
+ * specified CPU, for the specified MMU indexes.  Entries of other
+ * address spaces are kept.
+ */
+void tlb_flush_asid_by_mmuidx(CPUState *cpu, uint16_t idxmap, uint32_t asid);
+
+/* Similarly, with broadcast and syncing. */
+void tlb_flush_asid_by_mmuidx_all_cpus_synced(CPUState *cpu, uint16_t idxmap,
+                                              uint32_t asid);
 #else
 static inline void tlb_flush_page(CPUState *cpu, vaddr addr)
 {
@@ -282,5 +319,18 @@ static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                              unsigned bits)
 {
 }
+static inline void tlb_set_asid_by_mmuidx(CPUState *cpu, uint16_t idxmap,
+                                          uint32_t asid)
+{
+}
+static inline void tlb_flush_asid_by_mmuidx(CPUState *cpu, uint16_t idxmap,
+                                            uint32_t asid)
+{
+}
+static inline void tlb_flush_asid_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                            uint16_t idxmap,
+                                                            uint32_t asid)
+{
+}
 #endif /* CONFIG_TCG && !CONFIG_USER_ONLY */
 #endif /* CPUTLB_H */
@@ -159,6 +159,19 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct jump
+ *
+ * Return true if translation may continue at @dest within the current
+ * TB, instead of ending the TB with a goto_tb to @dest.  This builds
+ * longer traces for hot blocks, so that the optimizer sees the code
+ * on both sides of the jump.  If so, the caller must arrange for the
+ * next insn to be decoded from @dest, and must leave is_jmp unchanged.
+ */
+bool translator_follow_jump(DisasContextBase *db, vaddr dest);
+
 /**
  * translator_io_start
  * @db: Disassembly context
@@ -603,6 +603,19 @@ float32 float32_rem(float32, float32, float_status *status);
 float32 float32_muladd(float32, float32, float32, int, float_status *status);
 float32 float32_muladd_scalbn(float32, float32, float32,
                               int, int, float_status *status);
+
+/*----------------------------------------------------------------------------
+| Element-wise operations on @n elements, for vector helpers.  The results
+| and exception flags are those of the scalar operation applied to each
+| element in turn.  @d may be equal to, but must not otherwise overlap,
+| @a or @b.
+*----------------------------------------------------------------------------*/
+void float32_add_vec(float32 *d, const float32 *a, const float32 *b,
+                     size_t n, float_status *status);
+void float32_sub_vec(float32 *d, const float32 *a, const float32 *b,
+                     size_t n, float_status *status);
+void float32_mul_vec(float32 *d, const float32 *a, const float32 *b,
+                     size_t n, float_status *status);
 float32 float32_sqrt(float32, float_status *status);
 float32 float32_exp2(float32, float_status *status);
 float32 float32_log2(float32, float_status *status);
@@ -800,6 +813,12 @@ float64 float64_rem(float64, float64, float_status *status);
 float64 float64_muladd(float64, float64, float64, int, float_status *status);
 float64 float64_muladd_scalbn(float64, float64, float64,
                               int, int, float_status *status);
+void float64_add_vec(float64 *d, const float64 *a, const float64 *b,
+                     size_t n, float_status *status);
+void float64_sub_vec(float64 *d, const float64 *a, const float64 *b,
+                     size_t n, float_status *status);
+void float64_mul_vec(float64 *d, const float64 *a, const float64 *b,
+                     size_t n, float_status *status);
 float64 float64_sqrt(float64, float_status *status);
 float64 float64_log2(float64, float_status *status);
 FloatRelation float64_compare(float64, float64, float_status *status);
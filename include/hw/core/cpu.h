@@ -241,6 +241,12 @@ struct CPUTLBEntryFull {
     /* Additional tlb flags requested by tlb_fill. */
     uint8_t tlb_fill_flags;
 
+    /*
+     * @asid contains the address space the entry was added in, as
+     * given to tlb_set_asid_by_mmuidx.  Set by tlb_set_page_full.
+     */
+    uint32_t asid;
+
     /*
      * Additional tlb flags for use by the slow path. If non-zero,
      * the corresponding CPUTLBEntry comparator must have TLB_FORCE_SLOW.
@@ -269,6 +275,30 @@ struct CPUTLBEntryFull {
     } extra;
 };
 
+/* Number of inactive address spaces whose tlb is kept per MMU mode. */
+#define CPU_TLB_ASID_CTXS 4
+
+/* The address space of the entries is not known, see tlb_flush. */
+#define CPU_TLB_ASID_UNKNOWN UINT32_MAX
+
+/*
+ * The tlb of an address space which is not the current one for its
+ * MMU mode.  Switching back to the address space swaps these fields
+ * with those of CPUTLBDesc and CPUTLBDescFast.
+ */
+typedef struct CPUTLBContext {
+    /* CPU_TLB_ASID_UNKNOWN if the slot is free */
+    uint32_t asid;
+    /* value of CPUTLBDesc.asid_clock when the context was switched out */
+    uint32_t lru;
+    uintptr_t mask;
+    CPUTLBEntry *table;
+    CPUTLBEntryFull *fulltlb;
+    vaddr large_page_addr;
+    vaddr large_page_mask;
+    size_t n_used_entries;
+} CPUTLBContext;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -293,6 +323,11 @@ typedef struct CPUTLBDesc {
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
     CPUTLBEntryFull *fulltlb;
+    /* The address space of the entries in fulltlb and the fast table.  */
+    uint32_t asid;
+    uint32_t asid_clock;
+    /* The tlbs of the address spaces used before this one.  */
+    CPUTLBContext ctx[CPU_TLB_ASID_CTXS];
 } CPUTLBDesc;
 
 /*
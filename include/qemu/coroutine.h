@@ -284,6 +284,32 @@ void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
  */
 void qemu_coroutine_dec_pool_size(unsigned int additional_pool_size);
 
+typedef struct CoroutinePoolStats {
+    size_t stack_size;              /* stack size of each coroutine */
+    unsigned long allocated;        /* coroutines, running or pooled */
+    unsigned long trimmed;          /* pooled stacks given back to the host */
+    unsigned int global_size;       /* coroutines in the global pool */
+    unsigned int global_max_size;   /* effective limit of the global pool */
+} CoroutinePoolStats;
+
+/**
+ * Get statistics about the coroutine pool
+ */
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats);
+
+typedef void CoroutineLocalPoolFunc(int thread_id, unsigned int size,
+                                    unsigned long reused, void *opaque);
+
+/**
+ * Call @fn for the local pool of each thread that has used the coroutine
+ * pool, with the number of coroutines it holds and the number of coroutines
+ * the thread got from the pool instead of allocating them.
+ *
+ * @fn must not create or delete coroutines.
+ */
+void qemu_coroutine_foreach_local_pool(CoroutineLocalPoolFunc *fn,
+                                       void *opaque);
+
 /**
  * Sends a (part of) iovec down a socket, yielding when the socket is full, or
  * Receives data into a (part of) iovec from a socket,
@@ -35,6 +35,13 @@ extern __thread void *__safestack_unsafe_stack_ptr;
 
 #define COROUTINE_STACK_SIZE (1 << 20)
 
+/*
+ * Part of the stack of a terminated coroutine that qemu_coroutine_trim()
+ * preserves.  The backend's trampoline stays parked there until the
+ * coroutine is reused.
+ */
+#define COROUTINE_STACK_TRIM_KEEP (1 << 16)
+
 typedef enum {
     COROUTINE_YIELD = 1,
     COROUTINE_TERMINATE = 2,
@@ -71,6 +78,8 @@ struct Coroutine {
 
 Coroutine *qemu_coroutine_new(void);
 void qemu_coroutine_delete(Coroutine *co);
+/* Release the memory of the unused part of a terminated coroutine's stack */
+void qemu_coroutine_trim(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
 
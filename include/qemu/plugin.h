@@ -70,10 +70,24 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_COND,
     PLUGIN_CB_MEM_REGULAR,
+    PLUGIN_CB_MEM_BUFFERED,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
+    PLUGIN_CB_INLINE_RING_APPEND_U64,
+    PLUGIN_CB_INLINE_HASH_ADD_U64,
 };
 
+/*
+ * Slot selected by QEMU_PLUGIN_INLINE_HASH_ADD_U64 for @key in a table
+ * of @n slots, @n being a power of two.
+ */
+#define PLUGIN_INLINE_HASH_MUL 0x9e3779b97f4a7c15ull
+
+static inline uint64_t plugin_inline_hash_slot(uint64_t key, uint64_t n)
+{
+    return n == 1 ? 0 : (key * PLUGIN_INLINE_HASH_MUL) >> (64 - ctz64(n));
+}
+
 struct qemu_plugin_regular_cb {
     union qemu_plugin_cb_sig f;
     TCGHelperInfo *info;
@@ -87,6 +101,30 @@ struct qemu_plugin_inline_cb {
     enum qemu_plugin_mem_rw rw;
 };
 
+/*
+ * Each vcpu entry of @score holds the number of pending records,
+ * followed by @n qemu_plugin_mem_record.  @reserved is the largest
+ * number of records that an instruction appends inline, for which
+ * appends out of line must leave room.
+ */
+struct qemu_plugin_mem_buffer {
+    struct qemu_plugin_scoreboard *score;
+    size_t n;
+    size_t reserved;
+    qemu_plugin_vcpu_mem_batch_cb_t cb;
+    void *userp;
+};
+
+#define PLUGIN_MEM_BUFFER_RECORDS_OFFSET sizeof(uint64_t)
+
+struct qemu_plugin_buffered_cb {
+    struct qemu_plugin_mem_buffer *buf;
+    TCGHelperInfo *flush_info;
+    TCGHelperInfo *append_info;
+    uint64_t pc;
+    enum qemu_plugin_mem_rw rw;
+};
+
 struct qemu_plugin_conditional_cb {
     union qemu_plugin_cb_sig f;
     TCGHelperInfo *info;
@@ -107,6 +145,7 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_buffered_cb buffered;
     };
 };
 
@@ -171,6 +210,10 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              uint64_t value_high,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw);
 
+void plugin_mem_buffer_append(struct qemu_plugin_mem_buffer *buf,
+                              unsigned int cpu_index, uint64_t vaddr,
+                              uint64_t pc, qemu_plugin_meminfo_t info);
+
 void qemu_plugin_flush_cb(void);
 
 void qemu_plugin_atexit_cb(void);
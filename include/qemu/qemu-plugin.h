@@ -65,11 +65,19 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * version 4:
  * - added qemu_plugin_read_memory_vaddr
+ *
+ * version 5:
+ * - added QEMU_PLUGIN_INLINE_RING_APPEND_U64 and
+ *   QEMU_PLUGIN_INLINE_HASH_ADD_U64 inline ops
+ * - qemu_plugin_register_vcpu_{tb, insn, mem}_inline_per_vcpu return
+ *   whether the op was valid and inserted
+ * - added qemu_plugin_mem_buffer_{new,free,flush} and
+ *   qemu_plugin_register_vcpu_mem_buffered
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 4
+#define QEMU_PLUGIN_VERSION 5
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -386,11 +394,31 @@ void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
  *
  * @QEMU_PLUGIN_INLINE_ADD_U64: add an immediate value uint64_t
  * @QEMU_PLUGIN_INLINE_STORE_U64: store an immediate value uint64_t
+ * @QEMU_PLUGIN_INLINE_RING_APPEND_U64: append the key to a ring buffer
+ * @QEMU_PLUGIN_INLINE_HASH_ADD_U64: increment a counter selected by the key
+ *
+ * The last two ops operate on a key, which is the virtual address of
+ * the access for memory ops, and the virtual address of the block or
+ * instruction for execution ops.  Their immediate is a power of two
+ * giving the number of uint64_t slots that follow (for RING_APPEND)
+ * or start at (for HASH_ADD) the entry, all of which must fit in the
+ * scoreboard element.
+ *
+ * RING_APPEND stores the key at slot (entry % imm) after the entry,
+ * then increments the entry. The entry therefore counts every append
+ * so far, and the plugin can tell how many were overwritten before it
+ * read them.
+ *
+ * HASH_ADD adds one to the slot at index
+ * (key * 0x9e3779b97f4a7c15) >> (64 - log2(imm)) from the entry,
+ * which is 0 when imm is 1.
  */
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
     QEMU_PLUGIN_INLINE_STORE_U64,
+    QEMU_PLUGIN_INLINE_RING_APPEND_U64,
+    QEMU_PLUGIN_INLINE_HASH_ADD_U64,
 };
 
 /**
@@ -401,9 +429,12 @@ enum qemu_plugin_op {
  * @imm: the op data (e.g. 1)
  *
  * Insert an inline op on a given scoreboard entry.
+ *
+ * Returns: false if @op, @entry or @imm are invalid, in which case no op
+ * is inserted, true otherwise.
  */
 QEMU_PLUGIN_API
-void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+bool qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
     struct qemu_plugin_tb *tb,
     enum qemu_plugin_op op,
     qemu_plugin_u64 entry,
@@ -459,9 +490,12 @@ void qemu_plugin_register_vcpu_insn_exec_cond_cb(
  * @imm: the op data (e.g. 1)
  *
  * Insert an inline op to every time an instruction executes.
+ *
+ * Returns: false if @op, @entry or @imm are invalid, in which case no op
+ * is inserted, true otherwise.
  */
 QEMU_PLUGIN_API
-void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+bool qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_op op,
     qemu_plugin_u64 entry,
@@ -692,15 +726,111 @@ void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
  *
  * This registers a inline op every memory access generated by the
  * instruction.
+ *
+ * Returns: false if @op, @entry or @imm are invalid, in which case no op
+ * is inserted, true otherwise.
  */
 QEMU_PLUGIN_API
-void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+bool qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_mem_rw rw,
     enum qemu_plugin_op op,
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/** struct qemu_plugin_mem_buffer - Opaque handle for a memory trace buffer */
+struct qemu_plugin_mem_buffer;
+
+/**
+ * typedef qemu_plugin_mem_record - one buffered memory access
+ * @vaddr: the virtual address of the transaction
+ * @pc: the virtual address of the instruction doing the access
+ * @info: as passed to qemu_plugin_vcpu_mem_cb_t
+ */
+typedef struct {
+    uint64_t vaddr;
+    uint64_t pc;
+    qemu_plugin_meminfo_t info;
+    uint32_t reserved;
+} qemu_plugin_mem_record;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_batch_cb_t - memory trace buffer callback
+ * @vcpu_index: the vCPU that recorded the accesses
+ * @records: the accesses, oldest first
+ * @n: number of entries in @records
+ * @userdata: any user data attached to the buffer
+ *
+ * @records is only valid for the duration of the callback.
+ */
+typedef void (*qemu_plugin_vcpu_mem_batch_cb_t)(
+    unsigned int vcpu_index,
+    const qemu_plugin_mem_record *records,
+    size_t n,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_new() - create a memory trace buffer
+ * @n_records: capacity of the buffer of each vCPU
+ * @cb: callback called with the contents of a full buffer
+ * @userdata: any user data to pass to @cb
+ *
+ * Each vCPU records accesses into its own buffer without locking, and
+ * calls @cb from its own thread with the recorded accesses when its
+ * buffer has no room left for those of the next instruction. Records
+ * left over can be retrieved with qemu_plugin_mem_buffer_flush().
+ *
+ * Returns a pointer to a new buffer. It must be freed using
+ * qemu_plugin_mem_buffer_free.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records,
+                           qemu_plugin_vcpu_mem_batch_cb_t cb,
+                           void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_free() - free a memory trace buffer
+ * @buf: buffer to free
+ *
+ * Records still in @buf are dropped.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+/**
+ * qemu_plugin_mem_buffer_flush() - deliver the records of a vCPU
+ * @buf: buffer to flush
+ * @vcpu_index: vCPU whose records are delivered
+ *
+ * Call the buffer callback with the records @vcpu_index has made since
+ * the last time its buffer was delivered, if any. This must either be
+ * called from the thread of @vcpu_index (e.g. from a vcpu_exit
+ * callback) or once no vCPU runs anymore (e.g. from an atexit
+ * callback).
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_register_vcpu_mem_buffered() - record memory accesses
+ * @insn: handle for instruction to instrument
+ * @rw: record reads, writes or both
+ * @buf: buffer to record into
+ *
+ * Append a qemu_plugin_mem_record to @buf for every memory access
+ * generated by the instruction. Appending is done inline; a call is
+ * only made when the buffer fills up. This is much cheaper than
+ * qemu_plugin_register_vcpu_mem_cb() when the plugin can process
+ * accesses in bulk.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_buffered(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    struct qemu_plugin_mem_buffer *buf);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
@@ -141,6 +141,14 @@ struct rcu_head {
 };
 
 void call_rcu1(struct rcu_head *head, RCUCBFunc *func);
+
+/*
+ * Like call_rcu1(), but start a grace period for @head right away instead
+ * of waiting for more callbacks to pile up, and ask readers that are in a
+ * long read-side critical section to leave it through their force_rcu
+ * notifiers.
+ */
+void call_rcu1_expedited(struct rcu_head *head, RCUCBFunc *func);
 void drain_call_rcu(void);
 
 /* The operands of the minus operator must have the same type,
@@ -155,6 +163,15 @@ void drain_call_rcu(void);
       }),                                                                \
       (RCUCBFunc *)(func))
 
+#define call_rcu_expedited(head, func, field)                            \
+    call_rcu1_expedited(({                                               \
+         char __attribute__((unused))                                    \
+            offset_must_be_zero[-offsetof(typeof(*(head)), field)],      \
+            func_type_invalid = (func) - (void (*)(typeof(head)))(func); \
+         &(head)->field;                                                 \
+      }),                                                                \
+      (RCUCBFunc *)(func))
+
 #define g_free_rcu(obj, field) \
     call_rcu1(({                                                         \
         char __attribute__((unused))                                     \
@@ -87,6 +87,8 @@ struct QEMUTimer {
     QEMUTimerCB *cb;
     void *opaque;
     QEMUTimer *next;
+    QEMUTimer **pprev;
+    uint64_t seq;               /* orders timers with the same expire_time */
     int attributes;
     int scale;
 };
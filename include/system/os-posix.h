@@ -82,6 +82,18 @@ void *qemu_alloc_stack(size_t *sz);
  */
 void qemu_free_stack(void *stack, size_t sz);
 
+/**
+ * qemu_trim_stack:
+ * @stack: stack allocated via qemu_alloc_stack()
+ * @sz: size of stack in bytes, as returned by qemu_alloc_stack()
+ * @keep: number of bytes at the top of the stack that must be preserved
+ *
+ * Release the memory behind the lower part of a stack that is not in use,
+ * so that it reads as zeroes and is committed again only when touched.
+ * The top @keep bytes, where the outermost frames live, are left alone.
+ */
+void qemu_trim_stack(void *stack, size_t sz, size_t keep);
+
 /* POSIX and Mingw32 differ in the name of the stdio lock functions.  */
 
 static inline void qemu_flockfile(FILE *f)
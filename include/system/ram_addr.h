@@ -48,7 +48,8 @@ static inline long clear_bmap_size(uint64_t pages, uint8_t shift)
 
 /**
  * clear_bmap_set: set clear bitmap for the page range.  Must be with
- * bitmap_mutex held.
+ * bitmap_mutex held.  Bits are set atomically, because the dirty bitmap
+ * of a RAMBlock may be synchronized by several threads at once.
  *
  * @rb: the ramblock to operate on
  * @start: the start page number
@@ -61,7 +62,8 @@ static inline void clear_bmap_set(RAMBlock *rb, uint64_t start,
 {
     uint8_t shift = rb->clear_bmap_shift;
 
-    bitmap_set(rb->clear_bmap, start >> shift, clear_bmap_size(npages, shift));
+    bitmap_set_atomic(rb->clear_bmap, start >> shift,
+                      clear_bmap_size(npages, shift));
 }
 
 /**
@@ -482,7 +484,10 @@ static inline void cpu_physical_memory_clear_dirty_range(ram_addr_t start,
 }
 
 
-/* Called with RCU critical section */
+/*
+ * Called with RCU critical section.  Ranges of one RAMBlock that cover
+ * disjoint sets of whole clear_bmap chunks can be synchronized concurrently.
+ */
 static inline
 uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                                                ram_addr_t start,
@@ -509,14 +514,18 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
 
         for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
+            bool dirty = src[idx][offset];
+
+            if (dirty) {
                 unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
                 unsigned long new_dirty;
                 new_dirty = ~dest[k];
                 dest[k] |= bits;
                 new_dirty &= bits;
                 num_dirty += ctpopl(new_dirty);
+                bmap_summary_mark(rb, k);
             }
+            bmap_heat_age(rb, k, dirty);
 
             if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
                 offset = 0;
@@ -543,13 +552,21 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
         ram_addr_t offset = rb->offset;
 
         for (addr = 0; addr < length; addr += TARGET_PAGE_SIZE) {
+            long k = (start + addr) >> TARGET_PAGE_BITS;
+
+            if (!addr || !(k % BITS_PER_LONG)) {
+                bmap_heat_age(rb, BIT_WORD(k), false);
+            }
             if (cpu_physical_memory_test_and_clear_dirty(
                         start + addr + offset,
                         TARGET_PAGE_SIZE,
                         DIRTY_MEMORY_MIGRATION)) {
-                long k = (start + addr) >> TARGET_PAGE_BITS;
+                if (rb->bmap_heat) {
+                    rb->bmap_heat[BIT_WORD(k)] |= 0x80;
+                }
                 if (!test_and_set_bit(k, dest)) {
                     num_dirty++;
+                    bmap_summary_mark(rb, BIT_WORD(k));
                 }
             }
         }
@@ -20,6 +20,7 @@
 #define SYSTEM_RAMBLOCK_H
 
 #include "exec/cpu-common.h"
+#include "qemu/bitops.h"
 #include "qemu/rcu.h"
 #include "exec/ramlist.h"
 
@@ -45,6 +46,25 @@ struct RAMBlock {
     size_t page_size;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
+    /*
+     * Summary of bmap, like the upper levels of an HBitmap: a bit of level
+     * 0 is set if the matching word of bmap may be non-zero, and a bit of
+     * level N + 1 if the matching word of level N may be non-zero.  The top
+     * level is a single word.  Bits are only cleared by the dirty page
+     * search, when it finds that there is nothing below them.
+     *
+     * Only used during src side of ram migration, protected by the global
+     * ram_state.bitmap_mutex.  NULL if bmap is searched directly.
+     */
+    unsigned long **bmap_summary;
+    uint8_t bmap_summary_levels;
+    /*
+     * One byte per word of bmap, with the history of the last 8 dirty
+     * bitmap syncs: bit 7 is set if the guest dirtied a page of the word
+     * before the most recent sync, bit 6 for the one before, and so on.
+     * Only used on the src side of precopy, NULL otherwise.
+     */
+    uint8_t *bmap_heat;
 
     /*
      * Below fields are only used by mapped-ram migration
@@ -91,4 +111,50 @@ struct RAMBlock {
     ram_addr_t postcopy_length;
 };
 
+/**
+ * bmap_summary_mark: note that a word of the dirty bitmap may be non-zero.
+ * Must be with bitmap_mutex held, but may run concurrently with itself.
+ *
+ * @rb: the ramblock to operate on
+ * @word: index of the word in @rb->bmap
+ *
+ * Returns: None
+ */
+static inline void bmap_summary_mark(RAMBlock *rb, unsigned long word)
+{
+    int level;
+
+    if (!rb->bmap_summary) {
+        return;
+    }
+
+    for (level = 0; level < rb->bmap_summary_levels; level++) {
+        unsigned long *p = &rb->bmap_summary[level][BIT_WORD(word)];
+
+        /* The levels above are already set, or being set */
+        if (qatomic_read(p) & BIT_MASK(word)) {
+            break;
+        }
+        qatomic_or(p, BIT_MASK(word));
+        word = BIT_WORD(word);
+    }
+}
+
+/**
+ * bmap_heat_age: record one dirty bitmap sync in the history of a word.
+ * Must be with bitmap_mutex held.
+ *
+ * @rb: the ramblock to operate on
+ * @word: index of the word in @rb->bmap
+ * @dirty: whether the guest dirtied a page of the word since the last sync
+ *
+ * Returns: None
+ */
+static inline void bmap_heat_age(RAMBlock *rb, unsigned long word, bool dirty)
+{
+    if (rb->bmap_heat) {
+        rb->bmap_heat[word] = (rb->bmap_heat[word] >> 1) | (dirty ? 0x80 : 0);
+    }
+}
+
 #endif
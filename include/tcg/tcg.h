@@ -403,6 +403,14 @@ struct TCGContext {
 
     TCGLabel *exitreq_label;
 
+    /* Execution counter of a bottom tier TB, or NULL; see tb_tier_init. */
+    uint16_t *gen_tier_counter;
+    /*
+     * The TB is hot: the translator may follow direct jumps, and
+     * tcg_gen_code() runs a second round of optimization.
+     */
+    bool gen_trace;
+
 #ifdef CONFIG_PLUGIN
     /*
      * We keep one plugin_tb struct per TCGContext. Note that on every TB
@@ -652,6 +660,30 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
 
+/**
+ * tcg_region_mark_hot:
+ * @tc_ptr: host code of a translation block that ran recently
+ *
+ * Count the region holding @tc_ptr as hotter for the next call to
+ * tcg_region_evict_cold().  Call from a safe-work context.
+ */
+void tcg_region_mark_hot(const void *tc_ptr);
+
+/**
+ * tcg_region_evict_cold:
+ * @evict: called for each translation block in an evicted region
+ *
+ * Empty the colder half of the full regions, i.e. those that no TCG
+ * context is generating code into, and make them available again for
+ * allocation.  Regions are ordered first by tcg_region_mark_hot() calls
+ * and then by age.  @evict must unlink the TB from everything that can
+ * reach it.  Call from a safe-work context.
+ *
+ * Returns false if there was nothing to evict; the caller must then
+ * flush everything with tcg_region_reset_all().
+ */
+bool tcg_region_evict_cold(void (*evict)(TranslationBlock *tb));
+
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
 
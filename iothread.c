@@ -339,10 +339,33 @@ AioContext *iothread_get_aio_context(IOThread *iothread)
     return iothread->ctx;
 }
 
+static void query_one_poll(const AioPollInfo *poll_info, void *opaque)
+{
+    IOThreadPollInfoList ***tail = opaque;
+    IOThreadPollInfo *info;
+    uint32List **hist_tail;
+    int i;
+
+    info = g_new0(IOThreadPollInfo, 1);
+    info->fd = poll_info->fd;
+    info->polling = poll_info->polling;
+    info->poll_ns = poll_info->poll.ns;
+    info->hits = poll_info->poll.hits;
+    info->misses = poll_info->poll.misses;
+
+    hist_tail = &info->latency_histogram;
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        QAPI_LIST_APPEND(hist_tail, poll_info->poll.hist[i]);
+    }
+
+    QAPI_LIST_APPEND(*tail, info);
+}
+
 static int query_one_iothread(Object *object, void *opaque)
 {
     IOThreadInfoList ***tail = opaque;
     IOThreadInfo *info;
+    IOThreadPollInfoList **poll_tail;
     IOThread *iothread;
 
     iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
@@ -358,6 +381,9 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
 
+    poll_tail = &info->poll;
+    aio_context_foreach_poll(iothread->ctx, query_one_poll, &poll_tail);
+
     QAPI_LIST_APPEND(*tail, info);
     return 0;
 }
@@ -72,6 +72,8 @@ char real_exec_path[PATH_MAX];
 
 static bool opt_one_insn_per_tb;
 static unsigned long opt_tb_size;
+static const char *opt_tb_cache;
+static unsigned long opt_tier_threshold;
 static const char *argv0;
 static const char *gdbstub;
 static envlist_t *envlist;
@@ -433,6 +435,18 @@ static void handle_arg_tb_size(const char *arg)
     }
 }
 
+static void handle_arg_tier_threshold(const char *arg)
+{
+    if (qemu_strtoul(arg, NULL, 0, &opt_tier_threshold)) {
+        usage(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_tb_cache(const char *arg)
+{
+    opt_tb_cache = arg;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -527,6 +541,10 @@ static const struct qemu_argument arg_table[] = {
      "",           "run with one guest instruction per emulated TB"},
     {"tb-size",    "QEMU_TB_SIZE",     true,  handle_arg_tb_size,
      "size",       "TCG translation block cache size"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "file",       "TCG translation profile kept across runs"},
+    {"tier-threshold", "QEMU_TIER_THRESHOLD", true, handle_arg_tier_threshold,
+     "n",          "retranslate TCG blocks after n executions (0=off)"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
@@ -820,6 +838,12 @@ int main(int argc, char **argv, char **envp)
                                  opt_one_insn_per_tb, &error_abort);
         object_property_set_int(OBJECT(accel), "tb-size",
                                 opt_tb_size, &error_abort);
+        object_property_set_int(OBJECT(accel), "tier-threshold",
+                                opt_tier_threshold, &error_fatal);
+        if (opt_tb_cache) {
+            object_property_set_str(OBJECT(accel), "tb-cache",
+                                    opt_tb_cache, &error_abort);
+        }
         ac->init_machine(NULL);
     }
 
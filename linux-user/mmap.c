@@ -24,6 +24,7 @@
 #include "exec/mmap-lock.h"
 #include "exec/tb-flush.h"
 #include "exec/translation-block.h"
+#include "accel/tcg/tb-cache.h"
 #include "qemu.h"
 #include "user/page-protection.h"
 #include "user-internals.h"
@@ -951,6 +952,29 @@ static abi_long target_mmap__locked(abi_ulong start, abi_ulong len,
     }
 }
 
+/*
+ * Let the translation profile record the blocks of read-only executable
+ * file mappings by file offset, so that other processes mapping the same
+ * file at another address can use them.
+ */
+static void mmap_note_tb_cache(abi_ulong start, abi_ulong len,
+                               int target_prot, int flags, int fd,
+                               off_t offset)
+{
+    struct stat sb;
+
+    if (!tb_cache_enabled()) {
+        return;
+    }
+    tb_cache_unmap(start, len);
+    if (!(flags & MAP_ANONYMOUS) &&
+        (flags & MAP_TYPE) == MAP_PRIVATE &&
+        (target_prot & (PROT_WRITE | PROT_EXEC)) == PROT_EXEC &&
+        fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+        tb_cache_map_file(start, len, sb.st_dev, sb.st_ino, offset);
+    }
+}
+
 /* NOTE: all the constants are the HOST ones */
 abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
                      int flags, int fd, off_t offset)
@@ -997,6 +1021,9 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
 
     ret = target_mmap__locked(start, len, target_prot, flags,
                               page_flags, fd, offset);
+    if (ret != -1) {
+        mmap_note_tb_cache(ret, len, target_prot, flags, fd, offset);
+    }
 
     mmap_unlock();
 
@@ -1096,6 +1123,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
     if (likely(ret == 0)) {
         page_set_flags(start, start + len - 1, 0);
         shm_region_rm_complete(start, start + len - 1);
+        tb_cache_unmap(start, len);
     }
     mmap_unlock();
 
@@ -1190,6 +1218,8 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         page_set_flags(new_addr, new_addr + new_size - 1,
                        prot | PAGE_VALID | PAGE_RESET);
         shm_region_rm_complete(new_addr, new_addr + new_size - 1);
+        tb_cache_unmap(old_addr, old_size);
+        tb_cache_unmap(new_addr, new_size);
     }
     mmap_unlock();
     return new_addr;
@@ -0,0 +1,169 @@
+/*
+ * Summary and heat of the migration dirty bitmap of a RAMBlock
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/host-utils.h"
+#include "system/ramblock.h"
+#include "bmap-summary.h"
+
+/* Number of bits in level @level of the summary of @pages bits of bmap */
+static unsigned long bmap_summary_bits(unsigned long pages, int level)
+{
+    unsigned long bits = BITS_TO_LONGS(pages);
+
+    while (level--) {
+        bits = BITS_TO_LONGS(bits);
+    }
+    return bits;
+}
+
+void bmap_summary_init(RAMBlock *rb, unsigned long pages)
+{
+    unsigned long bits = BITS_TO_LONGS(pages);
+    int levels = 1;
+    int i;
+
+    while (bits > BITS_PER_LONG) {
+        bits = BITS_TO_LONGS(bits);
+        levels++;
+    }
+
+    rb->bmap_summary_levels = levels;
+    rb->bmap_summary = g_new(unsigned long *, levels);
+    for (i = 0; i < levels; i++) {
+        rb->bmap_summary[i] = bitmap_new(bmap_summary_bits(pages, i));
+    }
+    bmap_summary_fill(rb, pages);
+}
+
+void bmap_summary_fill(RAMBlock *rb, unsigned long pages)
+{
+    int level;
+
+    for (level = 0; level < rb->bmap_summary_levels; level++) {
+        bitmap_set(rb->bmap_summary[level], 0,
+                   bmap_summary_bits(pages, level));
+    }
+}
+
+void bmap_summary_free(RAMBlock *rb)
+{
+    int i;
+
+    if (!rb->bmap_summary) {
+        return;
+    }
+    for (i = 0; i < rb->bmap_summary_levels; i++) {
+        g_free(rb->bmap_summary[i]);
+    }
+    g_free(rb->bmap_summary);
+    rb->bmap_summary = NULL;
+    rb->bmap_summary_levels = 0;
+}
+
+/*
+ * Clear bit @idx of level @level of the summary, and the bits above it
+ * whose words become zero.
+ */
+static void bmap_summary_clear(RAMBlock *rb, int level, unsigned long idx)
+{
+    for (; level < rb->bmap_summary_levels; level++) {
+        unsigned long *p = &rb->bmap_summary[level][BIT_WORD(idx)];
+
+        *p &= ~BIT_MASK(idx);
+        if (*p) {
+            break;
+        }
+        idx = BIT_WORD(idx);
+    }
+}
+
+/*
+ * Return the first bit of level @level of the summary that is set, starting
+ * from @idx and below @size, or @size if there is none.  Words that are
+ * zero are skipped by looking at the level above.
+ */
+static unsigned long bmap_summary_next(RAMBlock *rb, int level,
+                                       unsigned long idx, unsigned long size)
+{
+    unsigned long *map = rb->bmap_summary[level];
+
+    while (idx < size) {
+        unsigned long word = map[BIT_WORD(idx)] & BITMAP_FIRST_WORD_MASK(idx);
+
+        if (word) {
+            return MIN(BIT_WORD(idx) * BITS_PER_LONG + ctzl(word), size);
+        }
+        if (level + 1 == rb->bmap_summary_levels) {
+            /* The top level is a single word */
+            break;
+        }
+        idx = bmap_summary_next(rb, level + 1, BIT_WORD(idx) + 1,
+                                BITS_TO_LONGS(size)) * BITS_PER_LONG;
+    }
+    return size;
+}
+
+unsigned long ramblock_find_next_dirty(RAMBlock *rb, unsigned long size,
+                                       unsigned long page)
+{
+    unsigned long *bitmap = rb->bmap;
+
+    if (!rb->bmap_summary) {
+        return find_next_bit(bitmap, size, page);
+    }
+
+    while (page < size) {
+        unsigned long idx = BIT_WORD(page);
+        unsigned long word = bitmap[idx] & BITMAP_FIRST_WORD_MASK(page);
+
+        if (word) {
+            return MIN(idx * BITS_PER_LONG + ctzl(word), size);
+        }
+        if (!bitmap[idx]) {
+            bmap_summary_clear(rb, 0, idx);
+        }
+        page = bmap_summary_next(rb, 0, idx + 1, BITS_TO_LONGS(size)) *
+               BITS_PER_LONG;
+    }
+    return size;
+}
+
+unsigned long ramblock_find_next_cold_dirty(RAMBlock *rb, unsigned long size,
+                                            unsigned long page,
+                                            unsigned long host_pages)
+{
+    page = ramblock_find_next_dirty(rb, size, page);
+
+    /* Skip the host pages that start in a hot word */
+    while (page < size && bmap_word_is_hot(rb, BIT_WORD(page))) {
+        unsigned long next = (BIT_WORD(page) + 1) * BITS_PER_LONG;
+
+        page = ramblock_find_next_dirty(rb, size,
+                                        QEMU_ALIGN_UP(next, host_pages));
+    }
+    return page;
+}
+
+uint64_t ramblock_count_hot_pages(RAMBlock *rb, unsigned long start,
+                                  unsigned long npages)
+{
+    unsigned long word = BIT_WORD(start);
+    unsigned long end = BITS_TO_LONGS(start + npages);
+    uint64_t pages = 0;
+
+    if (!rb->bmap_heat) {
+        return 0;
+    }
+
+    for (; word < end; word++) {
+        if (bmap_word_is_hot(rb, word)) {
+            pages += ctpopl(rb->bmap[word]);
+        }
+    }
+    return pages;
+}
@@ -0,0 +1,94 @@
+/*
+ * Summary and heat of the migration dirty bitmap of a RAMBlock
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_MIGRATION_BMAP_SUMMARY_H
+#define QEMU_MIGRATION_BMAP_SUMMARY_H
+
+/*
+ * A word of bmap is hot if the guest dirtied it before each of the last
+ * RAM_HEAT_HOT_SYNCS bitmap syncs.  Its pages would most likely be dirtied
+ * again right after being sent.
+ */
+#define RAM_HEAT_HOT_SYNCS  3
+#define RAM_HEAT_HOT_MASK   ((uint8_t)(0xff << (8 - RAM_HEAT_HOT_SYNCS)))
+
+static inline bool bmap_word_is_hot(RAMBlock *rb, unsigned long word)
+{
+    return rb->bmap_heat &&
+           (rb->bmap_heat[word] & RAM_HEAT_HOT_MASK) == RAM_HEAT_HOT_MASK;
+}
+
+/**
+ * bmap_summary_init: allocate the summary of @rb->bmap, with every bit set
+ *
+ * @rb: the ramblock to operate on
+ * @pages: number of bits of @rb->bmap
+ */
+void bmap_summary_init(RAMBlock *rb, unsigned long pages);
+
+/**
+ * bmap_summary_fill: mark all of @rb->bmap as possibly dirty
+ *
+ * @rb: the ramblock to operate on
+ * @pages: number of bits of @rb->bmap, as given to bmap_summary_init()
+ */
+void bmap_summary_fill(RAMBlock *rb, unsigned long pages);
+
+/**
+ * bmap_summary_free: free the summary of @rb->bmap, if there is one
+ *
+ * @rb: the ramblock to operate on
+ */
+void bmap_summary_free(RAMBlock *rb);
+
+/**
+ * ramblock_find_next_dirty: find the next dirty page of @rb
+ *
+ * Like find_next_bit() on @rb->bmap, but skips clean regions using the
+ * summary in O(levels), and clears the summary bits of the words that
+ * turn out to be clean.  Must be with bitmap_mutex held.
+ *
+ * Returns the index of the first set bit of @rb->bmap from @page on, or
+ * @size if there is none.
+ *
+ * @rb: the ramblock to search
+ * @size: number of bits of @rb->bmap to search
+ * @page: first bit to look at
+ */
+unsigned long ramblock_find_next_dirty(RAMBlock *rb, unsigned long size,
+                                       unsigned long page);
+
+/**
+ * ramblock_find_next_cold_dirty: find the next dirty page of @rb that is
+ * not deferred
+ *
+ * Like ramblock_find_next_dirty(), but skips the host pages that start in
+ * a hot word of @rb->bmap.  The pages of hot words are left dirty, for a
+ * search that does not skip them.
+ *
+ * @rb: the ramblock to search
+ * @size: number of bits of @rb->bmap to search
+ * @page: first bit to look at
+ * @host_pages: number of bits of @rb->bmap per host page of @rb
+ */
+unsigned long ramblock_find_next_cold_dirty(RAMBlock *rb, unsigned long size,
+                                            unsigned long page,
+                                            unsigned long host_pages);
+
+/**
+ * ramblock_count_hot_pages: count the dirty pages in the hot words of @rb
+ *
+ * Returns the number of set bits of @rb->bmap in the hot words that hold
+ * bits @start to @start + @npages - 1.
+ *
+ * @rb: the ramblock to operate on
+ * @start: first bit of @rb->bmap
+ * @npages: number of bits of @rb->bmap
+ */
+uint64_t ramblock_count_hot_pages(RAMBlock *rb, unsigned long start,
+                                  unsigned long npages);
+
+#endif
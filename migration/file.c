@@ -8,6 +8,7 @@
 #include "qemu/osdep.h"
 #include "system/ramblock.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "channel.h"
@@ -18,9 +19,20 @@
 #include "io/channel-util.h"
 #include "options.h"
 #include "trace.h"
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+#endif
 
 #define OFFSET_OPTION ",offset="
 
+/*
+ * Reads of mapped-ram pages by a multifd channel are split in requests of
+ * FILE_RECV_READ_SIZE bytes, of which up to FILE_RECV_QUEUE_DEPTH are kept
+ * in flight when io_uring is available.
+ */
+#define FILE_RECV_READ_SIZE     (1 * MiB)
+#define FILE_RECV_QUEUE_DEPTH   32
+
 static struct FileOutgoingArgs {
     char *fname;
 } outgoing_args;
@@ -250,18 +262,253 @@ int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
     return (ret < 0) ? ret : 0;
 }
 
+void multifd_file_recv_cleanup(MultiFDRecvParams *p)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (p->ring) {
+        io_uring_queue_exit(p->ring);
+        g_free(p->ring);
+        p->ring = NULL;
+    }
+#endif
+}
+
+#ifdef CONFIG_LINUX_IO_URING
+/* Set once io_uring turned out to be unavailable, e.g. disabled by sysctl */
+static bool file_recv_uring_unavailable;
+/* Set once a channel has set up its ring */
+static bool file_recv_uring_used;
+
+/*
+ * The channels only get connected after the multifd setup, so the ring is
+ * created when the first pages are read.
+ */
+static void file_recv_uring_setup(MultiFDRecvParams *p)
+{
+    struct io_uring *ring;
+    int ret;
+
+    if (qatomic_read(&file_recv_uring_unavailable) ||
+        !object_dynamic_cast(OBJECT(p->c), TYPE_QIO_CHANNEL_FILE)) {
+        return;
+    }
+
+    ring = g_new(struct io_uring, 1);
+    ret = io_uring_queue_init(FILE_RECV_QUEUE_DEPTH, ring, 0);
+    trace_multifd_file_recv_uring_setup(p->id, ret);
+    if (ret < 0) {
+        /* preadv works just as well, only with a single read in flight */
+        qatomic_set(&file_recv_uring_unavailable, true);
+        g_free(ring);
+        return;
+    }
+    p->ring = ring;
+    qatomic_set(&file_recv_uring_used, true);
+}
+
+typedef struct FileRecvRequest {
+    struct iovec iov;
+    off_t offset;
+} FileRecvRequest;
+
+static void file_recv_prep(struct io_uring *ring, int fd,
+                           FileRecvRequest *reqs, unsigned int slot)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+    /* There are as many sqes as slots */
+    assert(sqe);
+    io_uring_prep_readv(sqe, fd, &reqs[slot].iov, 1, reqs[slot].offset);
+    io_uring_sqe_set_data(sqe, (void *)(uintptr_t)slot);
+}
+
+/*
+ * Read @data with up to FILE_RECV_QUEUE_DEPTH requests in flight.  With
+ * direct-io, these go straight from the disk to guest memory.
+ *
+ * Requests are prepared in the submission queue, then submitted; only
+ * those that were submitted complete.
+ */
+static int file_recv_data_uring(MultiFDRecvParams *p, Error **errp)
+{
+    MultiFDRecvData *data = p->data;
+    int fd = QIO_CHANNEL_FILE(p->c)->fd;
+    FileRecvRequest reqs[FILE_RECV_QUEUE_DEPTH];
+    unsigned int free_slots[FILE_RECV_QUEUE_DEPTH];
+    unsigned int nr_free = FILE_RECV_QUEUE_DEPTH;
+    unsigned int prepared = 0, submitted = 0;
+    size_t queued = 0, done = 0;
+    struct io_uring_cqe *cqe;
+    int ret = 0;
+    unsigned int i;
+
+    for (i = 0; i < FILE_RECV_QUEUE_DEPTH; i++) {
+        free_slots[i] = i;
+    }
+
+    while (done < data->size && !ret) {
+        while (nr_free && queued < data->size) {
+            unsigned int slot = free_slots[--nr_free];
+
+            reqs[slot].iov.iov_base = (char *)data->opaque + queued;
+            reqs[slot].iov.iov_len = MIN(FILE_RECV_READ_SIZE,
+                                         data->size - queued);
+            reqs[slot].offset = data->file_offset + queued;
+            file_recv_prep(p->ring, fd, reqs, slot);
+            prepared++;
+            queued += reqs[slot].iov.iov_len;
+        }
+
+        ret = io_uring_submit(p->ring);
+        if (ret == -EINTR) {
+            ret = 0;
+            continue;
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "multifd recv (%u): io_uring submit "
+                             "failed", p->id);
+            break;
+        }
+        prepared -= ret;
+        submitted += ret;
+        ret = 0;
+
+        if (!submitted) {
+            error_setg(errp, "multifd recv (%u): io_uring submitted no read",
+                       p->id);
+            ret = -1;
+            break;
+        }
+
+        ret = io_uring_wait_cqe(p->ring, &cqe);
+        if (ret == -EINTR) {
+            ret = 0;
+            continue;
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "multifd recv (%u): io_uring wait "
+                             "failed", p->id);
+            break;
+        }
+
+        while (!ret && !io_uring_peek_cqe(p->ring, &cqe)) {
+            unsigned int slot = (uintptr_t)io_uring_cqe_get_data(cqe);
+            FileRecvRequest *req = &reqs[slot];
+            int res = cqe->res;
+
+            io_uring_cqe_seen(p->ring, cqe);
+            submitted--;
+
+            if (res == -EINTR || res == -EAGAIN) {
+                file_recv_prep(p->ring, fd, reqs, slot);
+                prepared++;
+            } else if (res < 0) {
+                error_setg_errno(errp, -res, "multifd recv (%u): failed to "
+                                 "read 0x%zx bytes at offset 0x%" PRIx64,
+                                 p->id, req->iov.iov_len,
+                                 (uint64_t)req->offset);
+                ret = -1;
+                free_slots[nr_free++] = slot;
+            } else if (res == 0) {
+                error_setg(errp, "multifd recv (%u): unexpected end of file "
+                           "at offset 0x%" PRIx64, p->id,
+                           (uint64_t)req->offset);
+                ret = -1;
+                free_slots[nr_free++] = slot;
+            } else if (res < req->iov.iov_len) {
+                /* Short read, queue the rest */
+                done += res;
+                req->iov.iov_base = (char *)req->iov.iov_base + res;
+                req->iov.iov_len -= res;
+                req->offset += res;
+                file_recv_prep(p->ring, fd, reqs, slot);
+                prepared++;
+            } else {
+                done += res;
+                free_slots[nr_free++] = slot;
+            }
+        }
+    }
+
+    /*
+     * After an error, requests may be left in both states.  Submit the
+     * prepared ones, which read into guest memory just like the others,
+     * and wait for everything that was submitted, since requests must
+     * not outlive @reqs.  If that fails too, drop the ring, which also
+     * drops the requests, and start over with a new one for the next job.
+     */
+    while (prepared) {
+        int r = io_uring_submit(p->ring);
+
+        if (r == -EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            break;
+        }
+        prepared -= r;
+        submitted += r;
+    }
+    while (submitted && !prepared) {
+        int r = io_uring_wait_cqe(p->ring, &cqe);
+
+        if (r == -EINTR) {
+            continue;
+        }
+        if (r < 0) {
+            break;
+        }
+        io_uring_cqe_seen(p->ring, cqe);
+        submitted--;
+    }
+    if (prepared || submitted) {
+        multifd_file_recv_cleanup(p);
+    }
+
+    return ret;
+}
+#endif
+
+/*
+ * Whether the channels read with io_uring, and so can keep several reads
+ * of a large job in flight.
+ */
+bool multifd_file_recv_uring_in_use(void)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    return qatomic_read(&file_recv_uring_used) &&
+           !qatomic_read(&file_recv_uring_unavailable);
+#else
+    return false;
+#endif
+}
+
 int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp)
 {
     MultiFDRecvData *data = p->data;
-    size_t ret;
-
-    ret = qio_channel_pread(p->c, (char *) data->opaque,
-                            data->size, data->file_offset, errp);
-    if (ret != data->size) {
-        error_prepend(errp,
-                      "multifd recv (%u): read 0x%zx, expected 0x%zx",
-                      p->id, ret, data->size);
-        return -1;
+    size_t done = 0;
+    ssize_t ret;
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (!p->ring) {
+        file_recv_uring_setup(p);
+    }
+    if (p->ring) {
+        return file_recv_data_uring(p, errp);
+    }
+#endif
+
+    while (done < data->size) {
+        ret = qio_channel_pread(p->c, (char *) data->opaque + done,
+                                data->size - done, data->file_offset + done,
+                                errp);
+        if (ret <= 0) {
+            error_prepend(errp,
+                          "multifd recv (%u): read 0x%zx, expected 0x%zx",
+                          p->id, done, data->size);
+            return -1;
+        }
+        done += ret;
     }
 
     return 0;
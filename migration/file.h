@@ -23,4 +23,6 @@ bool file_send_channel_create(gpointer opaque, Error **errp);
 int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
                             int niov, MultiFDPages_t *pages, Error **errp);
 int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp);
+bool multifd_file_recv_uring_in_use(void);
+void multifd_file_recv_cleanup(MultiFDRecvParams *p);
 #endif
@@ -216,6 +216,13 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         visit_free(v);
     }
 
+    if (info->has_postcopy_prefetch_pages) {
+        monitor_printf(mon, "Postcopy prefetched pages: %" PRIu64
+                       " (hits: %" PRIu64 ")\n",
+                       info->postcopy_prefetch_pages,
+                       info->postcopy_prefetch_hits);
+    }
+
 out:
     qapi_free_MigrationInfo(info);
 }
@@ -366,6 +373,12 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
                                MIGRATION_PARAMETER_DIRECT_IO),
                            params->direct_io ? "on" : "off");
         }
+
+        assert(params->has_postcopy_prefetch_window);
+        monitor_printf(mon, "%s: %u\n",
+                       MigrationParameter_str(
+                           MIGRATION_PARAMETER_POSTCOPY_PREFETCH_WINDOW),
+                       params->postcopy_prefetch_window);
     }
 
     qapi_free_MigrationParameters(params);
@@ -647,6 +660,10 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_direct_io = true;
         visit_type_bool(v, param, &p->direct_io, &err);
         break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREFETCH_WINDOW:
+        p->has_postcopy_prefetch_window = true;
+        visit_type_uint8(v, param, &p->postcopy_prefetch_window, &err);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -533,17 +533,18 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
     return qemu_fflush(mis->to_src_file);
 }
 
-/* Request one page from the source VM at the given start address.
+/*
+ * Request pages from the source VM at the given start address.
  *   rb: the RAMBlock to request the page in
  *   Start: Address offset within the RB
  *   Len: Length in bytes required - must be a multiple of pagesize
  */
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start)
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len)
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
@@ -603,7 +604,69 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
         return 0;
     }
 
-    return migrate_send_rp_message_req_pages(mis, rb, start);
+    return migrate_send_rp_message_req_pages(mis, rb, start,
+                                             qemu_ram_pagesize(rb));
+}
+
+/*
+ * Request the host pages of @rb at the @n offsets in @offsets, ahead of
+ * any fault on them.  Pages that are already received or requested are
+ * skipped, and runs of adjacent pages are requested with one message.
+ * On return, @offsets starts with the offsets of the requested pages.
+ *
+ * Returns the number of pages requested, or a negative errno.
+ */
+int migrate_send_rp_req_pages_ahead(MigrationIncomingState *mis,
+                                    RAMBlock *rb, ram_addr_t *offsets,
+                                    unsigned int n)
+{
+    size_t page_size = qemu_ram_pagesize(rb);
+    ram_addr_t run_start = 0;
+    size_t run_len = 0;
+    int requested = 0;
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+        void *host = rb->host + offsets[i];
+        bool request = false;
+
+        WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
+            if (!ramblock_recv_bitmap_test_byte_offset(rb, offsets[i]) &&
+                !g_tree_lookup(mis->page_requested, host)) {
+                g_tree_insert(mis->page_requested, host, (gpointer)1);
+                qatomic_inc(&mis->page_requested_count);
+                trace_postcopy_page_req_add(host, mis->page_requested_count);
+                request = true;
+            }
+        }
+        if (!request) {
+            continue;
+        }
+
+        offsets[requested++] = offsets[i];
+        if (run_len && run_start + run_len == offsets[i]) {
+            run_len += page_size;
+            continue;
+        }
+        if (run_len) {
+            ret = migrate_send_rp_message_req_pages(mis, rb, run_start,
+                                                    run_len);
+            if (ret) {
+                return ret;
+            }
+        }
+        run_start = offsets[i];
+        run_len = page_size;
+    }
+
+    if (run_len) {
+        ret = migrate_send_rp_message_req_pages(mis, rb, run_start, run_len);
+        if (ret) {
+            return ret;
+        }
+    }
+    return requested;
 }
 
 static bool migration_colo_enabled;
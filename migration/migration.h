@@ -19,6 +19,7 @@
 #include "qapi/qapi-types-migration.h"
 #include "qobject/json-writer.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qemu/coroutine.h"
 #include "io/channel.h"
 #include "io/channel-buffer.h"
@@ -198,6 +199,13 @@ struct MigrationIncomingState {
      * */
     struct PostcopyBlocktimeContext *blocktime_ctx;
 
+    /*
+     * Host pages requested by the postcopy prefetcher ahead of faults, and
+     * how many of them the vCPUs then went past without faulting on them.
+     */
+    Stat64 postcopy_prefetch_pages;
+    Stat64 postcopy_prefetch_hits;
+
     /* notify PAUSED postcopy incoming migrations to try to continue */
     QemuSemaphore postcopy_pause_sem_dst;
     QemuSemaphore postcopy_pause_sem_fault;
@@ -547,8 +555,12 @@ void migrate_send_rp_pong(MigrationIncomingState *mis,
                           uint32_t value);
 int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
                               ram_addr_t start, uint64_t haddr);
+int migrate_send_rp_req_pages_ahead(MigrationIncomingState *mis,
+                                    RAMBlock *rb, ram_addr_t *offsets,
+                                    unsigned int n);
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start);
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
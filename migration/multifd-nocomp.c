@@ -155,6 +155,7 @@ static int multifd_nocomp_recv_setup(MultiFDRecvParams *p, Error **errp)
 
 static void multifd_nocomp_recv_cleanup(MultiFDRecvParams *p)
 {
+    multifd_file_recv_cleanup(p);
     g_free(p->iov);
     p->iov = NULL;
 }
@@ -417,6 +418,7 @@ int multifd_ram_flush_and_sync(QEMUFile *f)
     if (ret) {
         return ret;
     }
+    multifd_xbzrle_sync();
 
     /* If we don't need to sync with remote at all, nothing else to do */
     if (req == MULTIFD_SYNC_LOCAL) {
@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Multifd XBZRLE delta encoding implementation
+ *
+ * Each channel encodes its pages against the copy of the same pages that
+ * was last sent, which is kept in a page cache shared by all channels.
+ * The destination applies the deltas to the guest memory itself, so it
+ * does not need a cache.
+ *
+ * The multifd syncs order all channels on both sides, so the copy in the
+ * cache matches the destination memory when the page is encoded, as long
+ * as it was cached before the last sync.  The age of the cached pages
+ * counts the syncs: a page that is sent again before the next one goes
+ * whole, because another channel may still be sending the cached copy.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "system/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "options.h"
+#include "page_cache.h"
+#include "xbzrle.h"
+#include "trace.h"
+#include "multifd.h"
+
+/* Locks of the page cache per channel, to keep contention low */
+#define MULTIFD_XBZRLE_SHARDS_PER_CHANNEL 16
+
+/*
+ * Wire format of the data that follows the packet header: a big endian
+ * uint32_t length for each normal page, then the data of each page.  A
+ * length equal to the page size means that the page is sent whole, zero
+ * that it is unchanged, and anything else is an XBZRLE delta.
+ */
+struct xbzrle_data {
+    /* lengths of the pages, in wire format */
+    uint32_t *lens;
+    /* data of the pages */
+    uint8_t *buf;
+    /* copy of the page being encoded, of size qemu_target_page_size() */
+    uint8_t *page;
+};
+
+/* Shared by the send channels, which are set up by the migration thread */
+static PageCache *multifd_xbzrle_cache;
+static unsigned int multifd_xbzrle_users;
+static uint8_t *multifd_xbzrle_zero_page;
+/* Number of multifd syncs, read by the send channels */
+static unsigned int multifd_xbzrle_epoch;
+
+/* Multifd XBZRLE encoding */
+
+static int multifd_xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t page_count = multifd_ram_page_count();
+    struct xbzrle_data *x;
+
+    if (!multifd_xbzrle_users) {
+        multifd_xbzrle_cache = cache_init_sharded(
+            migrate_xbzrle_cache_size(), page_size,
+            migrate_multifd_channels() * MULTIFD_XBZRLE_SHARDS_PER_CHANNEL,
+            errp);
+        if (!multifd_xbzrle_cache) {
+            error_prepend(errp, "multifd %u: ", p->id);
+            return -1;
+        }
+        multifd_xbzrle_zero_page = g_malloc0(page_size);
+        multifd_xbzrle_epoch = 0;
+    }
+    multifd_xbzrle_users++;
+
+    x = g_new0(struct xbzrle_data, 1);
+    x->lens = g_new(uint32_t, page_count);
+    x->buf = g_malloc(MULTIFD_PACKET_SIZE);
+    x->page = g_malloc(page_size);
+    p->compress_data = x;
+
+    /* Needs 3 IOVs, for packet header, lengths and data */
+    p->iov = g_new0(struct iovec, 3);
+
+    return 0;
+}
+
+static void multifd_xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->compress_data;
+
+    if (x) {
+        g_free(x->lens);
+        g_free(x->buf);
+        g_free(x->page);
+        g_free(x);
+        p->compress_data = NULL;
+
+        if (!--multifd_xbzrle_users) {
+            g_clear_pointer(&multifd_xbzrle_cache, cache_fini);
+            g_clear_pointer(&multifd_xbzrle_zero_page, g_free);
+        }
+    }
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+void multifd_xbzrle_cache_zero_page(ram_addr_t addr)
+{
+    if (!multifd_xbzrle_cache) {
+        return;
+    }
+
+    /*
+     * As in xbzrle_cache_zero_page(), it is fine if this fails to cache
+     * a new page, as long as a stale copy is replaced.
+     */
+    cache_shard_lock(multifd_xbzrle_cache, addr);
+    cache_insert(multifd_xbzrle_cache, addr, multifd_xbzrle_zero_page,
+                 qatomic_read(&multifd_xbzrle_epoch));
+    cache_shard_unlock(multifd_xbzrle_cache, addr);
+}
+
+/*
+ * Called by the migration thread after each multifd sync, when the send
+ * channels have prepared all the packets queued before it.
+ */
+void multifd_xbzrle_sync(void)
+{
+    if (multifd_xbzrle_cache) {
+        qatomic_inc(&multifd_xbzrle_epoch);
+    }
+}
+
+/*
+ * Encode the page at @offset of @block into @dst.
+ *
+ * Returns the length of the page in the wire format.
+ */
+static int multifd_xbzrle_encode_page(struct xbzrle_data *x,
+                                      RAMBlock *block, ram_addr_t offset,
+                                      uint64_t epoch, uint8_t *dst)
+{
+    PageCache *cache = multifd_xbzrle_cache;
+    uint32_t page_size = multifd_ram_page_size();
+    ram_addr_t addr = block->offset + offset;
+    uint64_t age;
+    uint8_t *cached;
+    int len;
+
+    cache_shard_lock(cache, addr);
+
+    /*
+     * A page cached since the last sync may still be on its way in another
+     * channel, and the destination could apply a delta against it before
+     * it: send it whole, like a page that is not cached.  Read the age
+     * first, a cache hit updates it.
+     */
+    age = cache_get_age(cache, addr);
+    if (!cache_is_cached(cache, addr, epoch) || age == epoch) {
+        /* Send the same data that goes into the cache */
+        memcpy(dst, block->host + offset, page_size);
+        cache_insert(cache, addr, dst, epoch);
+        cache_shard_unlock(cache, addr);
+        return page_size;
+    }
+
+    /* The guest may be changing the page, so encode a stable copy */
+    cached = get_cached_data(cache, addr);
+    memcpy(x->page, block->host + offset, page_size);
+
+    /* Deltas must be shorter than a page to tell them apart */
+    len = xbzrle_encode_buffer(cached, x->page, page_size, dst,
+                               page_size - 1);
+    if (len != 0) {
+        memcpy(cached, x->page, page_size);
+    }
+    cache_shard_unlock(cache, addr);
+
+    if (len < 0) {
+        memcpy(dst, x->page, page_size);
+        return page_size;
+    }
+    return len;
+}
+
+static int multifd_xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct xbzrle_data *x = p->compress_data;
+    unsigned int epoch = qatomic_read(&multifd_xbzrle_epoch);
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t out_size = 0, encoded = 0, unchanged = 0;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto zero_pages;
+    }
+
+    for (i = 0; i < pages->normal_num; i++) {
+        int len = multifd_xbzrle_encode_page(x, pages->block,
+                                             pages->offset[i], epoch,
+                                             x->buf + out_size);
+
+        encoded += len && len < page_size;
+        unchanged += !len;
+        x->lens[i] = cpu_to_be32(len);
+        out_size += len;
+    }
+
+    p->iov[p->iovs_num].iov_base = x->lens;
+    p->iov[p->iovs_num].iov_len = pages->normal_num * sizeof(uint32_t);
+    p->iovs_num++;
+    p->iov[p->iovs_num].iov_base = x->buf;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = pages->normal_num * sizeof(uint32_t) + out_size;
+
+    trace_multifd_xbzrle_send(p->id, pages->normal_num, encoded, unchanged,
+                              p->next_packet_size);
+
+zero_pages:
+    /* The destination now has zeroes, a stale copy must not be used */
+    for (i = pages->normal_num; i < pages->num; i++) {
+        multifd_xbzrle_cache_zero_page(pages->block->offset +
+                                       pages->offset[i]);
+    }
+
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t page_count = multifd_ram_page_count();
+    struct xbzrle_data *x = g_new0(struct xbzrle_data, 1);
+
+    x->lens = g_new(uint32_t, page_count);
+    x->buf = g_malloc(MULTIFD_PACKET_SIZE);
+    p->compress_data = x;
+    return 0;
+}
+
+static void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *x = p->compress_data;
+
+    g_free(x->lens);
+    g_free(x->buf);
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_xbzrle_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t lens_size = p->normal_num * sizeof(uint32_t);
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t data_size = 0;
+    uint8_t *data;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    if (in_size < lens_size || in_size - lens_size > MULTIFD_PACKET_SIZE) {
+        error_setg(errp, "multifd %u: packet size %u is invalid for %u pages",
+                   p->id, in_size, p->normal_num);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->lens, lens_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+    for (i = 0; i < p->normal_num; i++) {
+        x->lens[i] = be32_to_cpu(x->lens[i]);
+        if (x->lens[i] > page_size) {
+            error_setg(errp, "multifd %u: page length %u is too large",
+                       p->id, x->lens[i]);
+            return -1;
+        }
+        data_size += x->lens[i];
+    }
+    if (data_size != in_size - lens_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size - lens_size, data_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->buf, data_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    data = x->buf;
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        if (x->lens[i] == page_size) {
+            memcpy(page, data, page_size);
+        } else if (x->lens[i] &&
+                   xbzrle_decode_buffer(data, x->lens[i], page,
+                                        page_size) < 0) {
+            error_setg(errp, "multifd %u: failed to decode page at 0x%"
+                       PRIx64, p->id, (uint64_t)p->normal[i]);
+            return -1;
+        }
+        data += x->lens[i];
+    }
+
+    return 0;
+}
+
+static const MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = multifd_xbzrle_send_setup,
+    .send_cleanup = multifd_xbzrle_send_cleanup,
+    .send_prepare = multifd_xbzrle_send_prepare,
+    .recv_setup = multifd_xbzrle_recv_setup,
+    .recv_cleanup = multifd_xbzrle_recv_cleanup,
+    .recv = multifd_xbzrle_recv
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
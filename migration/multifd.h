@@ -63,6 +63,12 @@ MultiFDRecvData *multifd_get_recv_data(void);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+/*
+ * The methods above and below use one bit each, but the field holds a
+ * single method and is compared for equality, so this value, ZLIB | ZSTD,
+ * is free.
+ */
+#define MULTIFD_FLAG_XBZRLE (3 << 1)
 #define MULTIFD_FLAG_QPL (4 << 1)
 #define MULTIFD_FLAG_UADK (8 << 1)
 #define MULTIFD_FLAG_QATZIP (16 << 1)
@@ -293,6 +299,8 @@ typedef struct {
     uint32_t zero_num;
     /* used for de-compression methods */
     void *compress_data;
+    /* io_uring for the mapped-ram reads, NULL when they use preadv */
+    struct io_uring *ring;
     /* Flags for the QIOChannel */
     int read_flags;
 } MultiFDRecvParams;
@@ -408,6 +416,9 @@ void multifd_ram_payload_free(MultiFDPages_t *pages);
 void multifd_ram_fill_packet(MultiFDSendParams *p);
 int multifd_ram_unfill_packet(MultiFDRecvParams *p, Error **errp);
 
+void multifd_xbzrle_cache_zero_page(ram_addr_t addr);
+void multifd_xbzrle_sync(void);
+
 void multifd_send_data_clear_device_state(MultiFDDeviceState_t *device_state);
 
 void multifd_device_state_send_setup(void);
@@ -29,6 +29,7 @@
 #include "qemu-file.h"
 #include "ram.h"
 #include "options.h"
+#include "postcopy-ram.h"
 #include "system/kvm.h"
 
 /* Maximum migrate downtime set to 2000 seconds */
@@ -177,6 +178,8 @@ const Property migration_properties[] = {
     DEFINE_PROP_ZERO_PAGE_DETECTION("zero-page-detection", MigrationState,
                        parameters.zero_page_detection,
                        ZERO_PAGE_DETECTION_MULTIFD),
+    DEFINE_PROP_UINT8("postcopy-prefetch-window", MigrationState,
+                      parameters.postcopy_prefetch_window, 0),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -775,6 +778,13 @@ uint64_t migrate_max_postcopy_bandwidth(void)
     return s->parameters.max_postcopy_bandwidth;
 }
 
+uint8_t migrate_postcopy_prefetch_window(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.postcopy_prefetch_window;
+}
+
 MigMode migrate_mode(void)
 {
     MigMode mode = cpr_get_incoming_mode();
@@ -957,6 +967,8 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->zero_page_detection = s->parameters.zero_page_detection;
     params->has_direct_io = true;
     params->direct_io = s->parameters.direct_io;
+    params->has_postcopy_prefetch_window = true;
+    params->postcopy_prefetch_window = s->parameters.postcopy_prefetch_window;
 
     return params;
 }
@@ -991,6 +1003,7 @@ void migrate_params_init(MigrationParameters *params)
     params->has_mode = true;
     params->has_zero_page_detection = true;
     params->has_direct_io = true;
+    params->has_postcopy_prefetch_window = true;
 }
 
 /*
@@ -1177,6 +1190,15 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_postcopy_prefetch_window &&
+        params->postcopy_prefetch_window > POSTCOPY_PREFETCH_MAX_PAGES) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy-prefetch-window",
+                   "a value between 0 and "
+                   stringify(POSTCOPY_PREFETCH_MAX_PAGES));
+        return false;
+    }
+
     return true;
 }
 
@@ -1295,6 +1317,10 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_direct_io) {
         dest->direct_io = params->direct_io;
     }
+
+    if (params->has_postcopy_prefetch_window) {
+        dest->postcopy_prefetch_window = params->postcopy_prefetch_window;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1427,6 +1453,11 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_direct_io) {
         s->parameters.direct_io = params->direct_io;
     }
+
+    if (params->has_postcopy_prefetch_window) {
+        s->parameters.postcopy_prefetch_window =
+            params->postcopy_prefetch_window;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -17,6 +17,7 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/thread.h"
 #include "page_cache.h"
 #include "trace.h"
 
@@ -36,6 +37,9 @@ struct PageCache {
     size_t page_size;
     size_t max_num_items;
     size_t num_items;
+    /* only for sharded caches */
+    QemuMutex *shard_locks;
+    unsigned int shard_shift;
 };
 
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
@@ -66,6 +70,8 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     cache->page_size = page_size;
     cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->shard_locks = NULL;
+    cache->shard_shift = 0;
 
     trace_migration_pagecache_init(cache->max_num_items);
 
@@ -87,6 +93,26 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     return cache;
 }
 
+PageCache *cache_init_sharded(uint64_t new_size, size_t page_size,
+                              unsigned int shards, Error **errp)
+{
+    PageCache *cache = cache_init(new_size, page_size, errp);
+    unsigned int i;
+
+    if (!cache) {
+        return NULL;
+    }
+
+    shards = MIN(pow2floor(MAX(shards, 1)), cache->max_num_items);
+    cache->shard_shift = ctz64(cache->max_num_items / shards);
+    cache->shard_locks = g_new(QemuMutex, shards);
+    for (i = 0; i < shards; i++) {
+        qemu_mutex_init(&cache->shard_locks[i]);
+    }
+
+    return cache;
+}
+
 void cache_fini(PageCache *cache)
 {
     int64_t i;
@@ -98,6 +124,13 @@ void cache_fini(PageCache *cache)
         g_free(cache->page_cache[i].it_data);
     }
 
+    if (cache->shard_locks) {
+        for (i = 0; i < cache->max_num_items >> cache->shard_shift; i++) {
+            qemu_mutex_destroy(&cache->shard_locks[i]);
+        }
+        g_free(cache->shard_locks);
+    }
+
     g_free(cache->page_cache);
     cache->page_cache = NULL;
     g_free(cache);
@@ -110,6 +143,23 @@ static size_t cache_get_cache_pos(const PageCache *cache,
     return (address / cache->page_size) & (cache->max_num_items - 1);
 }
 
+static QemuMutex *cache_get_shard_lock(PageCache *cache, uint64_t addr)
+{
+    g_assert(cache->shard_locks);
+    return &cache->shard_locks[cache_get_cache_pos(cache, addr) >>
+                               cache->shard_shift];
+}
+
+void cache_shard_lock(PageCache *cache, uint64_t addr)
+{
+    qemu_mutex_lock(cache_get_shard_lock(cache, addr));
+}
+
+void cache_shard_unlock(PageCache *cache, uint64_t addr)
+{
+    qemu_mutex_unlock(cache_get_shard_lock(cache, addr));
+}
+
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
     size_t pos;
@@ -127,6 +177,11 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
     return cache_get_by_addr(cache, addr)->it_data;
 }
 
+uint64_t cache_get_age(const PageCache *cache, uint64_t addr)
+{
+    return cache_get_by_addr(cache, addr)->it_age;
+}
+
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
                      uint64_t current_age)
 {
@@ -163,7 +218,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
             trace_migration_pagecache_insert();
             return -1;
         }
-        cache->num_items++;
+        qatomic_inc(&cache->num_items);
     }
 
     memcpy(it->it_data, pdata, cache->page_size);
@@ -29,6 +29,41 @@ typedef struct PageCache PageCache;
  * @errp: set *errp if the check failed, with reason
  */
 PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
+
+/**
+ * cache_init_sharded: Initialize a page cache for several threads
+ *
+ * The slots of the cache are split in @shards contiguous ranges, each
+ * protected by its own lock.  The pages that map to a shard are accessed
+ * between cache_shard_lock() and cache_shard_unlock().
+ *
+ * Returns new allocated cache or NULL on error
+ *
+ * @cache_size: cache size in bytes
+ * @page_size: cache page size
+ * @shards: number of locks, rounded down to a power of two that is not
+ *          larger than the number of pages in the cache
+ * @errp: set *errp if the check failed, with reason
+ */
+PageCache *cache_init_sharded(uint64_t cache_size, size_t page_size,
+                              unsigned int shards, Error **errp);
+
+/**
+ * cache_shard_lock: lock the shard of a page
+ *
+ * @cache pointer to a PageCache created by cache_init_sharded()
+ * @addr: page addr
+ */
+void cache_shard_lock(PageCache *cache, uint64_t addr);
+
+/**
+ * cache_shard_unlock: unlock the shard of a page
+ *
+ * @cache pointer to a PageCache created by cache_init_sharded()
+ * @addr: page addr
+ */
+void cache_shard_unlock(PageCache *cache, uint64_t addr);
+
 /**
  * cache_fini: free all cache resources
  * @cache pointer to the PageCache struct
@@ -57,6 +92,17 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
  */
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
 
+/**
+ * cache_get_age: Get the age of the page cached for an addr
+ *
+ * Returns the age given when the page was last inserted or hit, only
+ * meaningful if the page is cached
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+uint64_t cache_get_age(const PageCache *cache, uint64_t addr);
+
 /**
  * cache_insert: insert the page into the cache. the page cache
  * will dup the data on insert. the previous value will be overwritten
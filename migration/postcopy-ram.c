@@ -18,6 +18,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -176,8 +177,8 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
 
 /*
  * This function just populates MigrationInfo from postcopy's
- * blocktime context. It will not populate MigrationInfo,
- * unless postcopy-blocktime capability was set.
+ * prefetch counters and blocktime context. It will not populate
+ * the blocktime unless postcopy-blocktime capability was set.
  *
  * @info: pointer to MigrationInfo to populate
  */
@@ -186,6 +187,14 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *bc = mis->blocktime_ctx;
 
+    if (migrate_postcopy_prefetch_window()) {
+        info->has_postcopy_prefetch_pages = true;
+        info->postcopy_prefetch_pages =
+            stat64_get(&mis->postcopy_prefetch_pages);
+        info->has_postcopy_prefetch_hits = true;
+        info->postcopy_prefetch_hits = stat64_get(&mis->postcopy_prefetch_hits);
+    }
+
     if (!bc) {
         return;
     }
@@ -943,6 +952,143 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
                                       affected_cpu);
 }
 
+/*
+ * The faults of each vCPU are matched against two patterns: a constant
+ * stride between consecutive faults, as in a sequential scan, and
+ * consecutive faults within the same POSTCOPY_PREFETCH_REGION.  Once a
+ * pattern shows up, the next pages along it are requested right after
+ * the faulting page, so that they are likely in place by the time the
+ * vCPU gets there.  The window doubles each time a stride repeats, up to
+ * the postcopy-prefetch-window parameter, which is 0 unless prefetching
+ * is wanted.
+ */
+#define POSTCOPY_PREFETCH_MAX_BYTES     (4 * MiB)
+/* Largest stride that is followed, in host pages */
+#define POSTCOPY_PREFETCH_MAX_STRIDE    16
+#define POSTCOPY_PREFETCH_REGION        (2 * MiB)
+#define POSTCOPY_PREFETCH_REGION_PAGES  8
+
+typedef struct PostcopyPrefetchStream {
+    RAMBlock *rb;
+    /* Offset in @rb of the last fault */
+    ram_addr_t last;
+    /* Distance from the fault before it */
+    int64_t stride;
+    /* Number of times in a row that @stride was seen */
+    unsigned int streak;
+    /*
+     * The last prefetch was for @last + i * @window_stride, with bit i - 1
+     * of @window set for each page that was requested.
+     */
+    int64_t window_stride;
+    uint64_t window;
+} PostcopyPrefetchStream;
+
+/*
+ * Count the prefetched pages that the vCPU went past without faulting,
+ * if it is still following the pattern of its last prefetch.
+ */
+static void postcopy_prefetch_account(MigrationIncomingState *mis,
+                                      PostcopyPrefetchStream *ps,
+                                      RAMBlock *rb, ram_addr_t offset)
+{
+    int64_t delta = offset - ps->last;
+    int64_t k;
+
+    if (!ps->window || ps->rb != rb || delta % ps->window_stride) {
+        return;
+    }
+
+    k = delta / ps->window_stride;
+    if (k > 1) {
+        uint64_t passed = k > 64 ? UINT64_MAX : MAKE_64BIT_MASK(0, k - 1);
+
+        stat64_add(&mis->postcopy_prefetch_hits, ctpop64(ps->window & passed));
+    }
+}
+
+/*
+ * Request the pages that the vCPU behind @ps is likely to fault on next,
+ * after it faulted on the host page at @offset of @rb.
+ */
+static void postcopy_prefetch(MigrationIncomingState *mis,
+                              PostcopyPrefetchStream *ps,
+                              RAMBlock *rb, ram_addr_t offset)
+{
+    ram_addr_t offsets[POSTCOPY_PREFETCH_MAX_PAGES];
+    size_t page_size = qemu_ram_pagesize(rb);
+    unsigned int max_pages = MIN(POSTCOPY_PREFETCH_MAX_BYTES / page_size,
+                                 migrate_postcopy_prefetch_window());
+    unsigned int window = 0, n = 0, i;
+    int64_t stride = 0;
+    int ret;
+
+    if (!max_pages) {
+        return;
+    }
+
+    postcopy_prefetch_account(mis, ps, rb, offset);
+
+    if (ps->rb == rb) {
+        int64_t delta = offset - ps->last;
+
+        if (delta && delta == ps->stride &&
+            ABS(delta) <= POSTCOPY_PREFETCH_MAX_STRIDE * page_size) {
+            ps->streak = MIN(ps->streak + 1, 6);
+            stride = delta;
+            window = MIN(1U << ps->streak, max_pages);
+        } else if (delta && page_size < POSTCOPY_PREFETCH_REGION &&
+                   ROUND_DOWN(offset, POSTCOPY_PREFETCH_REGION) ==
+                   ROUND_DOWN(ps->last, POSTCOPY_PREFETCH_REGION)) {
+            /* Fetch the rest of the region, following the fault */
+            ps->streak = 0;
+            stride = page_size;
+            window = MIN(POSTCOPY_PREFETCH_REGION_PAGES, max_pages);
+            window = MIN(window, (ROUND_UP(offset + 1,
+                                           POSTCOPY_PREFETCH_REGION) -
+                                  offset) / page_size - 1);
+        } else {
+            ps->streak = 0;
+        }
+        ps->stride = delta;
+    } else {
+        ps->stride = 0;
+        ps->streak = 0;
+    }
+
+    ps->rb = rb;
+    ps->last = offset;
+    ps->window = 0;
+    ps->window_stride = stride;
+
+    for (i = 1; i <= window; i++) {
+        int64_t next = offset + i * stride;
+
+        if (next < 0 || next >= rb->used_length) {
+            break;
+        }
+        /* Discarded pages are placed as zero pages when they fault */
+        if (!ramblock_page_is_discarded(rb, next)) {
+            offsets[n++] = next;
+        }
+    }
+    if (!n) {
+        return;
+    }
+
+    /* On error, the next fault pauses the fault thread */
+    ret = migrate_send_rp_req_pages_ahead(mis, rb, offsets, n);
+    trace_postcopy_prefetch(qemu_ram_get_idstr(rb), offset, stride, n, ret);
+    if (ret <= 0) {
+        return;
+    }
+
+    stat64_add(&mis->postcopy_prefetch_pages, ret);
+    for (i = 0; i < ret; i++) {
+        ps->window |= BIT_ULL((int64_t)(offsets[i] - offset) / stride - 1);
+    }
+}
+
 static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
 {
     trace_postcopy_pause_fault_thread();
@@ -956,6 +1102,10 @@ static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
 static void *postcopy_ram_fault_thread(void *opaque)
 {
     MigrationIncomingState *mis = opaque;
+    MachineState *ms = MACHINE(qdev_get_machine());
+    /* One per vCPU, and the last one for faults from other threads */
+    g_autofree PostcopyPrefetchStream *streams =
+        g_new0(PostcopyPrefetchStream, ms->smp.max_cpus + 1);
     struct uffd_msg msg;
     int ret;
     size_t index;
@@ -988,6 +1138,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
     while (true) {
         ram_addr_t rb_offset;
         int poll_result;
+        int cpu;
 
         /*
          * We're mainly waiting for the kernel to give us a faulting HVA,
@@ -1084,6 +1235,13 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+
+            cpu = msg.arg.pagefault.feat.ptid ?
+                  get_mem_fault_cpu_index(msg.arg.pagefault.feat.ptid) : -1;
+            if (cpu < 0 || cpu >= ms->smp.max_cpus) {
+                cpu = ms->smp.max_cpus;
+            }
+            postcopy_prefetch(mis, &streams[cpu], rb, rb_offset);
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -15,6 +15,9 @@
 
 #include "qapi/qapi-types-migration.h"
 
+/* Largest value of the postcopy-prefetch-window parameter */
+#define POSTCOPY_PREFETCH_MAX_PAGES 32
+
 /* Return true if the host supports everything we need to do postcopy-ram */
 bool postcopy_ram_supported_by_host(MigrationIncomingState *mis,
                                     Error **errp);
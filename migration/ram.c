@@ -33,6 +33,7 @@
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
 #include "xbzrle.h"
+#include "bmap-summary.h"
 #include "ram.h"
 #include "migration.h"
 #include "migration-stats.h"
@@ -56,6 +57,8 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "file.h"
+#include "block/thread-pool.h"
 #include "system/runstate.h"
 #include "rdma.h"
 #include "options.h"
@@ -89,6 +92,13 @@
  */
 #define MAPPED_RAM_LOAD_BUF_SIZE 0x100000
 
+/*
+ * With multifd, channels that read with io_uring get jobs of up to this
+ * size, and keep several requests of each in flight.  The others get jobs
+ * of MAPPED_RAM_LOAD_BUF_SIZE.
+ */
+#define MAPPED_RAM_MULTIFD_URING_LOAD_BUF_SIZE 0x2000000
+
 XBZRLECacheStats xbzrle_counters;
 
 /*
@@ -432,6 +442,19 @@ struct RAMState {
      * Protected by @bitmap_mutex.
      */
     PageLocationHint page_hint;
+    /*
+     * Workers for the dirty bitmap sync of large RAMBlocks, NULL if the
+     * guest is too small to benefit from them.
+     */
+    ThreadPool *sync_threads;
+    /* Dirty pages in hot words of bmap, as of the last bitmap sync */
+    uint64_t hot_dirty_pages;
+    /*
+     * Whether the search for dirty pages skips hot words, so that their
+     * pages are only sent by the completion stage or by postcopy.
+     * Protected by @bitmap_mutex.
+     */
+    bool defer_hot_pages;
 };
 typedef struct RAMState RAMState;
 
@@ -709,6 +732,11 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+static bool ram_defer_hot_pages(RAMState *rs)
+{
+    return rs->defer_hot_pages && !migration_in_postcopy();
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -739,9 +767,18 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
     if (pss->host_page_sending) {
         assert(pss->host_page_end);
         size = MIN(size, pss->host_page_end);
+        pss->page = find_next_bit(bitmap, size, pss->page);
+        return;
     }
 
-    pss->page = find_next_bit(bitmap, size, pss->page);
+    if (ram_defer_hot_pages(ram_state)) {
+        unsigned long host_pages = rb->page_size >> TARGET_PAGE_BITS;
+
+        pss->page = ramblock_find_next_cold_dirty(rb, size, pss->page,
+                                                  host_pages);
+    } else {
+        pss->page = ramblock_find_next_dirty(rb, size, pss->page);
+    }
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -931,6 +968,132 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
+    rs->hot_dirty_pages +=
+        ramblock_count_hot_pages(rb, 0, rb->used_length >> TARGET_PAGE_BITS);
+}
+
+/*
+ * RAMBlocks of at least two chunks are synchronized by rs->sync_threads,
+ * one chunk per task.  The guest needs RAM_SYNC_BYTES_PER_THREAD of RAM
+ * for each worker thread.
+ */
+#define RAM_SYNC_CHUNK_BYTES        (1ULL << 30)
+#define RAM_SYNC_BYTES_PER_THREAD   (32ULL << 30)
+#define RAM_SYNC_THREADS_MAX        8
+
+typedef struct RAMSyncChunk {
+    RAMBlock *rb;
+    ram_addr_t start;
+    ram_addr_t length;
+    Stat64 *new_dirty_pages;
+    Stat64 *hot_dirty_pages;
+} RAMSyncChunk;
+
+static int ramblock_sync_dirty_chunk(void *opaque)
+{
+    RAMSyncChunk *chunk = opaque;
+
+    /*
+     * No rcu_read_lock(): thread pool workers are not registered with RCU.
+     * The migration thread stays in its RCU critical section until all
+     * chunks are done, so chunk->rb and the dirty memory blocks stay valid.
+     */
+    stat64_add(chunk->new_dirty_pages,
+               cpu_physical_memory_sync_dirty_bitmap(chunk->rb, chunk->start,
+                                                     chunk->length));
+    stat64_add(chunk->hot_dirty_pages,
+               ramblock_count_hot_pages(chunk->rb,
+                                        chunk->start >> TARGET_PAGE_BITS,
+                                        chunk->length >> TARGET_PAGE_BITS));
+    return 0;
+}
+
+/*
+ * Queue the sync of @rb to rs->sync_threads.  Chunks touch disjoint words
+ * of bmap and bits of clear_bmap, so they only need the fast path of
+ * cpu_physical_memory_sync_dirty_bitmap(), which works on whole words.
+ *
+ * Returns false if @rb must be synchronized by the caller instead.
+ *
+ * Called with RCU critical section
+ */
+static bool ramblock_sync_dirty_bitmap_queue(RAMState *rs, RAMBlock *rb,
+                                             Stat64 *new_dirty_pages,
+                                             Stat64 *hot_dirty_pages)
+{
+    ram_addr_t word_size = (ram_addr_t)BITS_PER_LONG << TARGET_PAGE_BITS;
+    ram_addr_t clear_size, chunk_size, start;
+
+    if (!rs->sync_threads || !rb->clear_bmap ||
+        !QEMU_IS_ALIGNED(rb->offset, word_size) ||
+        !QEMU_IS_ALIGNED(rb->used_length, word_size)) {
+        return false;
+    }
+
+    clear_size = (ram_addr_t)1 << (rb->clear_bmap_shift + TARGET_PAGE_BITS);
+    chunk_size = MAX(RAM_SYNC_CHUNK_BYTES, clear_size);
+    if (rb->used_length < 2 * chunk_size) {
+        return false;
+    }
+
+    /*
+     * The workers are not RCU readers: they rely on the caller's critical
+     * section to keep @rb and ram_list.dirty_memory alive, so the caller
+     * must not leave it before thread_pool_wait() returns.
+     */
+    for (start = 0; start < rb->used_length; start += chunk_size) {
+        RAMSyncChunk *chunk = g_new(RAMSyncChunk, 1);
+
+        chunk->rb = rb;
+        chunk->start = start;
+        chunk->length = MIN(chunk_size, rb->used_length - start);
+        chunk->new_dirty_pages = new_dirty_pages;
+        chunk->hot_dirty_pages = hot_dirty_pages;
+        thread_pool_submit(rs->sync_threads, ramblock_sync_dirty_chunk,
+                           chunk, g_free);
+    }
+    return true;
+}
+
+/* Called with RCU critical section */
+static void migration_bitmap_sync_blocks(RAMState *rs)
+{
+    Stat64 new_dirty_pages, hot_dirty_pages;
+    RAMBlock *block;
+    bool queued = false;
+
+    stat64_init(&new_dirty_pages, 0);
+    stat64_init(&hot_dirty_pages, 0);
+    rs->hot_dirty_pages = 0;
+
+    /* Small RAMBlocks are synchronized while the workers run */
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        if (ramblock_sync_dirty_bitmap_queue(rs, block, &new_dirty_pages,
+                                             &hot_dirty_pages)) {
+            queued = true;
+        } else {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+    }
+
+    if (queued) {
+        /* Still in the critical section that the workers depend on */
+        thread_pool_wait(rs->sync_threads);
+        rs->migration_dirty_pages += stat64_get(&new_dirty_pages);
+        rs->num_dirty_pages_period += stat64_get(&new_dirty_pages);
+        rs->hot_dirty_pages += stat64_get(&hot_dirty_pages);
+    }
+
+    /*
+     * Sending hot pages before the completion stage is wasted bandwidth
+     * as long as they can all be sent within the downtime limit.
+     * Otherwise they are sent as usual, which may still let the
+     * migration converge, for example with auto-converge.
+     */
+    rs->defer_hot_pages = rs->hot_dirty_pages * TARGET_PAGE_SIZE <
+                          migrate_get_current()->threshold_size;
+    trace_migration_bitmap_sync_hot(rs->hot_dirty_pages,
+                                    rs->defer_hot_pages);
 }
 
 /**
@@ -1054,7 +1217,6 @@ static void migration_trigger_throttle(RAMState *rs)
 
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
-    RAMBlock *block;
     int64_t end_time;
 
     stat64_add(&mig_stats.dirty_sync_count, 1);
@@ -1068,9 +1230,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
-            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-                ramblock_sync_dirty_bitmap(rs, block);
-            }
+            migration_bitmap_sync_blocks(rs);
             stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
     }
@@ -1175,6 +1335,9 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
         XBZRLE_cache_lock();
         xbzrle_cache_zero_page(pss->block->offset + offset);
         XBZRLE_cache_unlock();
+    } else if (migrate_multifd() &&
+               migrate_multifd_compression() == MULTIFD_COMPRESSION_XBZRLE) {
+        multifd_xbzrle_cache_zero_page(pss->block->offset + offset);
     }
 
     return len;
@@ -2340,6 +2503,7 @@ static void xbzrle_load_cleanup(void)
 static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
+        g_clear_pointer(&(*rsp)->sync_threads, thread_pool_free);
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
@@ -2373,6 +2537,9 @@ static void ram_bitmaps_destroy(void)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        bmap_summary_free(block);
+        g_free(block->bmap_heat);
+        block->bmap_heat = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
     }
@@ -2581,7 +2748,10 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
                  * Remark them as dirty, updating the count for any pages
                  * that weren't previously dirty.
                  */
-                rs->migration_dirty_pages += !test_and_set_bit(page, bitmap);
+                if (!test_and_set_bit(page, bitmap)) {
+                    rs->migration_dirty_pages++;
+                    bmap_summary_mark(block, BIT_WORD(page));
+                }
             }
         }
 
@@ -2710,6 +2880,22 @@ err_out:
     return false;
 }
 
+static ThreadPool *ram_sync_threads_new(uint64_t ram_bytes)
+{
+    ThreadPool *pool;
+    uint64_t threads;
+
+    threads = MIN(ram_bytes / RAM_SYNC_BYTES_PER_THREAD, RAM_SYNC_THREADS_MAX);
+    threads = MIN(threads, g_get_num_processors());
+    if (threads < 2) {
+        return NULL;
+    }
+
+    pool = thread_pool_new();
+    thread_pool_set_max_threads(pool, threads);
+    return pool;
+}
+
 static bool ram_state_init(RAMState **rsp, Error **errp)
 {
     *rsp = g_try_new0(RAMState, 1);
@@ -2730,6 +2916,7 @@ static bool ram_state_init(RAMState **rsp, Error **errp)
      * This must match with the initial values of dirty bitmap.
      */
     (*rsp)->migration_dirty_pages = (*rsp)->ram_bytes_total >> TARGET_PAGE_BITS;
+    (*rsp)->sync_threads = ram_sync_threads_new((*rsp)->ram_bytes_total);
     ram_state_reset(*rsp);
 
     return true;
@@ -2768,6 +2955,8 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            bmap_summary_init(block, pages);
+            block->bmap_heat = g_new0(uint8_t, BITS_TO_LONGS(pages));
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
@@ -3179,6 +3368,16 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
             if (ram_list.version != rs->last_version) {
+                /*
+                 * The scan starts over, so pages sent in this round may
+                 * be sent again: multifd must sync first.
+                 */
+                if (multifd_ram_sync_per_round()) {
+                    ret = multifd_ram_flush_and_sync(f);
+                    if (ret < 0) {
+                        goto out;
+                    }
+                }
                 ram_state_reset(rs);
             }
 
@@ -3296,6 +3495,7 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 
         /* flush all remaining blocks regardless of rate limiting */
         qemu_mutex_lock(&rs->bitmap_mutex);
+        rs->defer_hot_pages = false;
         while (true) {
             int pages;
 
@@ -3351,7 +3551,18 @@ static void ram_state_pending_estimate(void *opaque, uint64_t *must_precopy,
     RAMState **temp = opaque;
     RAMState *rs = *temp;
 
-    uint64_t remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
+    uint64_t remaining_pages = rs->migration_dirty_pages;
+    uint64_t remaining_size;
+
+    /*
+     * Deferred hot pages are not sent by ram_save_iterate(), so leave them
+     * out of the estimate.  The exact size still includes them, so that
+     * they are accounted for in the downtime.
+     */
+    if (ram_defer_hot_pages(rs)) {
+        remaining_pages -= MIN(rs->hot_dirty_pages, remaining_pages);
+    }
+    remaining_size = remaining_pages * TARGET_PAGE_SIZE;
 
     if (migrate_postcopy_ram()) {
         /* We can do postcopy, and all the data is postcopiable */
@@ -3496,10 +3707,12 @@ void colo_record_bitmap(RAMBlock *block, ram_addr_t *normal, uint32_t pages)
 {
     qemu_mutex_lock(&ram_state->bitmap_mutex);
     for (int i = 0; i < pages; i++) {
-        ram_addr_t offset = normal[i];
-        ram_state->migration_dirty_pages += !test_and_set_bit(
-                                                offset >> TARGET_PAGE_BITS,
-                                                block->bmap);
+        unsigned long page = normal[i] >> TARGET_PAGE_BITS;
+
+        if (!test_and_set_bit(page, block->bmap)) {
+            ram_state->migration_dirty_pages++;
+            bmap_summary_mark(block, BIT_WORD(page));
+        }
     }
     qemu_mutex_unlock(&ram_state->bitmap_mutex);
 }
@@ -3966,12 +4179,14 @@ static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                 return false;
             }
 
-            size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
-
             if (migrate_multifd()) {
+                size = MIN(unread, multifd_file_recv_uring_in_use() ?
+                                   MAPPED_RAM_MULTIFD_URING_LOAD_BUF_SIZE :
+                                   MAPPED_RAM_LOAD_BUF_SIZE);
                 read = ram_load_multifd_pages(host, size,
                                               block->pages_offset + offset);
             } else {
+                size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
                 read = qemu_get_buffer_at(f, host, size,
                                           block->pages_offset + offset);
             }
@@ -4456,6 +4671,7 @@ bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *block, Error **errp)
      * dirty bitmap for this ramblock.
      */
     bitmap_complement(block->bmap, block->bmap, nbits);
+    bmap_summary_fill(block, block->max_length >> TARGET_PAGE_BITS);
 
     /* Clear dirty bits of discarded ranges that we don't want to migrate. */
     ramblock_dirty_bitmap_clear_discarded_pages(block);
@@ -2298,7 +2298,8 @@ static gboolean postcopy_sync_page_req(gpointer key, gpointer value,
         return FALSE;
     }
 
-    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset);
+    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset,
+                                            qemu_ram_pagesize(rb));
     if (ret) {
         /* Please refer to above comment. */
         error_report("%s: send rp message failed for addr %p",
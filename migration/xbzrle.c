@@ -161,6 +161,46 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 #define xbzrle_encode_buffer xbzrle_encode_buffer_int
 #endif
 
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+/* Skip 16 bytes at a time while the buffers are equal */
+static inline int xbzrle_skip_zrun(uint8_t *old_buf, uint8_t *new_buf,
+                                   int i, int slen)
+{
+    while (i + 16 <= slen &&
+           vminvq_u8(vceqq_u8(vld1q_u8(old_buf + i),
+                              vld1q_u8(new_buf + i))) == 0xff) {
+        i += 16;
+    }
+    return i;
+}
+
+/* Skip 16 bytes at a time while no byte of the buffers is equal */
+static inline int xbzrle_skip_nzrun(uint8_t *old_buf, uint8_t *new_buf,
+                                    int i, int slen)
+{
+    while (i + 16 <= slen &&
+           vmaxvq_u8(vceqq_u8(vld1q_u8(old_buf + i),
+                              vld1q_u8(new_buf + i))) == 0) {
+        i += 16;
+    }
+    return i;
+}
+#else
+static inline int xbzrle_skip_zrun(uint8_t *old_buf, uint8_t *new_buf,
+                                   int i, int slen)
+{
+    return i;
+}
+
+static inline int xbzrle_skip_nzrun(uint8_t *old_buf, uint8_t *new_buf,
+                                    int i, int slen)
+{
+    return i;
+}
+#endif
+
 /*
   page = zrun nzrun
        | zrun nzrun page
@@ -198,6 +238,10 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
         /* word at a time for speed */
         if (!res) {
+            int start = i;
+
+            i = xbzrle_skip_zrun(old_buf, new_buf, i, slen);
+            zrun_len += i - start;
             while (i < slen &&
                    (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
                 i += sizeof(long);
@@ -242,6 +286,10 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
         if (!res) {
             /* truncation to 32-bit long okay */
             unsigned long mask = (unsigned long)0x0101010101010101ULL;
+            int start = i;
+
+            i = xbzrle_skip_nzrun(old_buf, new_buf, i, slen);
+            nzrun_len += i - start;
             while (i < slen) {
                 unsigned long xor;
                 xor = *(unsigned long *)(old_buf + i)
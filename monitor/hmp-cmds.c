@@ -192,6 +192,7 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
     IOThreadInfoList *info_list = qmp_query_iothreads(NULL);
     IOThreadInfoList *info;
     IOThreadInfo *value;
+    IOThreadPollInfoList *poll;
 
     for (info = info_list; info; info = info->next) {
         value = info->value;
@@ -202,6 +203,14 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        for (poll = value->poll; poll; poll = poll->next) {
+            monitor_printf(mon, "  fd %" PRId64 ": polling=%s poll-ns=%" PRId64
+                           " hits=%" PRIu64 " misses=%" PRIu64 "\n",
+                           poll->value->fd,
+                           poll->value->polling ? "on" : "off",
+                           poll->value->poll_ns, poll->value->hits,
+                           poll->value->misses);
+        }
     }
 
     qapi_free_IOThreadInfoList(info_list);
@@ -14,6 +14,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/coroutine.h"
 #include "qemu/sockets.h"
 #include "monitor-internal.h"
 #include "monitor/qdev.h"
@@ -187,6 +188,36 @@ out:
     return output;
 }
 
+static void query_one_local_pool(int thread_id, unsigned int size,
+                                 unsigned long reused, void *opaque)
+{
+    CoroutineLocalPoolInfoList ***tail = opaque;
+    CoroutineLocalPoolInfo *info;
+
+    info = g_new0(CoroutineLocalPoolInfo, 1);
+    info->thread_id = thread_id;
+    info->size = size;
+    info->reused = reused;
+    QAPI_LIST_APPEND(*tail, info);
+}
+
+CoroutinePoolInfo *qmp_query_coroutine_pool(Error **errp)
+{
+    CoroutinePoolInfo *info = g_new0(CoroutinePoolInfo, 1);
+    CoroutineLocalPoolInfoList **tail = &info->local_pools;
+    CoroutinePoolStats stats;
+
+    qemu_coroutine_get_pool_stats(&stats);
+    info->stack_size = stats.stack_size;
+    info->allocated = stats.allocated;
+    info->trimmed = stats.trimmed;
+    info->global_size = stats.global_size;
+    info->global_max_size = stats.global_max_size;
+
+    qemu_coroutine_foreach_local_pool(query_one_local_pool, &tail);
+    return info;
+}
+
 static void __attribute__((__constructor__)) monitor_init_qmp_commands(void)
 {
     /*
@@ -112,15 +112,16 @@ void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
                                        cond, entry, imm, udata);
 }
 
-void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+bool qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
     struct qemu_plugin_tb *tb,
     enum qemu_plugin_op op,
     qemu_plugin_u64 entry,
     uint64_t imm)
 {
-    if (!tb_is_mem_only()) {
-        plugin_register_inline_op_on_entry(&tb->cbs, 0, op, entry, imm);
+    if (tb_is_mem_only()) {
+        return plugin_inline_op_is_valid(op, entry, imm);
     }
+    return plugin_register_inline_op_on_entry(&tb->cbs, 0, op, entry, imm);
 }
 
 void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
@@ -153,15 +154,17 @@ void qemu_plugin_register_vcpu_insn_exec_cond_cb(
                                        cond, entry, imm, udata);
 }
 
-void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+bool qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_op op,
     qemu_plugin_u64 entry,
     uint64_t imm)
 {
-    if (!tb_is_mem_only()) {
-        plugin_register_inline_op_on_entry(&insn->insn_cbs, 0, op, entry, imm);
+    if (tb_is_mem_only()) {
+        return plugin_inline_op_is_valid(op, entry, imm);
     }
+    return plugin_register_inline_op_on_entry(&insn->insn_cbs, 0,
+                                              op, entry, imm);
 }
 
 
@@ -178,14 +181,23 @@ void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
     plugin_register_vcpu_mem_cb(&insn->mem_cbs, cb, flags, rw, udata);
 }
 
-void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+bool qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_mem_rw rw,
     enum qemu_plugin_op op,
     qemu_plugin_u64 entry,
     uint64_t imm)
 {
-    plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
+    return plugin_register_inline_op_on_entry(&insn->mem_cbs, rw,
+                                              op, entry, imm);
+}
+
+void qemu_plugin_register_vcpu_mem_buffered(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    struct qemu_plugin_mem_buffer *buf)
+{
+    plugin_register_vcpu_mem_buffered(&insn->mem_cbs, rw, buf, insn->vaddr);
 }
 
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
@@ -479,6 +491,44 @@ void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
     return base_ptr + vcpu_index * g_array_get_element_size(score->data);
 }
 
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records,
+                           qemu_plugin_vcpu_mem_batch_cb_t cb,
+                           void *userdata)
+{
+    struct qemu_plugin_mem_buffer *buf =
+        g_new0(struct qemu_plugin_mem_buffer, 1);
+
+    g_assert(n_records > 0);
+    buf->score = plugin_scoreboard_new(PLUGIN_MEM_BUFFER_RECORDS_OFFSET +
+                                       n_records *
+                                       sizeof(qemu_plugin_mem_record));
+    buf->n = n_records;
+    buf->cb = cb;
+    buf->userp = userdata;
+    return buf;
+}
+
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf)
+{
+    plugin_scoreboard_free(buf->score);
+    g_free(buf);
+}
+
+void qemu_plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                  unsigned int vcpu_index)
+{
+    uint64_t *count = qemu_plugin_scoreboard_find(buf->score, vcpu_index);
+    size_t n = *count;
+
+    if (n) {
+        *count = 0;
+        buf->cb(vcpu_index,
+                (void *)count + PLUGIN_MEM_BUFFER_RECORDS_OFFSET,
+                n, buf->userp);
+    }
+}
+
 static uint64_t *plugin_u64_address(qemu_plugin_u64 entry,
                                     unsigned int vcpu_index)
 {
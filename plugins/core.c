@@ -338,12 +338,51 @@ static enum plugin_dyn_cb_type op_to_cb_type(enum qemu_plugin_op op)
         return PLUGIN_CB_INLINE_ADD_U64;
     case QEMU_PLUGIN_INLINE_STORE_U64:
         return PLUGIN_CB_INLINE_STORE_U64;
+    case QEMU_PLUGIN_INLINE_RING_APPEND_U64:
+        return PLUGIN_CB_INLINE_RING_APPEND_U64;
+    case QEMU_PLUGIN_INLINE_HASH_ADD_U64:
+        return PLUGIN_CB_INLINE_HASH_ADD_U64;
     default:
         g_assert_not_reached();
     }
 }
 
-void plugin_register_inline_op_on_entry(GArray **arr,
+/*
+ * The plugin gets to choose @op, @entry and @imm, so check that the op
+ * exists and stays within the scoreboard element.
+ */
+bool plugin_inline_op_is_valid(enum qemu_plugin_op op, qemu_plugin_u64 entry,
+                               uint64_t imm)
+{
+    size_t elem_size;
+    uint64_t slots;
+
+    if (!entry.score) {
+        return false;
+    }
+    elem_size = g_array_get_element_size(entry.score->data);
+    if (entry.offset > elem_size ||
+        elem_size - entry.offset < sizeof(uint64_t)) {
+        return false;
+    }
+
+    switch (op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        return true;
+    case QEMU_PLUGIN_INLINE_RING_APPEND_U64:
+    case QEMU_PLUGIN_INLINE_HASH_ADD_U64:
+        if (!is_power_of_2(imm)) {
+            return false;
+        }
+        slots = imm + (op == QEMU_PLUGIN_INLINE_RING_APPEND_U64);
+        return slots <= (elem_size - entry.offset) / sizeof(uint64_t);
+    default:
+        return false;
+    }
+}
+
+bool plugin_register_inline_op_on_entry(GArray **arr,
                                         enum qemu_plugin_mem_rw rw,
                                         enum qemu_plugin_op op,
                                         qemu_plugin_u64 entry,
@@ -354,9 +393,57 @@ void plugin_register_inline_op_on_entry(GArray **arr,
     struct qemu_plugin_inline_cb inline_cb = { .rw = rw,
                                                .entry = entry,
                                                .imm = imm };
+
+    if (!plugin_inline_op_is_valid(op, entry, imm)) {
+        return false;
+    }
+
     dyn_cb = plugin_get_dyn_cb(arr);
     dyn_cb->type = op_to_cb_type(op);
     dyn_cb->inline_insn = inline_cb;
+    return true;
+}
+
+void plugin_register_vcpu_mem_buffered(GArray **arr,
+                                       enum qemu_plugin_mem_rw rw,
+                                       struct qemu_plugin_mem_buffer *buf,
+                                       uint64_t pc)
+{
+    /*
+     * Match qemu_plugin_mem_buffer_flush:
+     *   void (*)(struct qemu_plugin_mem_buffer *, unsigned int)
+     */
+    static TCGHelperInfo flush_info = {
+        .flags = TCG_CALL_NO_RWG,
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(ptr, 1) |
+                     dh_typemask(i32, 2)),
+    };
+    /*
+     * Match plugin_mem_buffer_append:
+     *   void (*)(struct qemu_plugin_mem_buffer *, unsigned int, uint64_t,
+     *            uint64_t, qemu_plugin_meminfo_t)
+     */
+    static TCGHelperInfo append_info = {
+        .flags = TCG_CALL_NO_RWG,
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(ptr, 1) |
+                     dh_typemask(i32, 2) |
+                     dh_typemask(i64, 3) |
+                     dh_typemask(i64, 4) |
+                     (__builtin_types_compatible_p(qemu_plugin_meminfo_t,
+                                                   uint32_t)
+                      ? dh_typemask(i32, 5) : dh_typemask(s32, 5))),
+    };
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_buffered_cb buffered_cb = { .buf = buf,
+                                                   .flush_info = &flush_info,
+                                                   .append_info = &append_info,
+                                                   .pc = pc,
+                                                   .rw = rw };
+    dyn_cb->type = PLUGIN_CB_MEM_BUFFERED;
+    dyn_cb->buffered = buffered_cb;
 }
 
 void plugin_register_dyn_cb__udata(GArray **arr,
@@ -573,7 +660,7 @@ void qemu_plugin_flush_cb(void)
 
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
-                    int cpu_index)
+                    int cpu_index, uint64_t key)
 {
     char *ptr = cb->entry.score->data->data;
     size_t elem_size = g_array_get_element_size(
@@ -588,11 +675,44 @@ void exec_inline_op(enum plugin_dyn_cb_type type,
     case PLUGIN_CB_INLINE_STORE_U64:
         *val = cb->imm;
         break;
+    case PLUGIN_CB_INLINE_RING_APPEND_U64:
+        val[1 + (*val & (cb->imm - 1))] = key;
+        *val += 1;
+        break;
+    case PLUGIN_CB_INLINE_HASH_ADD_U64:
+        val[plugin_inline_hash_slot(key, cb->imm)] += 1;
+        break;
     default:
         g_assert_not_reached();
     }
 }
 
+void plugin_mem_buffer_append(struct qemu_plugin_mem_buffer *buf,
+                              unsigned int cpu_index, uint64_t vaddr,
+                              uint64_t pc, qemu_plugin_meminfo_t info)
+{
+    uint64_t *count = qemu_plugin_scoreboard_find(buf->score, cpu_index);
+    qemu_plugin_mem_record *rec =
+        (void *)count + PLUGIN_MEM_BUFFER_RECORDS_OFFSET;
+
+    /* Inline appends may leave the buffer full, so check first. */
+    if (*count >= buf->n) {
+        qemu_plugin_mem_buffer_flush(buf, cpu_index);
+    }
+    rec[(*count)++] = (qemu_plugin_mem_record) { .vaddr = vaddr,
+                                                 .pc = pc,
+                                                 .info = info };
+
+    /*
+     * We may be in the middle of an instruction which reserved room for
+     * its inline appends when it started, and which will not check again
+     * before making them.  Leave room for the largest such reservation.
+     */
+    if (*count + qatomic_read(&buf->reserved) > buf->n) {
+        qemu_plugin_mem_buffer_flush(buf, cpu_index);
+    }
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              uint64_t value_low,
                              uint64_t value_high,
@@ -620,10 +740,20 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                        vaddr, cb->regular.userp);
             }
             break;
+        case PLUGIN_CB_MEM_BUFFERED:
+            if (rw & cb->buffered.rw) {
+                plugin_mem_buffer_append(cb->buffered.buf, cpu->cpu_index,
+                                         vaddr, cb->buffered.pc,
+                                         make_plugin_meminfo(oi, rw));
+            }
+            break;
         case PLUGIN_CB_INLINE_ADD_U64:
         case PLUGIN_CB_INLINE_STORE_U64:
+        case PLUGIN_CB_INLINE_RING_APPEND_U64:
+        case PLUGIN_CB_INLINE_HASH_ADD_U64:
             if (rw & cb->inline_insn.rw) {
-                exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
+                exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index,
+                               vaddr);
             }
             break;
         default:
@@ -69,7 +69,10 @@ struct qemu_plugin_ctx {
 
 struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id);
 
-void plugin_register_inline_op_on_entry(GArray **arr,
+bool plugin_inline_op_is_valid(enum qemu_plugin_op op, qemu_plugin_u64 entry,
+                               uint64_t imm);
+
+bool plugin_register_inline_op_on_entry(GArray **arr,
                                         enum qemu_plugin_mem_rw rw,
                                         enum qemu_plugin_op op,
                                         qemu_plugin_u64 entry,
@@ -109,9 +112,14 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+void plugin_register_vcpu_mem_buffered(GArray **arr,
+                                       enum qemu_plugin_mem_rw rw,
+                                       struct qemu_plugin_mem_buffer *buf,
+                                       uint64_t pc);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
-                    int cpu_index);
+                    int cpu_index, uint64_t key);
 
 int plugin_num_vcpus(void);
 
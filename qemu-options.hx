@@ -228,6 +228,8 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=file (TCG translation profile kept across runs)\n"
+    "                tier-threshold=n (TCG hot block threshold, default 0=off)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -271,6 +273,22 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-cache=file``
+        Records which translation blocks were generated into ``file``
+        when QEMU exits, and reads it back on startup.  The first time
+        execution reaches a guest page, the blocks that the previous
+        run generated for that page are translated together, provided
+        the guest code is unchanged.  The file is ignored if it was
+        written by a different QEMU build or target.
+
+    ``tier-threshold=n``
+        Enables tiered translation.  Translation blocks are first
+        generated with an execution counter, and are retranslated
+        without it after ``n`` executions (at most 65535).  Hot blocks
+        are optimized further, may continue across direct jumps, and
+        end up packed together in the translation cache.
+        The default of 0 disables tiering.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
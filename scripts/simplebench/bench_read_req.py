@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+#
+# Test to compare performance of read requests for two qemu-img binary files.
+#
+# The idea of the test comes from the reads that BlockBackend submits to
+# io_uring without creating a coroutine.  Run it with a qemu-img binary from
+# before and one from after that change.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+import sys
+import os
+import subprocess
+import simplebench
+from results_to_text import results_to_text
+
+
+def bench_func(env, case):
+    """ Handle one "cell" of benchmarking table. """
+    return bench_read_req(env['qemu_img'], env['image_name'],
+                          case['block_size'], case['depth'], env['aio'])
+
+
+def qemu_img_pipe(*args):
+    '''Run qemu-img and return its output'''
+    subp = subprocess.Popen(list(args),
+                            stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    exitcode = subp.wait()
+    if exitcode < 0:
+        sys.stderr.write('qemu-img received signal %i: %s\n'
+                         % (-exitcode, ' '.join(list(args))))
+    return subp.communicate()[0]
+
+
+def bench_read_req(qemu_img, image_name, block_size, depth, aio):
+    """Benchmark read requests
+
+    The function runs the 'qemu-img bench' command on an existing raw image,
+    making a series of reads with O_DIRECT, and returns the total time of the
+    read operations.
+
+    qemu_img     -- path to qemu_img executable file
+    image_name   -- raw image to read, preferably at least 1G on a fast disk
+    block_size   -- size of each read
+    depth        -- number of reads in flight
+    aio          -- 'threads', 'native' or 'io_uring'
+
+    Returns {'seconds': int} on success and {'error': str} on failure.
+    Return value is compatible with simplebench lib.
+    """
+
+    if not os.path.isfile(qemu_img):
+        print(f'File not found: {qemu_img}')
+        sys.exit(1)
+
+    if not os.path.isfile(image_name):
+        print(f'File not found: {image_name}')
+        sys.exit(1)
+
+    count = int(os.path.getsize(image_name) / block_size)
+
+    args_bench = [qemu_img, 'bench', '-n', '-t', 'none', '-i', aio,
+                  '-d', str(depth), '-c', str(count), '-s', str(block_size),
+                  '-f', 'raw', image_name]
+
+    try:
+        ret = qemu_img_pipe(*args_bench)
+    except OSError as e:
+        return {'error': 'qemu_img bench failed: ' + str(e)}
+
+    if 'seconds' in ret:
+        ret_list = ret.split()
+        index = ret_list.index('seconds.')
+        return {'seconds': float(ret_list[index-1])}
+    else:
+        return {'error': 'qemu_img bench failed: ' + ret}
+
+
+if __name__ == '__main__':
+
+    if len(sys.argv) < 4:
+        program = os.path.basename(sys.argv[0])
+        print(f'USAGE: {program} <path to qemu-img binary file> '
+              '<path to another qemu-img to compare performance with> '
+              '<raw image to read>')
+        exit(1)
+
+    # Test-cases are "rows" in benchmark resulting table, 'id' is a caption
+    # for the row, other fields are handled by bench_func.
+    test_cases = [
+        {
+            'id': '<4K, depth 1>',
+            'block_size': 4096,
+            'depth': 1
+        },
+        {
+            'id': '<4K, depth 32>',
+            'block_size': 4096,
+            'depth': 32
+        },
+        {
+            'id': '<64K, depth 8>',
+            'block_size': 65536,
+            'depth': 8
+        },
+    ]
+
+    # Test-envs are "columns" in benchmark resulting table, 'id is a caption
+    # for the column, other fields are handled by bench_func.
+    test_envs = []
+    for aio in ('threads', 'io_uring'):
+        for i in (1, 2):
+            test_envs.append({
+                'id': f'<qemu-img binary {i}, aio={aio}>',
+                'qemu_img': f'{sys.argv[i]}',
+                'image_name': f'{sys.argv[3]}',
+                'aio': aio
+            })
+
+    result = simplebench.bench(bench_func, test_envs, test_cases, count=3,
+                               initial_run=False)
+    print(results_to_text(result))
@@ -312,7 +312,12 @@ void flatview_unref(FlatView *view)
     if (qatomic_fetch_dec(&view->ref) == 1) {
         trace_flatview_destroy_rcu(view, view->root);
         assert(view->root);
-        call_rcu(view, flatview_destroy, rcu);
+        /*
+         * The view keeps the MemoryRegions it maps alive, including RAM
+         * that is being unplugged or remapped, so free it without waiting
+         * for a batch of callbacks to pile up.
+         */
+        call_rcu_expedited(view, flatview_destroy, rcu);
     }
 }
 
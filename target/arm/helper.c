@@ -4284,6 +4284,20 @@ static void vmsa_ttbr_write(CPUARMState *env, const ARMCPRegInfo *ri,
     if (cpreg_field_is_64bit(ri) &&
         extract64(raw_read(env, ri) ^ value, 48, 16) != 0) {
         ARMCPU *cpu = env_archcpu(env);
+
+        if (arm_el_is_aa64(env, 1)) {
+            /*
+             * The EL1&0 TLB is tagged with the AArch64 ASID, so switch
+             * to the tlb of the new one and keep that of the old one.
+             */
+            uint16_t mask = ARMMMUIdxBit_E10_1 |
+                            ARMMMUIdxBit_E10_1_PAN |
+                            ARMMMUIdxBit_E10_0;
+
+            raw_write(env, ri, value);
+            tlb_set_asid_by_mmuidx(CPU(cpu), mask, aa64_regime_asid(env, 1));
+            return;
+        }
         tlb_flush(CPU(cpu));
     }
     raw_write(env, ri, value);
@@ -4294,16 +4308,18 @@ static void vmsa_tcr_ttbr_el2_write(CPUARMState *env, const ARMCPRegInfo *ri,
 {
     /*
      * If we are running with E2&0 regime, then an ASID is active.
-     * Flush if that might be changing.  Note we're not checking
-     * TCR_EL2.A1 to know if this is really the TTBRx_EL2 that
-     * holds the active ASID, only checking the field that might.
+     * Switch the E2&0 tlb if that might be changing.  This is done even
+     * when E2H is clear, so that the tlb is tagged with the right ASID
+     * when E2H is set again.
      */
-    if (extract64(raw_read(env, ri) ^ value, 48, 16) &&
-        (arm_hcr_el2_eff(env) & HCR_E2H)) {
+    if (extract64(raw_read(env, ri) ^ value, 48, 16)) {
         uint16_t mask = ARMMMUIdxBit_E20_2 |
                         ARMMMUIdxBit_E20_2_PAN |
                         ARMMMUIdxBit_E20_0;
-        tlb_flush_by_mmuidx(env_cpu(env), mask);
+
+        raw_write(env, ri, value);
+        tlb_set_asid_by_mmuidx(env_cpu(env), mask, aa64_regime_asid(env, 2));
+        return;
     }
     raw_write(env, ri, value);
 }
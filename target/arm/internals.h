@@ -201,6 +201,8 @@ FIELD(CPTR_EL3, TCPAC, 31, 1)
 #define TTBCR_SH1    (1U << 28)
 #define TTBCR_EAE    (1U << 31)
 
+#define TCR_AS       (1ULL << 36) /* AArch64 TCR_ELx only */
+
 FIELD(VTCR, T0SZ, 0, 6)
 FIELD(VTCR, SL0, 6, 2)
 FIELD(VTCR, IRGN0, 8, 2)
@@ -1149,6 +1151,20 @@ static inline uint64_t regime_tcr(CPUARMState *env, ARMMMUIdx mmu_idx)
     return env->cp15.tcr_el[regime_el(env, mmu_idx)];
 }
 
+/*
+ * Return the ASID of the AArch64 EL1&0 (@el == 1) or EL2&0 (@el == 2)
+ * translation regime, as passed to tlb_set_asid_by_mmuidx(): TCR_ELx.A1
+ * selects the TTBR which holds it, and TCR_ELx.AS its width.
+ */
+static inline uint32_t aa64_regime_asid(CPUARMState *env, int el)
+{
+    uint64_t tcr = env->cp15.tcr_el[el];
+    uint64_t ttbr = tcr & TTBCR_A1 ? env->cp15.ttbr1_el[el]
+                                   : env->cp15.ttbr0_el[el];
+
+    return extract64(ttbr, 48, tcr & TCR_AS ? 16 : 8);
+}
+
 /* Return true if the translation regime is using LPAE format page tables */
 static inline bool regime_using_lpae_format(CPUARMState *env, ARMMMUIdx mmu_idx)
 {
@@ -322,6 +322,39 @@ static void tlbi_aa64_vmalle1_write(CPUARMState *env, const ARMCPRegInfo *ri,
     }
 }
 
+/* Return the ASID operand of a TLBI by ASID, for vae1_tlbmask(). */
+static uint32_t vae1_tlbasid(CPUARMState *env, uint64_t value)
+{
+    uint64_t hcr = arm_hcr_el2_eff(env);
+    int el = (hcr & (HCR_E2H | HCR_TGE)) == (HCR_E2H | HCR_TGE) ? 2 : 1;
+
+    return extract64(value, 48, env->cp15.tcr_el[el] & TCR_AS ? 16 : 8);
+}
+
+static void tlbi_aa64_aside1is_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                     uint64_t value)
+{
+    CPUState *cs = env_cpu(env);
+    int mask = vae1_tlbmask(env);
+
+    tlb_flush_asid_by_mmuidx_all_cpus_synced(cs, mask,
+                                             vae1_tlbasid(env, value));
+}
+
+static void tlbi_aa64_aside1_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                   uint64_t value)
+{
+    CPUState *cs = env_cpu(env);
+    int mask = vae1_tlbmask(env);
+    uint32_t asid = vae1_tlbasid(env, value);
+
+    if (tlb_force_broadcast(env)) {
+        tlb_flush_asid_by_mmuidx_all_cpus_synced(cs, mask, asid);
+    } else {
+        tlb_flush_asid_by_mmuidx(cs, mask, asid);
+    }
+}
+
 static int e2_tlbmask(CPUARMState *env)
 {
     return (ARMMMUIdxBit_E20_0 |
@@ -631,7 +664,7 @@ static const ARMCPRegInfo tlbi_v8_cp_reginfo[] = {
       .access = PL1_W, .accessfn = access_ttlbis,
       .type = ARM_CP_NO_RAW | ARM_CP_ADD_TLBI_NXS,
       .fgt = FGT_TLBIASIDE1IS,
-      .writefn = tlbi_aa64_vmalle1is_write },
+      .writefn = tlbi_aa64_aside1is_write },
     { .name = "TLBI_VAAE1IS", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 3, .opc2 = 3,
       .access = PL1_W, .accessfn = access_ttlbis,
@@ -667,7 +700,7 @@ static const ARMCPRegInfo tlbi_v8_cp_reginfo[] = {
       .access = PL1_W, .accessfn = access_ttlb,
       .type = ARM_CP_NO_RAW | ARM_CP_ADD_TLBI_NXS,
       .fgt = FGT_TLBIASIDE1,
-      .writefn = tlbi_aa64_vmalle1_write },
+      .writefn = tlbi_aa64_aside1_write },
     { .name = "TLBI_VAAE1", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 7, .opc2 = 3,
       .access = PL1_W, .accessfn = access_ttlb,
@@ -1157,7 +1190,7 @@ static const ARMCPRegInfo tlbios_reginfo[] = {
       .access = PL1_W, .accessfn = access_ttlbos,
       .type = ARM_CP_NO_RAW | ARM_CP_ADD_TLBI_NXS,
       .fgt = FGT_TLBIASIDE1OS,
-      .writefn = tlbi_aa64_vmalle1is_write },
+      .writefn = tlbi_aa64_aside1is_write },
     { .name = "TLBI_VAAE1OS", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 3,
       .access = PL1_W, .accessfn = access_ttlbos,
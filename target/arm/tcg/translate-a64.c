@@ -1628,7 +1628,16 @@ static inline void gen_check_sp_alignment(DisasContext *s)
 
 static bool trans_B(DisasContext *s, arg_i *a)
 {
+    uint64_t dest = s->pc_curr + a->imm;
+
     reset_btype(s);
+    if (translator_follow_jump(&s->base, dest)) {
+        /* Bound the insns still to translate to those left on the page. */
+        s->base.pc_next = dest;
+        s->base.max_insns = MIN(s->base.max_insns, s->base.num_insns +
+                                -(dest | TARGET_PAGE_MASK) / 4);
+        return true;
+    }
     gen_goto_tb(s, 0, a->imm);
     return true;
 }
@@ -1416,17 +1416,27 @@ void HELPER(NAME)(void *vd, void *vn, void *vm,                            \
     clear_tail(d, oprsz, simd_maxsz(desc));                                \
 }
 
+/* As DO_3OP, for the operations that softfloat can batch. */
+#define DO_3OP_VEC(NAME, FUNC, TYPE) \
+void HELPER(NAME)(void *vd, void *vn, void *vm,                            \
+                  float_status *stat, uint32_t desc)                       \
+{                                                                          \
+    intptr_t oprsz = simd_oprsz(desc);                                     \
+    FUNC(vd, vn, vm, oprsz / sizeof(TYPE), stat);                          \
+    clear_tail(vd, oprsz, simd_maxsz(desc));                               \
+}
+
 DO_3OP(gvec_fadd_h, float16_add, float16)
-DO_3OP(gvec_fadd_s, float32_add, float32)
-DO_3OP(gvec_fadd_d, float64_add, float64)
+DO_3OP_VEC(gvec_fadd_s, float32_add_vec, float32)
+DO_3OP_VEC(gvec_fadd_d, float64_add_vec, float64)
 
 DO_3OP(gvec_fsub_h, float16_sub, float16)
-DO_3OP(gvec_fsub_s, float32_sub, float32)
-DO_3OP(gvec_fsub_d, float64_sub, float64)
+DO_3OP_VEC(gvec_fsub_s, float32_sub_vec, float32)
+DO_3OP_VEC(gvec_fsub_d, float64_sub_vec, float64)
 
 DO_3OP(gvec_fmul_h, float16_mul, float16)
-DO_3OP(gvec_fmul_s, float32_mul, float32)
-DO_3OP(gvec_fmul_d, float64_mul, float64)
+DO_3OP_VEC(gvec_fmul_s, float32_mul_vec, float32)
+DO_3OP_VEC(gvec_fmul_d, float64_mul_vec, float64)
 
 DO_3OP(gvec_ftsmul_h, float16_ftsmul, float16)
 DO_3OP(gvec_ftsmul_s, float32_ftsmul, float32)
@@ -1517,6 +1527,7 @@ DO_3OP(gvec_ah_fmin_d, helper_vfp_ah_mind, float64)
 
 #endif
 #undef DO_3OP
+#undef DO_3OP_VEC
 
 /* Non-fused multiply-add (unlike float16_muladd etc, which are fused) */
 static float16 float16_muladd_nf(float16 dest, float16 op1, float16 op2,
@@ -4288,10 +4288,35 @@ static RISCVException read_satp(CPURISCVState *env, int csrno,
 static RISCVException write_satp(CPURISCVState *env, int csrno,
                                  target_ulong val, uintptr_t ra)
 {
+    target_ulong mode_mask, asid_mask;
+
     if (!riscv_cpu_cfg(env)->mmu) {
         return RISCV_EXCP_NONE;
     }
 
+    if (riscv_cpu_mxl(env) == MXL_RV32) {
+        mode_mask = SATP32_MODE;
+        asid_mask = SATP32_ASID;
+    } else {
+        mode_mask = SATP64_MODE;
+        asid_mask = SATP64_ASID;
+    }
+
+    /*
+     * Without the H extension, satp is the only source of translations
+     * for the U and S mmu indexes, and the TLB tags them with satp.ASID.
+     * A write that switches the ASID then keeps the entries of the old
+     * one, which stay valid until an SFENCE.VMA for it.
+     */
+    if (!riscv_has_ext(env, RVH) &&
+        !((env->satp ^ val) & mode_mask) &&
+        ((env->satp ^ val) & asid_mask)) {
+        env->satp = val;
+        tlb_set_asid_by_mmuidx(env_cpu(env), MMUIdxBits_SATP,
+                               get_field(val, asid_mask));
+        return RISCV_EXCP_NONE;
+    }
+
     env->satp = legalize_xatp(env, env->satp, val);
     return RISCV_EXCP_NONE;
 }
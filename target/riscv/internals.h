@@ -43,6 +43,16 @@
 #define MMU_2STAGE_BIT      (1 << 2)
 #define MMU_IDX_SS_WRITE    (1 << 3)
 
+/*
+ * The MMU modes translated through satp while V=0, whose TLB entries
+ * are tagged with satp.ASID on harts without the H extension.
+ */
+#define MMUIdxBits_SATP \
+    ((1 << MMUIdx_U) | (1 << MMUIdx_S) | (1 << MMUIdx_S_SUM) | \
+     (1 << (MMUIdx_U | MMU_IDX_SS_WRITE)) | \
+     (1 << (MMUIdx_S | MMU_IDX_SS_WRITE)) | \
+     (1 << (MMUIdx_S_SUM | MMU_IDX_SS_WRITE)))
+
 static inline int mmuidx_priv(int mmu_idx)
 {
     int ret = mmu_idx & 3;
@@ -552,19 +552,44 @@ void helper_wrs_nto(CPURISCVState *env)
     }
 }
 
-void helper_tlb_flush(CPURISCVState *env)
+static void check_sfence_vma(CPURISCVState *env, uintptr_t ra)
 {
-    CPUState *cs = env_cpu(env);
     if (!env->virt_enabled &&
         (env->priv == PRV_U ||
          (env->priv == PRV_S && get_field(env->mstatus, MSTATUS_TVM)))) {
-        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
+        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, ra);
     } else if (env->virt_enabled &&
                (env->priv == PRV_U || get_field(env->hstatus, HSTATUS_VTVM))) {
-        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, GETPC());
-    } else {
+        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, ra);
+    }
+}
+
+void helper_tlb_flush(CPURISCVState *env)
+{
+    check_sfence_vma(env, GETPC());
+    tlb_flush(env_cpu(env));
+}
+
+/* SFENCE.VMA with rs2 != x0, which leaves global mappings alone. */
+void helper_tlb_flush_asid(CPURISCVState *env, target_ulong asid)
+{
+    CPUState *cs = env_cpu(env);
+
+    check_sfence_vma(env, GETPC());
+
+    if (riscv_has_ext(env, RVH)) {
+        /* Only the TLB of harts without the H extension is tagged.  */
         tlb_flush(cs);
+        return;
+    }
+
+    /* The bits of rs2 above those of satp.ASID are ignored.  */
+    if (riscv_cpu_mxl(env) == MXL_RV32) {
+        asid = extract64(asid, 0, ctpop64(SATP32_ASID));
+    } else {
+        asid = extract64(asid, 0, ctpop64(SATP64_ASID));
     }
+    tlb_flush_asid_by_mmuidx(cs, MMUIdxBits_SATP, asid);
 }
 
 void helper_tlb_flush_all(CPURISCVState *env)
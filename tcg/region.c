@@ -24,6 +24,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/bitops.h"
 #include "qemu/madvise.h"
 #include "qemu/mprotect.h"
 #include "qemu/memalign.h"
@@ -72,6 +73,12 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    uint64_t gen; /* number of region allocations so far */
+    uint64_t *age; /* value of .gen when each region was last allocated */
+    unsigned long *evicted; /* regions emptied by tcg_region_evict_cold */
+
+    /* only accessed from a safe-work context */
+    size_t *hot; /* TBs per region marked by tcg_region_mark_hot */
 };
 
 static struct tcg_region_state region;
@@ -191,10 +198,8 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+static bool tc_ptr_to_region_idx(const void *p, size_t *pidx)
 {
-    size_t region_idx;
-
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -202,21 +207,31 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
     if (!in_code_gen_buffer(p)) {
         p -= tcg_splitwx_diff;
         if (!in_code_gen_buffer(p)) {
-            return NULL;
+            return false;
         }
     }
 
     if (p < region.start_aligned) {
-        region_idx = 0;
+        *pidx = 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
+            *pidx = region.n - 1;
         } else {
-            region_idx = offset / region.stride;
+            *pidx = offset / region.stride;
         }
     }
+    return true;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    size_t region_idx;
+
+    if (!tc_ptr_to_region_idx(p, &region_idx)) {
+        return NULL;
+    }
     return region_trees + region_idx * tree_size;
 }
 
@@ -359,11 +374,20 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t i;
+
+    if (region.current < region.n) {
+        i = region.current++;
+    } else {
+        /* Once every region has been used, reuse the evicted ones. */
+        i = find_first_bit(region.evicted, region.n);
+        if (i == region.n) {
+            return true;
+        }
+        clear_bit(i, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.age[i] = ++region.gen;
     return false;
 }
 
@@ -412,6 +436,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,11 +447,112 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/* Call from a safe-work context */
+void tcg_region_mark_hot(const void *tc_ptr)
+{
+    size_t i;
+
+    if (tc_ptr_to_region_idx(tc_ptr, &i)) {
+        region.hot[i]++;
+    }
+}
+
+/* Order regions from the coldest to the hottest, then oldest to newest. */
+static int tcg_region_cmp_cold(const void *ap, const void *bp)
+{
+    size_t a = *(const size_t *)ap;
+    size_t b = *(const size_t *)bp;
+
+    if (region.hot[a] != region.hot[b]) {
+        return region.hot[a] < region.hot[b] ? -1 : 1;
+    }
+    if (region.age[a] != region.age[b]) {
+        return region.age[a] < region.age[b] ? -1 : 1;
+    }
+    return 0;
+}
+
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/* Call from a safe-work context */
+bool tcg_region_evict_cold(void (*evict)(TranslationBlock *tb))
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autofree size_t *cand = g_new(size_t, region.n);
+    g_autofree unsigned long *busy = bitmap_new(region.n);
+    g_autoptr(GPtrArray) tbs = g_ptr_array_new();
+    size_t n_cand = 0;
+    size_t n_evict;
+    size_t i, j;
+
+    qemu_mutex_lock(&region.lock);
+
+    /* Regions that contexts are still generating code into stay put. */
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        if (tc_ptr_to_region_idx(s->code_gen_buffer, &j)) {
+            set_bit(j, busy);
+        }
+    }
+    for (i = 0; i < region.current; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        if (!test_bit(i, busy) && !test_bit(i, region.evicted) &&
+            q_tree_nnodes(rt->tree) != 0) {
+            cand[n_cand++] = i;
+        }
+    }
+
+    /* Evict the colder half of the full regions. */
+    qsort(cand, n_cand, sizeof(*cand), tcg_region_cmp_cold);
+    n_evict = DIV_ROUND_UP(n_cand, 2);
+    memset(region.hot, 0, region.n * sizeof(*region.hot));
+    qemu_mutex_unlock(&region.lock);
+
+    for (i = 0; i < n_evict; i++) {
+        struct tcg_region_tree *rt = region_trees + cand[i] * tree_size;
+
+        /*
+         * Unlinking takes the page locks, which nest outside the tree
+         * locks: gather the TBs first and evict them without the lock.
+         */
+        g_ptr_array_set_size(tbs, 0);
+        qemu_mutex_lock(&rt->lock);
+        q_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+        qemu_mutex_unlock(&rt->lock);
+
+        for (j = 0; j < tbs->len; j++) {
+            evict(g_ptr_array_index(tbs, j));
+        }
+
+        qemu_mutex_lock(&rt->lock);
+        /* Increment the refcount first so that destroy acts as a reset */
+        q_tree_ref(rt->tree);
+        q_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+    }
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < n_evict; i++) {
+        void *start, *end;
+
+        tcg_region_bounds(cand[i], &start, &end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        set_bit(cand[i], region.evicted);
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    return n_evict != 0;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
 {
-#ifdef CONFIG_USER_ONLY
-    return 1;
-#else
     size_t n_regions;
 
     /*
@@ -435,22 +561,23 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      *
-     * Use a single region if all we have is one vCPU thread.
+     * A single TCG thread (including user-mode) only ever needs one region
+     * at a time, but splitting the buffer still lets tcg_region_evict_cold()
+     * reclaim part of it when it fills up, instead of flushing everything.
      */
+    n_regions = tb_size / (2 * MiB);
     if (max_threads == 1) {
-        return 1;
+        return MAX(1, MIN(n_regions, 8));
     }
 
     /*
      * Try to have more regions than threads, with each region being >= 2 MB.
      * If we can't, then just allocate one region per vCPU thread.
      */
-    n_regions = tb_size / (2 * MiB);
     if (n_regions <= max_threads) {
         return max_threads;
     }
     return MIN(n_regions, max_threads * 8);
-#endif
 }
 
 /*
@@ -734,7 +861,8 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  *
  * In system-mode the number of TCG threads is bounded by max_threads,
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
+ * In user-mode all threads share a single TCG context, which allocates its
+ * regions one after the other.  Having a region per thread in user-mode
  * is not supported, because the number of vCPU threads (recall that each thread
  * spawned by the guest corresponds to a vCPU thread) is only bounded by the
  * OS, and usually this number is huge (tens of thousands is not uncommon).
@@ -847,6 +975,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
         }
     }
 
+    region.age = g_new0(uint64_t, region.n);
+    region.hot = g_new0(size_t, region.n);
+    region.evicted = bitmap_new(region.n);
     tcg_region_trees_init();
 
     /*
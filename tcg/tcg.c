@@ -1836,7 +1836,7 @@ static void tcg_context_init(unsigned max_threads)
     tcg_ctx = s;
     /*
      * In user-mode we simply share the init context among threads, since we
-     * use a single region. See the documentation tcg_region_init() for the
+     * use a single region at a time. See the documentation tcg_region_init() for the
      * reasoning behind this.
      * In system-mode we will have at most max_threads TCG threads.
      */
@@ -6877,6 +6877,18 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     tcg_optimize(s);
 
     reachable_code_pass(s);
+
+    /*
+     * Hot blocks, and the jumps they follow, are worth a second round:
+     * the optimizer forgets what it knows about temps at each label, so
+     * the labels that reachable_code_pass() just removed let it fold
+     * more across the longer extended basic blocks.
+     */
+    if (s->gen_trace) {
+        tcg_optimize(s);
+        reachable_code_pass(s);
+    }
+
     liveness_pass_0(s);
     liveness_pass_1(s);
 
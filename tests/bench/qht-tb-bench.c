@@ -0,0 +1,238 @@
+/*
+ * qht-tb-bench.c - concurrent qht lookups shaped like MTTCG TB lookups
+ *
+ * Each thread stands for a vCPU whose tb_jmp_cache missed, and looks up
+ * translation blocks by (pc, phys_pc, cs_base, flags, cflags), hashing
+ * and comparing them the way tb_htable_lookup does.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/processor.h"
+#include "qemu/atomic.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
+#include "qemu/xxhash.h"
+#include "qemu/memalign.h"
+
+struct fake_tb {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t phys_pc;
+    uint32_t flags;
+    uint32_t cflags;
+};
+
+struct thread_info {
+    uint64_t seed;
+    size_t hits;
+    size_t misses;
+} QEMU_ALIGNED(64); /* avoid false sharing among threads */
+
+static struct qht ht;
+static struct fake_tb *tbs;
+static QemuThread *threads;
+static struct thread_info *infos;
+
+static unsigned int duration = 1;
+static unsigned int n_threads = 1;
+static size_t n_tbs = 1 << 16;
+static double miss_rate; /* 0.0 to 1.0 */
+static uint64_t miss_threshold;
+static int qht_mode;
+
+static size_t n_ready_threads;
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -d = duration, in seconds\n"
+    " -n = number of threads (i.e. vCPUs)\n"
+    " -k = number of translation blocks (will be rounded up to pow2)\n"
+    " -m = rate of lookups for blocks not in the table (0.0 to 100.0)\n"
+    " -R = enable auto-resize, starting from a small table";
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+    exit(-1);
+}
+
+static uint32_t tb_hash(const struct fake_tb *tb)
+{
+    return qemu_xxhash8(tb->phys_pc, tb->pc, tb->cs_base, tb->flags,
+                        tb->cflags);
+}
+
+static bool tb_cmp(const void *ap, const void *bp)
+{
+    const struct fake_tb *a = ap;
+    const struct fake_tb *b = bp;
+
+    return a->pc == b->pc &&
+           a->phys_pc == b->phys_pc &&
+           a->cs_base == b->cs_base &&
+           a->flags == b->flags &&
+           a->cflags == b->cflags;
+}
+
+/* From: https://en.wikipedia.org/wiki/Xorshift */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static void *thread_func(void *p)
+{
+    struct thread_info *info = p;
+    struct fake_tb key;
+
+    rcu_register_thread();
+
+    qatomic_inc(&n_ready_threads);
+    while (!qatomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    rcu_read_lock();
+    while (!qatomic_read(&test_stop)) {
+        uint64_t r = info->seed = xorshift64star(info->seed);
+
+        key = tbs[r & (n_tbs - 1)];
+        if (r < miss_threshold) {
+            /* same block, different cpu state: a miss with a full probe */
+            key.flags ^= 1;
+        }
+        if (qht_lookup_custom(&ht, &key, tb_hash(&key), tb_cmp)) {
+            info->hits++;
+        } else {
+            info->misses++;
+        }
+    }
+    rcu_read_unlock();
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void htable_init(void)
+{
+    size_t i;
+
+    tbs = g_new(struct fake_tb, n_tbs);
+    for (i = 0; i < n_tbs; i++) {
+        /* blocks of ~16 bytes, in pages shared by all vCPUs */
+        tbs[i].pc = 0x400000 + i * 16;
+        tbs[i].phys_pc = 0x80000000 + i * 16;
+        tbs[i].cs_base = 0;
+        tbs[i].flags = i & 0xf0;
+        tbs[i].cflags = 0;
+    }
+
+    qht_init(&ht, tb_cmp, qht_mode & QHT_MODE_AUTO_RESIZE ? 16 : n_tbs,
+             qht_mode);
+    for (i = 0; i < n_tbs; i++) {
+        qht_insert(&ht, &tbs[i], tb_hash(&tbs[i]), NULL);
+    }
+}
+
+static void run_test(void)
+{
+    unsigned int i;
+
+    threads = g_new(QemuThread, n_threads);
+    infos = qemu_memalign(64, sizeof(*infos) * n_threads);
+    for (i = 0; i < n_threads; i++) {
+        infos[i] = (struct thread_info) { .seed = (i + 1) ^ time(NULL) };
+        qemu_thread_create(&threads[i], "vcpu", thread_func, &infos[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    while (qatomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+    qatomic_set(&test_start, true);
+    g_usleep(duration * G_USEC_PER_SEC);
+    qatomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void pr_stats(void)
+{
+    struct qht_stats stats;
+    size_t hits = 0, misses = 0;
+    unsigned int i;
+    double tx;
+
+    for (i = 0; i < n_threads; i++) {
+        hits += infos[i].hits;
+        misses += infos[i].misses;
+    }
+    qht_statistics_init(&ht, &stats);
+
+    printf("Parameters:\n");
+    printf(" duration:          %u s\n", duration);
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" # of blocks:       %zu\n", n_tbs);
+    printf(" miss rate:         %f%%\n", miss_rate * 100.0);
+    printf(" head buckets:      %zu\n", stats.head_buckets);
+    printf(" avg chain length:  %.2f\n", qdist_avg(&stats.chain));
+    printf("Results:\n");
+    printf(" Hits:              %.2f M\n", hits / 1e6);
+    printf(" Misses:            %.2f M\n", misses / 1e6);
+    tx = (hits + misses) / 1e6 / duration;
+    printf(" Throughput:        %.2f MT/s\n", tx);
+    printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_threads);
+
+    qht_statistics_destroy(&stats);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:hk:m:n:R");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(0);
+        case 'k':
+            n_tbs = pow2ceil(atol(optarg));
+            break;
+        case 'm':
+            miss_rate = MIN(atof(optarg) / 100.0, 1.0);
+            break;
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'R':
+            qht_mode |= QHT_MODE_AUTO_RESIZE;
+            break;
+        }
+    }
+    miss_threshold = miss_rate == 1.0 ? UINT64_MAX : miss_rate * 0x1p64;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    htable_init();
+    run_test();
+    pr_stats();
+    return 0;
+}
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * thread-pool-bench.c - offload throughput of the AioContext thread pool
+ *
+ * Each thread stands for an iothread: it runs its own AioContext and keeps
+ * a fixed number of requests in flight in its thread pool, the way the
+ * block layer offloads preadv/pwritev/fallocate with thread_pool_submit_co.
+ */
+#include "qemu/osdep.h"
+#include "qemu/processor.h"
+#include "qemu/atomic.h"
+#include "qemu/memalign.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "block/aio.h"
+#include "block/thread-pool.h"
+
+struct thread_info {
+    AioContext *ctx;
+    size_t in_flight;
+    size_t completed;
+} QEMU_ALIGNED(64); /* avoid false sharing among threads */
+
+static QemuThread *threads;
+static struct thread_info *infos;
+
+static unsigned int duration = 1;
+static unsigned int n_threads = 1;
+static unsigned int depth = 32;
+static int64_t work_ns;
+static int max_workers = THREAD_POOL_MAX_THREADS_DEFAULT;
+
+static size_t n_ready_threads;
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -d = duration, in seconds\n"
+    " -n = number of submitting threads (i.e. iothreads)\n"
+    " -q = requests in flight per submitting thread\n"
+    " -w = busy work per request, in ns\n"
+    " -m = maximum number of pool workers per submitting thread";
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+    exit(-1);
+}
+
+static int work_func(void *opaque)
+{
+    int64_t end;
+
+    if (work_ns) {
+        end = get_clock() + work_ns;
+        while (get_clock() < end) {
+            cpu_relax();
+        }
+    }
+    return 0;
+}
+
+static void done_cb(void *opaque, int ret)
+{
+    struct thread_info *info = opaque;
+
+    info->in_flight--;
+    info->completed++;
+    if (!qatomic_read(&test_stop)) {
+        thread_pool_submit_aio(work_func, NULL, done_cb, info);
+        info->in_flight++;
+    }
+}
+
+static void *thread_func(void *p)
+{
+    struct thread_info *info = p;
+    unsigned int i;
+
+    qemu_set_current_aio_context(info->ctx);
+
+    qatomic_inc(&n_ready_threads);
+    while (!qatomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    for (i = 0; i < depth; i++) {
+        thread_pool_submit_aio(work_func, NULL, done_cb, info);
+        info->in_flight++;
+    }
+    while (info->in_flight) {
+        aio_poll(info->ctx, true);
+    }
+    return NULL;
+}
+
+static void run_test(void)
+{
+    unsigned int i;
+
+    threads = g_new(QemuThread, n_threads);
+    infos = qemu_memalign(64, sizeof(*infos) * n_threads);
+    for (i = 0; i < n_threads; i++) {
+        infos[i] = (struct thread_info) {
+            .ctx = aio_context_new(&error_abort),
+        };
+        aio_context_set_thread_pool_params(infos[i].ctx, 0, max_workers,
+                                           &error_abort);
+        qemu_thread_create(&threads[i], "iothread", thread_func, &infos[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    while (qatomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+    qatomic_set(&test_start, true);
+    g_usleep(duration * G_USEC_PER_SEC);
+    qatomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void pr_stats(void)
+{
+    size_t completed = 0;
+    unsigned int i;
+    double tx;
+
+    for (i = 0; i < n_threads; i++) {
+        completed += infos[i].completed;
+    }
+
+    printf("Parameters:\n");
+    printf(" duration:          %u s\n", duration);
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" queue depth:       %u\n", depth);
+    printf(" work per request:  %" PRId64 " ns\n", work_ns);
+    printf(" max workers:       %d\n", max_workers);
+    printf("Results:\n");
+    printf(" Requests:          %.2f M\n", completed / 1e6);
+    tx = completed / 1e6 / duration;
+    printf(" Throughput:        %.2f MReq/s\n", tx);
+    printf(" Throughput/thread: %.2f MReq/s/thread\n", tx / n_threads);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:hm:n:q:w:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(0);
+        case 'm':
+            max_workers = MAX(atoi(optarg), 1);
+            break;
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'q':
+            depth = MAX(atoi(optarg), 1);
+            break;
+        case 'w':
+            work_ns = atoll(optarg);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    run_test();
+    pr_stats();
+    return 0;
+}
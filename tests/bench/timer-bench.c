@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * timer-bench.c - re-arm throughput of QEMUTimerList
+ *
+ * Many periodic timers run against the realtime clock, like devices that
+ * coalesce interrupts or poll their backends, and a few random timers are
+ * reprogrammed before they expire on each iteration of the loop.  The same
+ * workload runs on the timer API and on a sorted linked list, which is how
+ * QEMUTimerList kept its timers before it got a timing wheel.
+ */
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "qemu/thread.h"
+
+typedef struct ListTimer ListTimer;
+
+struct ListTimer {
+    int64_t expire_time;
+    ListTimer *next;
+};
+
+typedef struct BenchTimer {
+    QEMUTimer timer;
+    ListTimer list_timer;
+    int64_t period;
+} BenchTimer;
+
+static unsigned int duration = 1;
+static unsigned int n_timers = 4096;
+static unsigned int n_churn = 16;
+static int64_t window = 10 * SCALE_MS;
+
+static BenchTimer *timers;
+static QEMUTimerList *timer_list;
+static uint64_t n_rearms;
+
+static QemuMutex list_lock;
+static ListTimer *list_head;
+
+static const char commands_string[] =
+    " -d = duration, in seconds\n"
+    " -n = number of timers\n"
+    " -c = timers reprogrammed per loop iteration\n"
+    " -w = maximum timer period, in us (at most 1 s)";
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+    exit(-1);
+}
+
+/* Reference implementation: the sorted list */
+
+static void list_del_locked(ListTimer *ts)
+{
+    ListTimer **pt;
+
+    for (pt = &list_head; *pt; pt = &(*pt)->next) {
+        if (*pt == ts) {
+            *pt = ts->next;
+            break;
+        }
+    }
+    ts->expire_time = -1;
+}
+
+static void list_mod(ListTimer *ts, int64_t expire_time)
+{
+    ListTimer **pt;
+
+    qemu_mutex_lock(&list_lock);
+    list_del_locked(ts);
+    for (pt = &list_head; *pt; pt = &(*pt)->next) {
+        if ((*pt)->expire_time > expire_time) {
+            break;
+        }
+    }
+    ts->expire_time = expire_time;
+    ts->next = *pt;
+    *pt = ts;
+    qemu_mutex_unlock(&list_lock);
+}
+
+static void list_run(void)
+{
+    int64_t now = get_clock();
+    ListTimer *ts;
+
+    qemu_mutex_lock(&list_lock);
+    while ((ts = list_head) && ts->expire_time <= now) {
+        list_head = ts->next;
+        ts->expire_time = -1;
+        qemu_mutex_unlock(&list_lock);
+
+        /* The callback re-arms the timer */
+        list_mod(ts, get_clock() +
+                 container_of(ts, BenchTimer, list_timer)->period);
+        n_rearms++;
+
+        qemu_mutex_lock(&list_lock);
+    }
+    qemu_mutex_unlock(&list_lock);
+}
+
+static int64_t list_deadline(void)
+{
+    int64_t expire_time;
+
+    qemu_mutex_lock(&list_lock);
+    expire_time = list_head ? list_head->expire_time : -1;
+    qemu_mutex_unlock(&list_lock);
+    return expire_time;
+}
+
+/* QEMUTimerList */
+
+static void timer_cb(void *opaque)
+{
+    BenchTimer *bt = opaque;
+
+    timer_mod_ns(&bt->timer, get_clock() + bt->period);
+    n_rearms++;
+}
+
+static void notify_cb(void *opaque, QEMUClockType type)
+{
+}
+
+static void run_test(bool use_list)
+{
+    int64_t end;
+    unsigned int i;
+
+    n_rearms = 0;
+    for (i = 0; i < n_timers; i++) {
+        if (use_list) {
+            list_mod(&timers[i].list_timer, get_clock() + timers[i].period);
+        } else {
+            timer_mod_ns(&timers[i].timer, get_clock() + timers[i].period);
+        }
+    }
+
+    end = get_clock() + duration * NANOSECONDS_PER_SECOND;
+    while (get_clock() < end) {
+        for (i = 0; i < n_churn; i++) {
+            BenchTimer *bt = &timers[g_random_int_range(0, n_timers)];
+            int64_t expire_time = get_clock() +
+                                  g_random_int_range(1, bt->period + 1);
+
+            if (use_list) {
+                list_mod(&bt->list_timer, expire_time);
+            } else {
+                timer_mod_ns(&bt->timer, expire_time);
+            }
+            n_rearms++;
+        }
+
+        /* Like a main loop iteration */
+        if (use_list) {
+            list_run();
+            list_deadline();
+        } else {
+            timerlist_run_timers(timer_list);
+            timerlist_deadline_ns(timer_list);
+        }
+    }
+
+    for (i = 0; i < n_timers; i++) {
+        if (use_list) {
+            qemu_mutex_lock(&list_lock);
+            list_del_locked(&timers[i].list_timer);
+            qemu_mutex_unlock(&list_lock);
+        } else {
+            timer_del(&timers[i].timer);
+        }
+    }
+}
+
+static void pr_result(const char *name)
+{
+    printf(" %-6s %8.2f M re-arms/s\n", name, n_rearms / 1e6 / duration);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "c:d:hn:w:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'c':
+            n_churn = atoi(optarg);
+            break;
+        case 'd':
+            duration = MAX(atoi(optarg), 1);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(0);
+        case 'n':
+            n_timers = MAX(atoi(optarg), 1);
+            break;
+        case 'w':
+            window = MIN(MAX(atoll(optarg), 1), SCALE_MS) * SCALE_US;
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int i;
+
+    parse_args(argc, argv);
+
+    qemu_mutex_init(&list_lock);
+    init_clocks(notify_cb);
+    timer_list = timerlist_new(QEMU_CLOCK_REALTIME, notify_cb, NULL);
+    timers = g_new0(BenchTimer, n_timers);
+    for (i = 0; i < n_timers; i++) {
+        timers[i].period = g_random_int_range(window / 2, window + 1);
+        timers[i].list_timer.expire_time = -1;
+        timer_init_tl(&timers[i].timer, timer_list, SCALE_NS,
+                      timer_cb, &timers[i]);
+    }
+
+    printf("Parameters:\n");
+    printf(" duration:          %u s\n", duration);
+    printf(" # of timers:       %u\n", n_timers);
+    printf(" churn per loop:    %u\n", n_churn);
+    printf(" max period:        %" PRId64 " us\n", window / SCALE_US);
+    printf("Results:\n");
+
+    run_test(true);
+    pr_result("list");
+    run_test(false);
+    pr_result("wheel");
+
+    g_free(timers);
+    timerlist_free(timer_list);
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * fp-test-inexact.c - test the inexact flag of hardfloat with flags clear
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * With the inexact flag clear, float32/float64 add and sub, and float32
+ * mul and div, run on the host FPU and compute inexact themselves from
+ * the rounding error.  Check the results and the flag against float128,
+ * which holds these results with enough precision that rounding them
+ * again to float32 or float64 gives the correctly rounded result.
+ * Hosts without hardfloat simply check softfloat against itself.
+ */
+#ifndef HW_POISON_H
+#error Must define HW_POISON_H to work around TARGET_* poisoning
+#endif
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "fpu/softfloat.h"
+
+typedef enum { OP_ADD, OP_SUB, OP_MUL, OP_DIV } Op;
+
+static const char * const op_names[] = { "add", "sub", "mul", "div" };
+
+static int errors;
+static unsigned exact[2][4], inexact[2][4];
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng(void)
+{
+    /* xorshift64*, for reproducible operands */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static float128 ref_op(Op op, float128 a, float128 b, float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float128_add(a, b, s);
+    case OP_SUB:
+        return float128_sub(a, b, s);
+    case OP_MUL:
+        return float128_mul(a, b, s);
+    case OP_DIV:
+        return float128_div(a, b, s);
+    }
+    g_assert_not_reached();
+}
+
+static void check(int size, Op op, uint64_t a, uint64_t b, uint64_t r,
+                  uint64_t ref, bool r_inexact, bool ref_inexact)
+{
+    if (r == ref && r_inexact == ref_inexact) {
+        exact[size == 64][op] += !r_inexact;
+        inexact[size == 64][op] += r_inexact;
+        return;
+    }
+    printf("f%d_%s %016" PRIx64 " %016" PRIx64 ": %016" PRIx64
+           " inexact=%d, expected %016" PRIx64 " inexact=%d\n",
+           size, op_names[op], a, b, r, r_inexact, ref, ref_inexact);
+    if (++errors == 20) {
+        exit(1);
+    }
+}
+
+/*
+ * A random normal number with a biased exponent in [@emin, @emin + 63].
+ * Every other number has few significant bits, so that a good share of
+ * the results are exact.
+ */
+static uint64_t rand_normal(int frac_bits, int emin, bool short_frac)
+{
+    uint64_t r = rng();
+    uint64_t frac = r & MAKE_64BIT_MASK(0, frac_bits);
+    uint64_t exp = emin + (r >> 58);
+    uint64_t sign = (r >> 57) & 1;
+
+    if (short_frac) {
+        frac &= MAKE_64BIT_MASK(frac_bits - 8, 8);
+    }
+    return (sign << (frac_bits + (frac_bits == 23 ? 8 : 11))) |
+           (exp << frac_bits) | frac;
+}
+
+static void test_f32(Op op, float_status *qsf, float_status *ref_sf)
+{
+    bool short_frac = rng() & 1;
+    float32 a = make_float32(rand_normal(23, 96, short_frac));
+    float32 b = make_float32(rand_normal(23, 96, short_frac));
+    float128 ref128;
+    float32 r, ref;
+    bool ref_inexact;
+
+    set_float_exception_flags(0, qsf);
+    switch (op) {
+    case OP_ADD:
+        r = float32_add(a, b, qsf);
+        break;
+    case OP_SUB:
+        r = float32_sub(a, b, qsf);
+        break;
+    case OP_MUL:
+        r = float32_mul(a, b, qsf);
+        break;
+    case OP_DIV:
+        r = float32_div(a, b, qsf);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    set_float_exception_flags(0, ref_sf);
+    ref128 = ref_op(op, float32_to_float128(a, ref_sf),
+                    float32_to_float128(b, ref_sf), ref_sf);
+    ref = float128_to_float32(ref128, ref_sf);
+    ref_inexact = get_float_exception_flags(ref_sf) & float_flag_inexact;
+
+    check(32, op, float32_val(a), float32_val(b), float32_val(r),
+          float32_val(ref),
+          get_float_exception_flags(qsf) & float_flag_inexact, ref_inexact);
+}
+
+static void test_f64(Op op, float_status *qsf, float_status *ref_sf)
+{
+    bool short_frac = rng() & 1;
+    float64 a = make_float64(rand_normal(52, 992, short_frac));
+    float64 b = make_float64(rand_normal(52, 992, short_frac));
+    float128 ref128;
+    float64 r, ref;
+    bool ref_inexact;
+
+    set_float_exception_flags(0, qsf);
+    r = op == OP_ADD ? float64_add(a, b, qsf) : float64_sub(a, b, qsf);
+
+    set_float_exception_flags(0, ref_sf);
+    ref128 = ref_op(op, float64_to_float128(a, ref_sf),
+                    float64_to_float128(b, ref_sf), ref_sf);
+    ref = float128_to_float64(ref128, ref_sf);
+    ref_inexact = get_float_exception_flags(ref_sf) & float_flag_inexact;
+
+    check(64, op, float64_val(a), float64_val(b), float64_val(r),
+          float64_val(ref),
+          get_float_exception_flags(qsf) & float_flag_inexact, ref_inexact);
+}
+
+int main(int ac, char **av)
+{
+    float_status qsf = {0}, ref_sf = {0};
+    Op op;
+    int i;
+
+    set_float_2nan_prop_rule(float_2nan_prop_s_ab, &qsf);
+    set_float_default_nan_pattern(0b01000000, &qsf);
+    set_float_rounding_mode(float_round_nearest_even, &qsf);
+    ref_sf = qsf;
+
+    for (i = 0; i < 200000; i++) {
+        for (op = OP_ADD; op <= OP_DIV; op++) {
+            test_f32(op, &qsf, &ref_sf);
+        }
+        test_f64(OP_ADD, &qsf, &ref_sf);
+        test_f64(OP_SUB, &qsf, &ref_sf);
+    }
+
+    /* Both outcomes of the inexact computation must have been checked. */
+    for (op = OP_ADD; op <= OP_DIV; op++) {
+        if (!exact[0][op] || !inexact[0][op] ||
+            (op <= OP_SUB && (!exact[1][op] || !inexact[1][op]))) {
+            printf("%s: too few exact or inexact results\n", op_names[op]);
+            errors++;
+        }
+    }
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * fp-test-vec.c - test the vector add, sub and mul operations
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * float{32,64}_{add,sub,mul}_vec() compute chunks of elements on the host
+ * FPU and recompute with softfloat the elements that need it.  Check
+ * their results and exception flags against the scalar operation applied
+ * to each element in turn, with vectors that are not a whole number of
+ * chunks and that mix in the special values which leave the batched path.
+ */
+#ifndef HW_POISON_H
+#error Must define HW_POISON_H to work around TARGET_* poisoning
+#endif
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "fpu/softfloat.h"
+
+#define MAX_ELEMS   70
+
+typedef enum { OP_ADD, OP_SUB, OP_MUL } Op;
+
+static const char * const op_names[] = { "add", "sub", "mul" };
+
+static int errors;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng(void)
+{
+    /* xorshift64*, for reproducible operands */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static const uint32_t f32_special[] = {
+    0x00000000, 0x80000000,             /* zeros */
+    0x00000001, 0x807fffff,             /* denormals */
+    0x00800000, 0x80800001,             /* smallest normals */
+    0x7f7fffff, 0xff000000,             /* large, to overflow */
+    0x7f800000, 0xff800000,             /* infinities */
+    0x7fc00000, 0x7f800001,             /* quiet and signalling NaN */
+};
+
+static const uint64_t f64_special[] = {
+    0x0000000000000000ull, 0x8000000000000000ull,
+    0x0000000000000001ull, 0x800fffffffffffffull,
+    0x0010000000000000ull, 0x8010000000000001ull,
+    0x7fefffffffffffffull, 0xffe0000000000000ull,
+    0x7ff0000000000000ull, 0xfff0000000000000ull,
+    0x7ff8000000000000ull, 0x7ff0000000000001ull,
+};
+
+/* Mostly normal numbers near 1, so that the batched path is taken */
+static uint32_t rand_f32(bool specials)
+{
+    uint64_t r = rng();
+
+    if (specials && (r & 15) == 0) {
+        return f32_special[(r >> 4) % ARRAY_SIZE(f32_special)];
+    }
+    return (r & 0x807fffff) | ((uint32_t)(112 + ((r >> 32) & 31)) << 23);
+}
+
+static uint64_t rand_f64(bool specials)
+{
+    uint64_t r = rng();
+
+    if (specials && (r & 15) == 0) {
+        return f64_special[(r >> 4) % ARRAY_SIZE(f64_special)];
+    }
+    return (r & 0x800fffffffffffffull) |
+           ((uint64_t)(1008 + ((r >> 52) & 31)) << 52);
+}
+
+static void rand_status(float_status *s)
+{
+    uint64_t r = rng();
+
+    /* The batched path needs inexact set and round to nearest even */
+    set_float_exception_flags(r & 1 ? float_flag_inexact : 0, s);
+    set_float_rounding_mode(r & 2 ? float_round_nearest_even
+                                  : float_round_to_zero, s);
+    if ((r & 12) == 0) {
+        set_float_rounding_mode(float_round_nearest_even, s);
+        set_float_exception_flags(float_flag_inexact, s);
+    }
+    set_flush_to_zero(r & 16, s);
+    set_flush_inputs_to_zero(r & 32, s);
+}
+
+static void report(int size, Op op, size_t n, size_t i, uint64_t a,
+                   uint64_t b, uint64_t r, uint64_t ref)
+{
+    printf("f%d_%s_vec n=%zu [%zu] %016" PRIx64 " %016" PRIx64 ": %016"
+           PRIx64 ", expected %016" PRIx64 "\n",
+           size, op_names[op], n, i, a, b, r, ref);
+    if (++errors == 20) {
+        exit(1);
+    }
+}
+
+static void report_flags(int size, Op op, size_t n, int flags, int ref)
+{
+    printf("f%d_%s_vec n=%zu: flags 0x%x, expected 0x%x\n",
+           size, op_names[op], n, flags, ref);
+    if (++errors == 20) {
+        exit(1);
+    }
+}
+
+static void test_f32(Op op, float_status *base, bool in_place)
+{
+    float32 a[MAX_ELEMS], b[MAX_ELEMS], d[MAX_ELEMS], ref[MAX_ELEMS];
+    float_status s = *base, ref_s = *base;
+    bool specials = rng() & 1;
+    size_t n = 1 + rng() % MAX_ELEMS;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        a[i] = make_float32(rand_f32(specials));
+        b[i] = make_float32(rand_f32(specials));
+    }
+
+    for (i = 0; i < n; i++) {
+        switch (op) {
+        case OP_ADD:
+            ref[i] = float32_add(a[i], b[i], &ref_s);
+            break;
+        case OP_SUB:
+            ref[i] = float32_sub(a[i], b[i], &ref_s);
+            break;
+        case OP_MUL:
+            ref[i] = float32_mul(a[i], b[i], &ref_s);
+            break;
+        }
+    }
+
+    if (in_place) {
+        memcpy(d, a, sizeof(a));
+    }
+    switch (op) {
+    case OP_ADD:
+        float32_add_vec(d, in_place ? d : a, b, n, &s);
+        break;
+    case OP_SUB:
+        float32_sub_vec(d, in_place ? d : a, b, n, &s);
+        break;
+    case OP_MUL:
+        float32_mul_vec(d, in_place ? d : a, b, n, &s);
+        break;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (float32_val(d[i]) != float32_val(ref[i])) {
+            report(32, op, n, i, float32_val(a[i]), float32_val(b[i]),
+                   float32_val(d[i]), float32_val(ref[i]));
+        }
+    }
+    if (get_float_exception_flags(&s) != get_float_exception_flags(&ref_s)) {
+        report_flags(32, op, n, get_float_exception_flags(&s),
+                     get_float_exception_flags(&ref_s));
+    }
+}
+
+static void test_f64(Op op, float_status *base, bool in_place)
+{
+    float64 a[MAX_ELEMS], b[MAX_ELEMS], d[MAX_ELEMS], ref[MAX_ELEMS];
+    float_status s = *base, ref_s = *base;
+    bool specials = rng() & 1;
+    size_t n = 1 + rng() % MAX_ELEMS;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        a[i] = make_float64(rand_f64(specials));
+        b[i] = make_float64(rand_f64(specials));
+    }
+
+    for (i = 0; i < n; i++) {
+        switch (op) {
+        case OP_ADD:
+            ref[i] = float64_add(a[i], b[i], &ref_s);
+            break;
+        case OP_SUB:
+            ref[i] = float64_sub(a[i], b[i], &ref_s);
+            break;
+        case OP_MUL:
+            ref[i] = float64_mul(a[i], b[i], &ref_s);
+            break;
+        }
+    }
+
+    if (in_place) {
+        memcpy(d, a, sizeof(a));
+    }
+    switch (op) {
+    case OP_ADD:
+        float64_add_vec(d, in_place ? d : a, b, n, &s);
+        break;
+    case OP_SUB:
+        float64_sub_vec(d, in_place ? d : a, b, n, &s);
+        break;
+    case OP_MUL:
+        float64_mul_vec(d, in_place ? d : a, b, n, &s);
+        break;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (float64_val(d[i]) != float64_val(ref[i])) {
+            report(64, op, n, i, float64_val(a[i]), float64_val(b[i]),
+                   float64_val(d[i]), float64_val(ref[i]));
+        }
+    }
+    if (get_float_exception_flags(&s) != get_float_exception_flags(&ref_s)) {
+        report_flags(64, op, n, get_float_exception_flags(&s),
+                     get_float_exception_flags(&ref_s));
+    }
+}
+
+int main(int ac, char **av)
+{
+    float_status s = {0};
+    Op op;
+    int i;
+
+    set_float_2nan_prop_rule(float_2nan_prop_s_ab, &s);
+    set_float_default_nan_pattern(0b01000000, &s);
+    set_float_ftz_detection(float_ftz_before_rounding, &s);
+
+    for (i = 0; i < 20000; i++) {
+        rand_status(&s);
+        for (op = OP_ADD; op <= OP_MUL; op++) {
+            test_f32(op, &s, i & 1);
+            test_f64(op, &s, i & 1);
+        }
+    }
+
+    return errors ? 1 : 0;
+}
@@ -153,6 +153,29 @@ static void test_precopy_unix_xbzrle(void)
     test_precopy_common(&args);
 }
 
+static void *
+migrate_hook_start_precopy_tcp_multifd_xbzrle(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "xbzrle");
+}
+
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_precopy_tcp_multifd_xbzrle,
+        .iterations = 2,
+        .start = {
+            .caps[MIGRATION_CAPABILITY_MULTIFD] = true,
+        },
+        /* Only pages sent again are delta encoded */
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
 static void *
 migrate_hook_start_precopy_tcp_multifd_zlib(QTestState *from,
                                             QTestState *to)
@@ -219,6 +242,9 @@ void migration_test_add_compression(MigrationTestEnv *env)
                        test_multifd_tcp_uadk);
 #endif
 
+    migration_test_add("/migration/multifd/tcp/plain/xbzrle",
+                       test_multifd_tcp_xbzrle);
+
     if (g_test_slow()) {
         migration_test_add("/migration/precopy/unix/xbzrle",
                            test_precopy_unix_xbzrle);
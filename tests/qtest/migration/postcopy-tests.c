@@ -13,7 +13,9 @@
 #include "qemu/osdep.h"
 #include "libqtest.h"
 #include "migration/framework.h"
+#include "migration/migration-qmp.h"
 #include "migration/migration-util.h"
+#include "qobject/qdict.h"
 #include "qobject/qlist.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
@@ -27,6 +29,36 @@ static void test_postcopy(void)
     test_postcopy_common(&args);
 }
 
+static void *migrate_hook_start_postcopy_prefetch(QTestState *from,
+                                                  QTestState *to)
+{
+    migrate_set_parameter_int(to, "postcopy-prefetch-window", 32);
+    return NULL;
+}
+
+static void migrate_hook_end_postcopy_prefetch(QTestState *from,
+                                               QTestState *to,
+                                               void *opaque)
+{
+    QDict *rsp_return = migrate_query_not_failed(to);
+
+    g_assert(qdict_haskey(rsp_return, "postcopy-prefetch-pages"));
+    g_assert(qdict_haskey(rsp_return, "postcopy-prefetch-hits"));
+    g_assert_cmpint(qdict_get_int(rsp_return, "postcopy-prefetch-hits"), <=,
+                    qdict_get_int(rsp_return, "postcopy-prefetch-pages"));
+    qobject_unref(rsp_return);
+}
+
+static void test_postcopy_prefetch(void)
+{
+    MigrateCommon args = {
+        .start_hook = migrate_hook_start_postcopy_prefetch,
+        .end_hook = migrate_hook_end_postcopy_prefetch,
+    };
+
+    test_postcopy_common(&args);
+}
+
 static void test_postcopy_suspend(void)
 {
     MigrateCommon args = {
@@ -137,6 +169,8 @@ void migration_test_add_postcopy(MigrationTestEnv *env)
             "/migration/postcopy/recovery/double-failures/reconnect",
             test_postcopy_recovery_fail_reconnect);
 
+        migration_test_add("/migration/postcopy/prefetch",
+                           test_postcopy_prefetch);
         migration_test_add("/migration/multifd+postcopy/plain",
                            test_multifd_postcopy);
         migration_test_add("/migration/multifd+postcopy/preempt/plain",
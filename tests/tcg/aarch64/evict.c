@@ -0,0 +1,15 @@
+/*
+ * Code buffer eviction, with B chaining blocks across regions.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+asm("step_code:\n"
+    "   add x0, x0, #1\n"
+    "   b .-68\n"           /* the start of the previous slot */
+    "step_end:\n"
+    "ret_code:\n"
+    "   ret\n"
+    "ret_end:\n");
+
+#include "../multiarch/evict.c.inc"
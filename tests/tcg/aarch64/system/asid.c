@@ -0,0 +1,145 @@
+/*
+ * ASID Test
+ *
+ * Map one page non-global at a different physical page for different
+ * ASIDs, and check that switching TTBR0_EL1.ASID without TLB maintenance
+ * never returns the translation of another ASID, and that TLBI ASIDE1
+ * and TLBI ASIDE1IS drop the translations of the ASID they are given,
+ * whether or not it is the current one.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <minilib.h>
+#include <stdint.h>
+
+#define TEST_VA     0x80000000UL
+
+#define DESC_TABLE  3
+#define DESC_PAGE   3
+#define DESC_AF     (1UL << 10)
+#define DESC_NG     (1UL << 11)
+#define DESC_SH_IS  (3UL << 8)
+#define DESC_XN     (3UL << 53)
+
+static uint64_t l1_a[512] __attribute__((aligned(4096)));
+static uint64_t l2_a[512] __attribute__((aligned(4096)));
+static uint64_t l3_a[512] __attribute__((aligned(4096)));
+static uint64_t l1_b[512] __attribute__((aligned(4096)));
+static uint64_t l2_b[512] __attribute__((aligned(4096)));
+static uint64_t l3_b[512] __attribute__((aligned(4096)));
+static uint64_t page_a[512] __attribute__((aligned(4096)));
+static uint64_t page_b[512] __attribute__((aligned(4096)));
+
+static void set_page(uint64_t *l3, uint64_t *page)
+{
+    l3[0] = (uintptr_t)page | DESC_PAGE | DESC_AF | DESC_NG | DESC_SH_IS |
+            DESC_XN;
+    asm volatile("dsb ishst" : : : "memory");
+}
+
+/*
+ * The global mappings of the boot code, plus TEST_VA mapped to @page
+ * through @l2 and @l3.
+ */
+static void make_tables(uint64_t *l1, uint64_t *l2, uint64_t *l3,
+                        uint64_t *page)
+{
+    uint64_t *boot_l1;
+    uint64_t ttbr;
+    int i;
+
+    asm volatile("mrs %0, ttbr0_el1" : "=r"(ttbr));
+    boot_l1 = (uint64_t *)(uintptr_t)(ttbr & 0xfffffffff000UL);
+    for (i = 0; i < 512; i++) {
+        l1[i] = boot_l1[i];
+    }
+    l1[TEST_VA >> 30] = (uintptr_t)l2 | DESC_TABLE;
+    l2[0] = (uintptr_t)l3 | DESC_TABLE;
+    set_page(l3, page);
+}
+
+static void set_asid(uint64_t *l1, uint64_t asid)
+{
+    uint64_t ttbr = (uintptr_t)l1 | asid << 48;
+
+    asm volatile("msr ttbr0_el1, %0\n\t"
+                 "isb" : : "r"(ttbr) : "memory");
+}
+
+static void tlbi_aside1(uint64_t asid)
+{
+    asm volatile("tlbi aside1, %0\n\t"
+                 "dsb nsh\n\t"
+                 "isb" : : "r"(asid << 48) : "memory");
+}
+
+static void tlbi_aside1is(uint64_t asid)
+{
+    asm volatile("tlbi aside1is, %0\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : "r"(asid << 48) : "memory");
+}
+
+static int check(int step, uint64_t expected)
+{
+    /* volatile: the mapping behind TEST_VA changes under the compiler */
+    uint64_t val = *(volatile uint64_t *)TEST_VA;
+
+    if (val != expected) {
+        ml_printf("step %d: read %lx, expected %lx\n", step, val, expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int err = 0;
+    int i, asid;
+
+    page_a[0] = 0xaaaa;
+    page_b[0] = 0xbbbb;
+    make_tables(l1_a, l2_a, l3_a, page_a);
+    make_tables(l1_b, l2_b, l3_b, page_b);
+
+    /* Switching ASIDs without a flush */
+    set_asid(l1_a, 1);
+    err |= check(1, 0xaaaa);
+    set_asid(l1_b, 2);
+    err |= check(2, 0xbbbb);
+    set_asid(l1_a, 1);
+    err |= check(3, 0xaaaa);
+
+    /* More ASIDs than the TLB keeps aside, twice around */
+    for (i = 0; i < 2; i++) {
+        for (asid = 1; asid <= 8; asid++) {
+            set_asid(asid & 1 ? l1_a : l1_b, asid);
+            err |= check(4, asid & 1 ? 0xaaaa : 0xbbbb);
+        }
+    }
+
+    /* TLBI ASIDE1 for the current ASID */
+    set_asid(l1_a, 1);
+    err |= check(5, 0xaaaa);
+    set_page(l3_a, page_b);
+    tlbi_aside1(1);
+    err |= check(6, 0xbbbb);
+
+    /* TLBI ASIDE1IS for another ASID, which is then switched back to */
+    set_asid(l1_b, 2);
+    err |= check(7, 0xbbbb);
+    set_page(l3_a, page_a);
+    tlbi_aside1is(1);
+    set_asid(l1_a, 1);
+    err |= check(8, 0xaaaa);
+
+    /* TLBI ASIDE1 for another ASID */
+    set_asid(l1_b, 2);
+    set_page(l3_a, page_b);
+    tlbi_aside1(1);
+    set_asid(l1_a, 1);
+    err |= check(9, 0xbbbb);
+
+    return err;
+}
@@ -0,0 +1,19 @@
+/*
+ * Tiered translation, following B in hot blocks.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+asm("jump_code:\n"
+    "   mov x0, #1\n"
+    "   b jump_target\n"
+    "   mov x0, #5\n"       /* skipped */
+    "   ret\n"
+    "jump_target:\n"
+    "   add x0, x0, #2\n"
+    "   ret\n"
+    "jump_end:\n"
+    "add_3:\n"
+    "   add x0, x0, #3\n");
+
+#include "../multiarch/tier.c.inc"
@@ -20,6 +20,8 @@ typedef struct {
     uint64_t count_insn_inline;
     uint64_t count_mem;
     uint64_t count_mem_inline;
+    uint64_t count_mem_buffered;
+    uint64_t count_mem_buffered_small;
     uint64_t tb_cond_num_trigger;
     uint64_t tb_cond_track_count;
     uint64_t insn_cond_num_trigger;
@@ -34,6 +36,21 @@ typedef struct {
     uint64_t data_mem;
 } CPUData;
 
+#define N_SLOTS 16
+
+/*
+ * Each access is recorded twice in a buffer of this size.  Instructions
+ * with a single access fill it exactly inline, and the others append
+ * through the helper, as do the accesses made from helpers.
+ */
+#define N_SMALL_RECORDS 2
+
+typedef struct {
+    uint64_t insn_hash[N_SLOTS];
+    uint64_t mem_ring_head;
+    uint64_t mem_ring[N_SLOTS];
+} CPUSlots;
+
 static struct qemu_plugin_scoreboard *counts;
 static qemu_plugin_u64 count_tb;
 static qemu_plugin_u64 count_tb_inline;
@@ -49,6 +66,13 @@ static struct qemu_plugin_scoreboard *data;
 static qemu_plugin_u64 data_insn;
 static qemu_plugin_u64 data_tb;
 static qemu_plugin_u64 data_mem;
+static struct qemu_plugin_scoreboard *slots;
+static qemu_plugin_u64 insn_hash;
+static qemu_plugin_u64 mem_ring_head;
+static struct qemu_plugin_mem_buffer *mem_buffer;
+static qemu_plugin_u64 count_mem_buffered;
+static struct qemu_plugin_mem_buffer *mem_buffer_small;
+static qemu_plugin_u64 count_mem_buffered_small;
 
 static uint64_t global_count_tb;
 static uint64_t global_count_insn;
@@ -127,6 +151,11 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
     g_autoptr(GString) stats = g_string_new("");
     g_assert(num_cpus == max_cpu_index + 1);
 
+    for (int i = 0; i < num_cpus ; ++i) {
+        qemu_plugin_mem_buffer_flush(mem_buffer, i);
+        qemu_plugin_mem_buffer_flush(mem_buffer_small, i);
+    }
+
     for (int i = 0; i < num_cpus ; ++i) {
         const uint64_t tb = qemu_plugin_u64_get(count_tb, i);
         const uint64_t tb_inline = qemu_plugin_u64_get(count_tb_inline, i);
@@ -142,6 +171,12 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
             qemu_plugin_u64_get(insn_cond_num_trigger, i);
         const uint64_t insn_cond_left =
             qemu_plugin_u64_get(insn_cond_track_count, i);
+        const CPUSlots *s = qemu_plugin_scoreboard_find(slots, i);
+        uint64_t insn_hashed = 0;
+
+        for (int j = 0; j < N_SLOTS; j++) {
+            insn_hashed += s->insn_hash[j];
+        }
         g_string_printf(stats, "cpu %d: tb (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
@@ -159,7 +194,11 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
         qemu_plugin_outs(stats->str);
         g_assert(tb == tb_inline);
         g_assert(insn == insn_inline);
+        g_assert(insn == insn_hashed);
         g_assert(mem == mem_inline);
+        g_assert(mem == qemu_plugin_u64_get(mem_ring_head, i));
+        g_assert(mem == qemu_plugin_u64_get(count_mem_buffered, i));
+        g_assert(2 * mem == qemu_plugin_u64_get(count_mem_buffered_small, i));
         g_assert(tb_cond_trigger == tb / cond_trigger_limit);
         g_assert(tb_cond_left == tb % cond_trigger_limit);
         g_assert(insn_cond_trigger == insn / cond_trigger_limit);
@@ -172,6 +211,9 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
 
     qemu_plugin_scoreboard_free(counts);
     qemu_plugin_scoreboard_free(data);
+    qemu_plugin_scoreboard_free(slots);
+    qemu_plugin_mem_buffer_free(mem_buffer);
+    qemu_plugin_mem_buffer_free(mem_buffer_small);
 }
 
 static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
@@ -223,6 +265,23 @@ static void vcpu_mem_access(unsigned int cpu_index,
     g_mutex_unlock(&mem_lock);
 }
 
+static void vcpu_mem_batch(unsigned int cpu_index,
+                           const qemu_plugin_mem_record *records,
+                           size_t n, void *udata)
+{
+    g_assert(n > 0 && n <= N_SLOTS);
+    qemu_plugin_u64_add(count_mem_buffered, cpu_index, n);
+}
+
+static void vcpu_mem_batch_small(unsigned int cpu_index,
+                                 const qemu_plugin_mem_record *records,
+                                 size_t n, void *udata)
+{
+    /* An append past the end would show up as a larger count. */
+    g_assert(n > 0 && n <= N_SMALL_RECORDS);
+    qemu_plugin_u64_add(count_mem_buffered_small, cpu_index, n);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     void *tb_store = tb;
@@ -235,6 +294,14 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
         tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_cond_track_count, 1);
+
+    /* Ops that do not fit their scoreboard entry are refused */
+    g_assert(!qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_HASH_ADD_U64, insn_hash, N_SLOTS - 1));
+    g_assert(!qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_RING_APPEND_U64, mem_ring_head, 2 * N_SLOTS));
+    g_assert(!qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_RING_APPEND_U64, mem_ring_head, 0));
     qemu_plugin_register_vcpu_tb_exec_cond_cb(
         tb, vcpu_tb_cond_exec, QEMU_PLUGIN_CB_NO_REGS,
         QEMU_PLUGIN_COND_EQ, tb_cond_track_count, cond_trigger_limit, tb_store);
@@ -251,6 +318,8 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, vcpu_insn_exec, QEMU_PLUGIN_CB_NO_REGS, insn_store);
         qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
             insn, QEMU_PLUGIN_INLINE_ADD_U64, count_insn_inline, 1);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_HASH_ADD_U64, insn_hash, N_SLOTS);
 
         qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
             insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_cond_track_count, 1);
@@ -270,6 +339,16 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_ADD_U64,
             count_mem_inline, 1);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW,
+            QEMU_PLUGIN_INLINE_RING_APPEND_U64,
+            mem_ring_head, N_SLOTS);
+        qemu_plugin_register_vcpu_mem_buffered(insn, QEMU_PLUGIN_MEM_RW,
+                                               mem_buffer);
+        qemu_plugin_register_vcpu_mem_buffered(insn, QEMU_PLUGIN_MEM_RW,
+                                               mem_buffer_small);
+        qemu_plugin_register_vcpu_mem_buffered(insn, QEMU_PLUGIN_MEM_RW,
+                                               mem_buffer_small);
     }
 }
 
@@ -290,6 +369,10 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, count_insn_inline);
     count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, count_mem_inline);
+    count_mem_buffered = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_buffered);
+    count_mem_buffered_small = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_buffered_small);
     tb_cond_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, tb_cond_num_trigger);
     tb_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
@@ -302,6 +385,14 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     data_insn = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_insn);
     data_tb = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_tb);
     data_mem = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_mem);
+    slots = qemu_plugin_scoreboard_new(sizeof(CPUSlots));
+    insn_hash = qemu_plugin_scoreboard_u64_in_struct(
+        slots, CPUSlots, insn_hash);
+    mem_ring_head = qemu_plugin_scoreboard_u64_in_struct(
+        slots, CPUSlots, mem_ring_head);
+    mem_buffer = qemu_plugin_mem_buffer_new(N_SLOTS, vcpu_mem_batch, NULL);
+    mem_buffer_small = qemu_plugin_mem_buffer_new(N_SMALL_RECORDS,
+                                                  vcpu_mem_batch_small, NULL);
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
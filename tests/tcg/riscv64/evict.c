@@ -0,0 +1,18 @@
+/*
+ * Code buffer eviction, with JAL chaining blocks across regions.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+asm(".option push\n"
+    ".option norvc\n"
+    "step_code:\n"
+    "   addi a0,a0,1\n"
+    "   j .-68\n"           /* the start of the previous slot */
+    "step_end:\n"
+    "ret_code:\n"
+    "   ret\n"
+    "ret_end:\n"
+    ".option pop");
+
+#include "../multiarch/evict.c.inc"
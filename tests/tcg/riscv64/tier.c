@@ -0,0 +1,22 @@
+/*
+ * Tiered translation, following JAL in hot blocks.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+asm(".option push\n"
+    ".option norvc\n"
+    "jump_code:\n"
+    "   li a0,1\n"
+    "   j jump_target\n"
+    "   li a0,5\n"          /* skipped */
+    "   ret\n"
+    "jump_target:\n"
+    "   addi a0,a0,2\n"
+    "   ret\n"
+    "jump_end:\n"
+    "add_3:\n"
+    "   addi a0,a0,3\n"
+    ".option pop");
+
+#include "../multiarch/tier.c.inc"
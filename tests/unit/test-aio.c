@@ -825,6 +825,126 @@ static void test_worker_thread_co_enter(void)
     g_assert(!aio_poll(ctx, false));
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+typedef struct {
+    CqeHandler cqe_handler;
+    int fd;
+    char buf[16];
+    int n;
+} SqeTestData;
+
+static void sqe_test_prep_nop(struct io_uring_sqe *sqe, void *opaque)
+{
+    io_uring_prep_nop(sqe);
+}
+
+static void sqe_test_prep_read(struct io_uring_sqe *sqe, void *opaque)
+{
+    SqeTestData *data = opaque;
+
+    io_uring_prep_read(sqe, data->fd, data->buf, sizeof(data->buf), 0);
+}
+
+static void sqe_test_cb(CqeHandler *cqe_handler)
+{
+    SqeTestData *data = container_of(cqe_handler, SqeTestData, cqe_handler);
+
+    data->n++;
+}
+
+/*
+ * Submit a request that completes right away and one that waits for data on
+ * a pipe, and wait for their cqes with aio_poll() or glib.
+ */
+static void do_test_add_sqe(bool use_gsource)
+{
+    SqeTestData nop = { .cqe_handler.cb = sqe_test_cb };
+    SqeTestData read = { .cqe_handler.cb = sqe_test_cb };
+    int fds[2];
+
+    if (!aio_has_io_uring(ctx)) {
+        g_test_skip("io_uring is not available");
+        return;
+    }
+
+    g_assert_cmpint(g_unix_open_pipe(fds, FD_CLOEXEC, NULL), ==, true);
+    read.fd = fds[0];
+
+    aio_add_sqe(sqe_test_prep_nop, &nop, &nop.cqe_handler);
+    aio_add_sqe(sqe_test_prep_read, &read, &read.cqe_handler);
+
+    while (nop.n == 0) {
+        if (use_gsource) {
+            g_main_context_iteration(NULL, true);
+        } else {
+            aio_poll(ctx, true);
+        }
+    }
+    g_assert_cmpint(nop.cqe_handler.cqe.res, ==, 0);
+    g_assert_cmpint(read.n, ==, 0);
+
+    g_assert_cmpint(write(fds[1], "hello", 5), ==, 5);
+    while (read.n == 0) {
+        if (use_gsource) {
+            g_main_context_iteration(NULL, true);
+        } else {
+            aio_poll(ctx, true);
+        }
+    }
+    g_assert_cmpint(read.cqe_handler.cqe.res, ==, 5);
+    g_assert_cmpmem(read.buf, 5, "hello", 5);
+    g_assert_cmpint(nop.n, ==, 1);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_add_sqe(void)
+{
+    do_test_add_sqe(false);
+}
+
+static void test_source_add_sqe(void)
+{
+    do_test_add_sqe(true);
+}
+
+static void *test_add_sqe_destroy_thread(void *opaque)
+{
+    SqeTestData *data = opaque;
+    AioContext *new_ctx = aio_context_new(&error_abort);
+
+    qemu_set_current_aio_context(new_ctx);
+    if (aio_has_io_uring(new_ctx)) {
+        aio_add_sqe(sqe_test_prep_nop, data, &data->cqe_handler);
+    } else {
+        data->n = -1;
+    }
+
+    /* The request was never reaped, destroying the AioContext waits for it */
+    aio_context_unref(new_ctx);
+    return NULL;
+}
+
+static void test_add_sqe_destroy(void)
+{
+    SqeTestData data = { .cqe_handler.cb = sqe_test_cb };
+    QemuThread thread;
+
+    qemu_thread_create(&thread, "test_add_sqe_destroy",
+                       test_add_sqe_destroy_thread, &data,
+                       QEMU_THREAD_JOINABLE);
+    qemu_thread_join(&thread);
+
+    if (data.n < 0) {
+        g_test_skip("io_uring is not available");
+        return;
+    }
+    g_assert_cmpint(data.n, ==, 1);
+    g_assert_cmpint(data.cqe_handler.cqe.res, ==, 0);
+}
+#endif
+
 /* End of tests.  */
 
 int main(int argc, char **argv)
@@ -850,6 +970,10 @@ int main(int argc, char **argv)
 
     g_test_add_func("/aio/coroutine/queue-chaining", test_queue_chaining);
     g_test_add_func("/aio/coroutine/worker-thread-co-enter", test_worker_thread_co_enter);
+#ifdef CONFIG_LINUX_IO_URING
+    g_test_add_func("/aio/io-uring/add-sqe",        test_add_sqe);
+    g_test_add_func("/aio/io-uring/add-sqe-destroy", test_add_sqe_destroy);
+#endif
 
     g_test_add_func("/aio-gsource/flush",                   test_source_flush);
     g_test_add_func("/aio-gsource/bh/schedule",             test_source_bh_schedule);
@@ -864,5 +988,8 @@ int main(int argc, char **argv)
     g_test_add_func("/aio-gsource/event/wait/no-flush-cb",  test_source_wait_event_notifier_noflush);
     g_test_add_func("/aio-gsource/event/flush",             test_source_flush_event_notifier);
     g_test_add_func("/aio-gsource/timer/schedule",          test_source_timer_schedule);
+#ifdef CONFIG_LINUX_IO_URING
+    g_test_add_func("/aio-gsource/io-uring/add-sqe",        test_source_add_sqe);
+#endif
     return g_test_run();
 }
@@ -0,0 +1,242 @@
+/*
+ * Summary and heat of the migration dirty bitmap unit tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "system/ramblock.h"
+#include "../migration/bmap-summary.h"
+
+#define LEVEL_BITS  (BITS_PER_LONG * BITS_PER_LONG)
+
+/* One, two and three summary levels, full and with a partial last word */
+static const unsigned long sizes[] = {
+    1, BITS_PER_LONG, LEVEL_BITS - 1, LEVEL_BITS,
+    LEVEL_BITS + 1, LEVEL_BITS * BITS_PER_LONG,
+    LEVEL_BITS * BITS_PER_LONG + 1, 2 * LEVEL_BITS * BITS_PER_LONG + 77,
+};
+
+static RAMBlock *block_new(unsigned long pages)
+{
+    RAMBlock *rb = g_new0(RAMBlock, 1);
+
+    rb->bmap = bitmap_new(pages);
+    bmap_summary_init(rb, pages);
+    return rb;
+}
+
+static void block_free(RAMBlock *rb)
+{
+    bmap_summary_free(rb);
+    g_assert_null(rb->bmap_summary);
+    g_free(rb->bmap);
+    g_free(rb);
+}
+
+static void set_dirty(RAMBlock *rb, unsigned long page)
+{
+    set_bit(page, rb->bmap);
+    bmap_summary_mark(rb, BIT_WORD(page));
+}
+
+/* Find and clear every dirty page, as the migration thread does */
+static void check_walk(RAMBlock *rb, unsigned long size)
+{
+    unsigned long page = 0;
+
+    for (;;) {
+        unsigned long ref = find_next_bit(rb->bmap, size, page);
+
+        page = ramblock_find_next_dirty(rb, size, page);
+        g_assert_cmpuint(page, ==, ref);
+        if (page == size) {
+            break;
+        }
+        clear_bit(page, rb->bmap);
+    }
+}
+
+/* Pages on each side of the word and level boundaries */
+static void test_boundaries(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        unsigned long pages = sizes[i];
+        RAMBlock *rb = block_new(pages);
+        unsigned long step;
+
+        /* Nothing dirty: every level is cleared on the way */
+        g_assert_cmpuint(ramblock_find_next_dirty(rb, pages, 0), ==, pages);
+
+        for (step = BITS_PER_LONG; step <= pages; step *= BITS_PER_LONG) {
+            unsigned long b;
+
+            for (b = step; b <= pages; b += step) {
+                set_dirty(rb, b - 1);
+                if (b < pages) {
+                    set_dirty(rb, b);
+                }
+            }
+        }
+        set_dirty(rb, 0);
+        set_dirty(rb, pages - 1);
+        check_walk(rb, pages);
+        g_assert_cmpuint(find_first_bit(rb->bmap, pages), ==, pages);
+
+        block_free(rb);
+    }
+}
+
+/*
+ * A page that is set without marking the summary, once the search found
+ * its region clean, is skipped: it is the summary that is searched.
+ */
+static void test_summary_skips(void)
+{
+    unsigned long pages = 2 * LEVEL_BITS * BITS_PER_LONG + 77;
+    unsigned long hidden = LEVEL_BITS * BITS_PER_LONG + 5;
+    RAMBlock *rb = block_new(pages);
+
+    g_assert_cmpuint(ramblock_find_next_dirty(rb, pages, 0), ==, pages);
+
+    set_bit(hidden, rb->bmap);
+    g_assert_cmpuint(ramblock_find_next_dirty(rb, pages, 0), ==, pages);
+
+    bmap_summary_mark(rb, BIT_WORD(hidden));
+    g_assert_cmpuint(ramblock_find_next_dirty(rb, pages, 0), ==, hidden);
+
+    /* Filling marks everything again */
+    set_bit(hidden + LEVEL_BITS, rb->bmap);
+    bmap_summary_fill(rb, pages);
+    clear_bit(hidden, rb->bmap);
+    g_assert_cmpuint(ramblock_find_next_dirty(rb, pages, 0), ==,
+                     hidden + LEVEL_BITS);
+
+    block_free(rb);
+}
+
+/* Random pages, searched from random places and below the block size */
+static void test_random(void)
+{
+    int i, round;
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        unsigned long pages = sizes[i];
+        RAMBlock *rb = block_new(pages);
+
+        for (round = 0; round < 8; round++) {
+            unsigned long size = g_test_rand_int_range(1, pages + 1);
+            int n = g_test_rand_int_range(0, 64);
+            int j;
+
+            for (j = 0; j < n; j++) {
+                set_dirty(rb, g_test_rand_int_range(0, pages));
+            }
+            for (j = 0; j < 64; j++) {
+                unsigned long page = g_test_rand_int_range(0, size + 1);
+
+                g_assert_cmpuint(ramblock_find_next_dirty(rb, size, page), ==,
+                                 find_next_bit(rb->bmap, size, page));
+            }
+            check_walk(rb, pages);
+        }
+
+        block_free(rb);
+    }
+}
+
+/* Record a bitmap sync in which the guest dirtied the words in @dirty */
+static void heat_sync(RAMBlock *rb, unsigned long pages,
+                      const unsigned long *dirty, int n)
+{
+    unsigned long word;
+    int i;
+
+    for (word = 0; word < BITS_TO_LONGS(pages); word++) {
+        bool found = false;
+
+        for (i = 0; i < n; i++) {
+            found |= dirty[i] == word;
+        }
+        bmap_heat_age(rb, word, found);
+    }
+}
+
+/*
+ * Pages in words that were dirtied before each of the last syncs are left
+ * dirty while hot pages are deferred, and found by the search that the
+ * completion stage does without deferring.
+ */
+static void test_defer_hot(void)
+{
+    unsigned long pages = LEVEL_BITS + 3 * BITS_PER_LONG;
+    unsigned long hot[] = { 0, 3, BITS_PER_LONG, BITS_PER_LONG + 2 };
+    unsigned long warm[] = { 0, 3, 5, BITS_PER_LONG, BITS_PER_LONG + 2 };
+    unsigned long old[] = { 7 };
+    unsigned long hot_pages = 0, page;
+    RAMBlock *rb = block_new(pages);
+    int i;
+
+    rb->bmap_heat = g_new0(uint8_t, BITS_TO_LONGS(pages));
+
+    /* Word 7 was dirtied long ago, word 5 not at each of the last syncs */
+    heat_sync(rb, pages, old, ARRAY_SIZE(old));
+    heat_sync(rb, pages, warm, ARRAY_SIZE(warm));
+    heat_sync(rb, pages, hot, ARRAY_SIZE(hot));
+    heat_sync(rb, pages, warm, ARRAY_SIZE(warm));
+    for (i = 0; i < ARRAY_SIZE(hot); i++) {
+        g_assert_true(bmap_word_is_hot(rb, hot[i]));
+    }
+    g_assert_false(bmap_word_is_hot(rb, 5));
+    g_assert_false(bmap_word_is_hot(rb, 7));
+
+    /* Two pages in each word */
+    for (page = 1; page < pages; page += BITS_PER_LONG / 2) {
+        set_dirty(rb, page);
+        if (bmap_word_is_hot(rb, BIT_WORD(page))) {
+            hot_pages++;
+        }
+    }
+    g_assert_cmpuint(ramblock_count_hot_pages(rb, 0, pages), ==, hot_pages);
+    g_assert_cmpuint(ramblock_count_hot_pages(rb, LEVEL_BITS,
+                                              BITS_PER_LONG), ==, 2);
+    g_assert_cmpuint(ramblock_count_hot_pages(rb, BITS_PER_LONG,
+                                              BITS_PER_LONG), ==, 0);
+
+    /* Iterations send the pages of cold words only */
+    page = 0;
+    while ((page = ramblock_find_next_cold_dirty(rb, pages, page, 1)) <
+           pages) {
+        g_assert_false(bmap_word_is_hot(rb, BIT_WORD(page)));
+        clear_bit(page, rb->bmap);
+    }
+    g_assert_cmpuint(bitmap_count_one(rb->bmap, pages), ==, hot_pages);
+
+    /* Host pages of two words are skipped when they start in a hot word */
+    set_dirty(rb, BITS_PER_LONG + 1);
+    set_dirty(rb, 4 * BITS_PER_LONG + 1);
+    g_assert_cmpuint(ramblock_find_next_cold_dirty(rb, pages, 0, 1), ==,
+                     BITS_PER_LONG + 1);
+    g_assert_cmpuint(ramblock_find_next_cold_dirty(rb, pages, 0,
+                                                   2 * BITS_PER_LONG), ==,
+                     4 * BITS_PER_LONG + 1);
+
+    /* The completion stage finds everything that is left */
+    check_walk(rb, pages);
+
+    g_free(rb->bmap_heat);
+    block_free(rb);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/bmap-summary/boundaries", test_boundaries);
+    g_test_add_func("/bmap-summary/summary-skips", test_summary_skips);
+    g_test_add_func("/bmap-summary/random", test_random);
+    g_test_add_func("/bmap-summary/defer-hot", test_defer_hot);
+    return g_test_run();
+}
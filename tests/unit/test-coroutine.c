@@ -194,6 +194,48 @@ static void test_no_dangling_access(void)
     *c1 = tmp;
 }
 
+/*
+ * Check that coroutines still work after the pool gave their stack memory
+ * back to the host
+ */
+
+#define TRIM_COROUTINES 512
+
+static void coroutine_fn trim_fn(void *opaque)
+{
+    char buf[128 * 1024];
+    int *count = opaque;
+
+    memset(buf, 0x5a, sizeof(buf));
+    qemu_coroutine_yield();
+    g_assert_cmpint(buf[0], ==, 0x5a);
+    g_assert_cmpint(buf[sizeof(buf) - 1], ==, 0x5a);
+    (*count)++;
+}
+
+static void test_trim(void)
+{
+    Coroutine *co[TRIM_COROUTINES];
+    CoroutinePoolStats stats;
+    int count = 0;
+    int round;
+    int i;
+
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < TRIM_COROUTINES; i++) {
+            co[i] = qemu_coroutine_create(trim_fn, &count);
+            qemu_coroutine_enter(co[i]);
+        }
+        for (i = 0; i < TRIM_COROUTINES; i++) {
+            qemu_coroutine_enter(co[i]);
+        }
+    }
+    g_assert_cmpint(count, ==, 2 * TRIM_COROUTINES);
+
+    qemu_coroutine_get_pool_stats(&stats);
+    g_assert_cmpuint(stats.trimmed, >, 0);
+}
+
 static bool locked;
 static int done_count;
 
@@ -647,6 +689,7 @@ int main(int argc, char **argv)
      */
     if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
         g_test_add_func("/basic/no-dangling-access", test_no_dangling_access);
+        g_test_add_func("/basic/trim", test_trim);
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
@@ -0,0 +1,209 @@
+/*
+ * call_rcu queues, shared and expedited grace periods
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/notify.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+
+/* More threads than util/rcu.c has call_rcu queues */
+#define NR_THREADS      16
+#define NR_CALLS        1000
+
+/* RCU_GP_CTR in util/rcu.c */
+#define GP_CTR_STEP     2
+
+typedef struct TestCall {
+    struct rcu_head rcu;
+    int thread;
+    int seq;
+} TestCall;
+
+static TestCall calls[NR_THREADS][NR_CALLS];
+static int last_seq[NR_THREADS];
+static QemuThread threads[NR_THREADS];
+
+/* Runs in the call_rcu thread */
+static void call_cb(TestCall *call)
+{
+    g_assert_cmpint(call->seq, ==, last_seq[call->thread] + 1);
+    last_seq[call->thread] = call->seq;
+}
+
+static void *call_thread(void *opaque)
+{
+    int thread = (uintptr_t)opaque;
+    int i;
+
+    for (i = 0; i < NR_CALLS; i++) {
+        calls[thread][i].thread = thread;
+        calls[thread][i].seq = i;
+        call_rcu(&calls[thread][i], call_cb, rcu);
+    }
+    drain_call_rcu();
+    g_assert_cmpint(last_seq[thread], ==, NR_CALLS - 1);
+    return NULL;
+}
+
+/*
+ * Threads that share call_rcu queues see their callbacks run in the order
+ * they registered them, and drain_call_rcu() waits for all of them.
+ */
+static void test_call_order(void)
+{
+    int i;
+
+    for (i = 0; i < NR_THREADS; i++) {
+        last_seq[i] = -1;
+    }
+    for (i = 0; i < NR_THREADS; i++) {
+        qemu_thread_create(&threads[i], "call", call_thread,
+                           (void *)(uintptr_t)i, QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < NR_THREADS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static QemuEvent reader_locked;
+static QemuEvent reader_go;
+static int sync_started;
+static int sync_done;
+
+static void *reader_thread(void *opaque)
+{
+    rcu_register_thread();
+    rcu_read_lock();
+    qemu_event_set(&reader_locked);
+    qemu_event_wait(&reader_go);
+    rcu_read_unlock();
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void *sync_thread(void *opaque)
+{
+    qatomic_inc(&sync_started);
+    synchronize_rcu();
+    qatomic_inc(&sync_done);
+    return NULL;
+}
+
+/*
+ * synchronize_rcu() waits for a reader that was in its critical section
+ * before the call, and callers that wait at the same time share the grace
+ * periods: one in progress when they arrive, and one after it.
+ */
+static void test_shared_grace_period(void)
+{
+    QemuThread reader;
+    unsigned long ctr;
+    int i;
+
+    qemu_event_init(&reader_locked, false);
+    qemu_event_init(&reader_go, false);
+    sync_started = sync_done = 0;
+
+    qemu_thread_create(&reader, "reader", reader_thread, NULL,
+                       QEMU_THREAD_JOINABLE);
+    qemu_event_wait(&reader_locked);
+
+    ctr = qatomic_read(&rcu_gp_ctr);
+    for (i = 0; i < NR_THREADS; i++) {
+        qemu_thread_create(&threads[i], "sync", sync_thread, NULL,
+                           QEMU_THREAD_JOINABLE);
+    }
+    while (qatomic_read(&sync_started) < NR_THREADS) {
+        g_usleep(1000);
+    }
+    g_usleep(50 * 1000);
+    g_assert_cmpint(qatomic_read(&sync_done), ==, 0);
+
+    qemu_event_set(&reader_go);
+    for (i = 0; i < NR_THREADS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+    qemu_thread_join(&reader);
+    g_assert_cmpint(sync_done, ==, NR_THREADS);
+
+    /* With 32-bit longs, grace periods flip the counter back and forth */
+    if (sizeof(rcu_gp_ctr) == 8) {
+        g_assert_cmpint((rcu_gp_ctr - ctr) / GP_CTR_STEP, <=, 2);
+    }
+
+    qemu_event_destroy(&reader_locked);
+    qemu_event_destroy(&reader_go);
+}
+
+static TestCall expedited_call;
+static QemuEvent expedited_done;
+static bool forced;
+
+static void force_rcu(Notifier *n, void *data)
+{
+    qatomic_set(&forced, true);
+}
+
+static void *long_reader_thread(void *opaque)
+{
+    Notifier force_rcu_notifier = { .notify = force_rcu };
+    int i;
+
+    rcu_register_thread();
+    rcu_add_force_rcu_notifier(&force_rcu_notifier);
+    rcu_read_lock();
+    qemu_event_set(&reader_locked);
+
+    /* Leave the critical section when asked, or give up after 10s */
+    for (i = 0; i < 10000 && !qatomic_read(&forced); i++) {
+        g_usleep(1000);
+    }
+
+    rcu_read_unlock();
+    rcu_remove_force_rcu_notifier(&force_rcu_notifier);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void expedited_cb(TestCall *call)
+{
+    qemu_event_set(&expedited_done);
+}
+
+/*
+ * An expedited callback asks readers to leave their critical sections,
+ * rather than waiting for them to do so on their own.
+ */
+static void test_call_expedited(void)
+{
+    QemuThread reader;
+
+    qemu_event_init(&reader_locked, false);
+    qemu_event_init(&expedited_done, false);
+    forced = false;
+
+    qemu_thread_create(&reader, "reader", long_reader_thread, NULL,
+                       QEMU_THREAD_JOINABLE);
+    qemu_event_wait(&reader_locked);
+
+    call_rcu_expedited(&expedited_call, expedited_cb, rcu);
+    qemu_event_wait(&expedited_done);
+    qemu_thread_join(&reader);
+    g_assert_true(forced);
+
+    qemu_event_destroy(&reader_locked);
+    qemu_event_destroy(&expedited_done);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/rcu/call-order", test_call_order);
+    g_test_add_func("/rcu/shared-grace-period", test_shared_grace_period);
+    g_test_add_func("/rcu/call-expedited", test_call_expedited);
+    return g_test_run();
+}
@@ -0,0 +1,326 @@
+/*
+ * Timer list tests, in particular of the timing wheel behind it
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Timers are armed on a private QEMUTimerListGroup of QEMU_CLOCK_VIRTUAL,
+ * whose time is set by the test.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "system/cpu-timers.h"
+
+/* The granule and the bits per level of the wheel in util/qemu-timer.c */
+#define GRANULE     (1LL << 16)
+#define LEVEL_BITS  6
+
+/* This is the clock for QEMU_CLOCK_VIRTUAL */
+static int64_t my_clock_value;
+
+int64_t cpu_get_clock(void)
+{
+    return my_clock_value;
+}
+
+typedef struct TestTimer {
+    QEMUTimer timer;
+    int64_t expire;
+    int id;
+} TestTimer;
+
+static QEMUTimerListGroup tlg;
+static int fired[1024];
+static int n_fired;
+
+static QEMUTimerList *tl(void)
+{
+    return tlg.tl[QEMU_CLOCK_VIRTUAL];
+}
+
+static void setup(void)
+{
+    my_clock_value = 0;
+    n_fired = 0;
+    timerlistgroup_init(&tlg, NULL, NULL);
+}
+
+static void teardown(void)
+{
+    timerlistgroup_deinit(&tlg);
+}
+
+static void timer_cb(void *opaque)
+{
+    TestTimer *t = opaque;
+
+    g_assert_cmpint(t->expire, <=, my_clock_value);
+    g_assert_cmpint(n_fired, <, ARRAY_SIZE(fired));
+    fired[n_fired++] = t->id;
+}
+
+static void mod(TestTimer *t, int64_t expire)
+{
+    t->expire = expire;
+    timer_mod_ns(&t->timer, expire);
+}
+
+static void arm_full(TestTimer *t, int id, int64_t expire, int attributes,
+                     QEMUTimerCB *cb)
+{
+    t->id = id;
+    timer_init_full(&t->timer, &tlg, QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                    attributes, cb, t);
+    mod(t, expire);
+}
+
+static void arm(TestTimer *t, int id, int64_t expire)
+{
+    arm_full(t, id, expire, 0, timer_cb);
+}
+
+static void run_until(int64_t time)
+{
+    my_clock_value = time;
+    timerlist_run_timers(tl());
+}
+
+static int64_t deadline(void)
+{
+    return timerlist_deadline_ns(tl());
+}
+
+static int compare_expiry(const void *a, const void *b)
+{
+    const TestTimer *ta = a, *tb = b;
+
+    if (ta->expire != tb->expire) {
+        return ta->expire < tb->expire ? -1 : 1;
+    }
+    return ta->id - tb->id;
+}
+
+/*
+ * Timers spread over the lower levels, some of them expiring at the same
+ * time, fire in order of expiry and then of arming, never early and never
+ * later than the first run after they expire.
+ */
+static void test_expiry_order(void)
+{
+    TestTimer t[ARRAY_SIZE(fired)];
+    TestTimer sorted[ARRAY_SIZE(fired)];
+    int64_t expire = 0;
+    int i, level;
+
+    setup();
+    for (i = 0; i < ARRAY_SIZE(t); i++) {
+        if (i % 4) {
+            level = g_test_rand_int_range(0, 5);
+            expire = (((int64_t)g_test_rand_int() << 32) | g_test_rand_int()) &
+                     ((GRANULE << ((level + 1) * LEVEL_BITS)) - 1);
+        }
+        arm(&t[i], i, expire);
+    }
+
+    memcpy(sorted, t, sizeof(t));
+    qsort(sorted, ARRAY_SIZE(sorted), sizeof(sorted[0]), compare_expiry);
+
+    run_until(0);
+    while (timerlist_has_timers(tl())) {
+        g_assert_cmpint(deadline(), >, 0);
+        run_until(my_clock_value + deadline() +
+                  (g_test_rand_bit() ? 0 : g_test_rand_int_range(0, GRANULE)));
+    }
+    g_assert_cmpint(deadline(), ==, -1);
+
+    g_assert_cmpint(n_fired, ==, ARRAY_SIZE(t));
+    for (i = 0; i < ARRAY_SIZE(t); i++) {
+        g_assert_cmpint(fired[i], ==, sorted[i].id);
+    }
+    teardown();
+}
+
+/*
+ * Approach timers on each level in steps that halve the distance, so
+ * that they are filed again at every level below on the way.  The
+ * deadline must stay exact throughout.
+ */
+static void test_cascade(void)
+{
+    TestTimer t[3];
+    int64_t base;
+    int i, level;
+
+    for (level = 0; level < 6; level++) {
+        base = GRANULE << (level * LEVEL_BITS);
+
+        setup();
+        arm(&t[0], 0, base - 1);
+        arm(&t[1], 1, base);
+        arm(&t[2], 2, base + 3 * GRANULE + 5);
+
+        for (i = 0; i < ARRAY_SIZE(t); i++) {
+            while (my_clock_value < t[i].expire - 1) {
+                run_until(my_clock_value + (t[i].expire - my_clock_value) / 2);
+                g_assert_cmpint(n_fired, ==, i);
+                g_assert_cmpint(deadline(), ==, t[i].expire - my_clock_value);
+            }
+            run_until(t[i].expire);
+            g_assert_cmpint(n_fired, ==, i + 1);
+            g_assert_cmpint(fired[i], ==, i);
+        }
+        g_assert_false(timerlist_has_timers(tl()));
+        teardown();
+    }
+}
+
+static void rearm_cb(void *opaque)
+{
+    TestTimer *t = opaque;
+
+    timer_cb(opaque);
+    if (n_fired < 10) {
+        mod(t, t->expire + 100 * GRANULE + 1);
+    }
+}
+
+static void test_del_rearm(void)
+{
+    TestTimer t[2];
+    int i;
+
+    setup();
+
+    /* In the wheel */
+    arm(&t[0], 0, GRANULE << 20);
+    g_assert_true(timerlist_has_timers(tl()));
+    g_assert_cmpint(deadline(), ==, GRANULE << 20);
+    timer_del(&t[0].timer);
+    g_assert_false(timerlist_has_timers(tl()));
+    g_assert_cmpint(deadline(), ==, -1);
+
+    /* From the sorted list to the wheel and back */
+    mod(&t[0], GRANULE / 2);
+    g_assert_cmpint(deadline(), ==, GRANULE / 2);
+    mod(&t[0], GRANULE << 8);
+    g_assert_cmpint(deadline(), ==, GRANULE << 8);
+    mod(&t[0], GRANULE / 4);
+    g_assert_cmpint(deadline(), ==, GRANULE / 4);
+
+    /* After the wheel moved it down some levels */
+    mod(&t[0], GRANULE << 8);
+    run_until((GRANULE << 8) - 70 * GRANULE);
+    g_assert_cmpint(deadline(), ==, 70 * GRANULE);
+    timer_del(&t[0].timer);
+    g_assert_false(timerlist_has_timers(tl()));
+    run_until((GRANULE << 8) + GRANULE);
+    g_assert_cmpint(n_fired, ==, 0);
+
+    /* The first of two timers in the same slot */
+    arm(&t[1], 1, my_clock_value + 5 * GRANULE);
+    mod(&t[0], my_clock_value + 5 * GRANULE + 1);
+    g_assert_cmpint(deadline(), ==, 5 * GRANULE);
+    timer_del(&t[1].timer);
+    g_assert_cmpint(deadline(), ==, 5 * GRANULE + 1);
+    run_until(t[0].expire);
+    g_assert_cmpint(n_fired, ==, 1);
+    g_assert_cmpint(fired[0], ==, 0);
+
+    /* From its own callback */
+    n_fired = 0;
+    arm_full(&t[1], 1, my_clock_value + GRANULE, 0, rearm_cb);
+    for (i = 1; i <= 10; i++) {
+        run_until(t[1].expire - 1);
+        g_assert_cmpint(n_fired, ==, i - 1);
+        run_until(t[1].expire);
+        g_assert_cmpint(n_fired, ==, i);
+    }
+    g_assert_false(timerlist_has_timers(tl()));
+    teardown();
+}
+
+static void test_deadline(void)
+{
+    TestTimer t[3];
+
+    setup();
+    g_assert_cmpint(deadline(), ==, -1);
+
+    /* The later timer of a slot is found when the earlier one goes */
+    arm(&t[0], 0, GRANULE << 13);
+    arm(&t[1], 1, 5 * GRANULE + 7);
+    arm(&t[2], 2, 5 * GRANULE + 3);
+    g_assert_cmpint(deadline(), ==, 5 * GRANULE + 3);
+    timer_del(&t[2].timer);
+    g_assert_cmpint(deadline(), ==, 5 * GRANULE + 7);
+    timer_del(&t[1].timer);
+    g_assert_cmpint(deadline(), ==, GRANULE << 13);
+
+    /* Relative to the clock, even before the timers have run */
+    my_clock_value = 100;
+    g_assert_cmpint(deadline(), ==, (GRANULE << 13) - 100);
+    my_clock_value = (GRANULE << 13) + 1;
+    g_assert_cmpint(deadline(), ==, 0);
+    g_assert_true(timerlist_expired(tl()));
+
+    run_until(my_clock_value);
+    g_assert_cmpint(n_fired, ==, 1);
+    g_assert_cmpint(deadline(), ==, -1);
+    g_assert_false(timerlist_expired(tl()));
+    teardown();
+}
+
+static int64_t deadline_attr(int attr_mask)
+{
+    return qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL, attr_mask);
+}
+
+static void test_attr_mask(void)
+{
+    TestTimer ext[2], t[2];
+
+    setup();
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_ALL), ==, -1);
+
+    /* In different levels of the wheel */
+    arm_full(&ext[0], 0, 2 * GRANULE, QEMU_TIMER_ATTR_EXTERNAL, timer_cb);
+    arm(&t[0], 1, GRANULE << 12);
+    g_assert_cmpint(deadline(), ==, 2 * GRANULE);
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_ALL), ==, 2 * GRANULE);
+    g_assert_cmpint(deadline_attr(0), ==, GRANULE << 12);
+
+    /* In the same slot */
+    arm(&t[1], 2, 2 * GRANULE + 1);
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_ALL), ==, 2 * GRANULE);
+    g_assert_cmpint(deadline_attr(0), ==, 2 * GRANULE + 1);
+
+    /* In the sorted list */
+    arm_full(&ext[1], 3, GRANULE / 2, QEMU_TIMER_ATTR_EXTERNAL, timer_cb);
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_ALL), ==, GRANULE / 2);
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_EXTERNAL), ==, GRANULE / 2);
+    g_assert_cmpint(deadline_attr(0), ==, 2 * GRANULE + 1);
+
+    timer_del(&t[1].timer);
+    timer_del(&t[0].timer);
+    g_assert_cmpint(deadline_attr(0), ==, -1);
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_ALL), ==, GRANULE / 2);
+
+    timer_del(&ext[1].timer);
+    timer_del(&ext[0].timer);
+    g_assert_cmpint(deadline_attr(QEMU_TIMER_ATTR_ALL), ==, -1);
+    teardown();
+}
+
+int main(int argc, char **argv)
+{
+    init_clocks(NULL);
+    qemu_clock_enable(QEMU_CLOCK_VIRTUAL, true);
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/timer-wheel/expiry-order", test_expiry_order);
+    g_test_add_func("/timer-wheel/cascade", test_cascade);
+    g_test_add_func("/timer-wheel/del-rearm", test_del_rearm);
+    g_test_add_func("/timer-wheel/deadline", test_deadline);
+    g_test_add_func("/timer-wheel/attr-mask", test_attr_mask);
+    return g_test_run();
+}
@@ -22,12 +22,29 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "trace.h"
 #include "aio-posix.h"
 
 /* Stop userspace polling on a handler if it isn't active for some time */
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
+/* ...or if it was polled this many times in a row without an event */
+#define POLL_IDLE_ROUNDS 1024
+
+/* Bucket i of AioPolledEvent::hist counts latencies below 2^(i + 10) ns */
+#define POLL_HIST_SHIFT 10
+
+/* Halve AioPolledEvent::hist after this many events to follow the workload */
+#define POLL_HIST_WINDOW 64
+
+/*
+ * Poll long enough to catch this percentage of a handler's events, but don't
+ * poll at all if poll_max_ns is too short to catch POLL_HIT_MIN percent.
+ */
+#define POLL_HIT_TARGET 90
+#define POLL_HIT_MIN    50
+
 static void adjust_polling_time(AioContext *ctx, AioPolledEvent *poll,
                                 int64_t block_ns);
 
@@ -68,6 +85,15 @@ static AioHandler *find_aio_handler(AioContext *ctx, int fd)
     return NULL;
 }
 
+/*
+ * Does glib poll the file descriptors of the AioHandlers itself?  Otherwise
+ * the fd monitoring implementation integrates into the GSource.
+ */
+static bool aio_gsource_polls_fds(AioContext *ctx)
+{
+    return !ctx->fdmon_ops->gsource_dispatch;
+}
+
 static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
 {
     /* If the GSource is in the process of being destroyed then
@@ -75,7 +101,7 @@ static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
      * removal in that case, because glib cleans up its state during
      * destruction anyway.
      */
-    if (!g_source_is_destroyed(&ctx->source)) {
+    if (aio_gsource_polls_fds(ctx) && !g_source_is_destroyed(&ctx->source)) {
         g_source_remove_poll(&ctx->source, &node->pfd);
     }
 
@@ -101,13 +127,14 @@ static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
     return true;
 }
 
-void aio_set_fd_handler(AioContext *ctx,
-                        int fd,
-                        IOHandler *io_read,
-                        IOHandler *io_write,
-                        AioPollFn *io_poll,
-                        IOHandler *io_poll_ready,
-                        void *opaque)
+static void aio_set_handler(AioContext *ctx,
+                            int fd,
+                            IOHandler *io_read,
+                            IOHandler *io_write,
+                            AioPollFn *io_poll,
+                            IOHandler *io_poll_ready,
+                            void *opaque,
+                            bool is_eventfd)
 {
     AioHandler *node;
     AioHandler *new_node = NULL;
@@ -147,13 +174,16 @@ void aio_set_fd_handler(AioContext *ctx,
         new_node->io_poll = io_poll;
         new_node->io_poll_ready = io_poll_ready;
         new_node->opaque = opaque;
+        new_node->is_eventfd = is_eventfd;
 
         if (is_new) {
             new_node->pfd.fd = fd;
         } else {
             new_node->pfd = node->pfd;
         }
-        g_source_add_poll(&ctx->source, &new_node->pfd);
+        if (aio_gsource_polls_fds(ctx)) {
+            g_source_add_poll(&ctx->source, &new_node->pfd);
+        }
 
         new_node->pfd.events = (io_read ? G_IO_IN | G_IO_HUP | G_IO_ERR : 0);
         new_node->pfd.events |= (io_write ? G_IO_OUT | G_IO_ERR : 0);
@@ -182,6 +212,18 @@ void aio_set_fd_handler(AioContext *ctx,
     }
 }
 
+void aio_set_fd_handler(AioContext *ctx,
+                        int fd,
+                        IOHandler *io_read,
+                        IOHandler *io_write,
+                        AioPollFn *io_poll,
+                        IOHandler *io_poll_ready,
+                        void *opaque)
+{
+    aio_set_handler(ctx, fd, io_read, io_write, io_poll, io_poll_ready,
+                    opaque, false);
+}
+
 static void aio_set_fd_poll(AioContext *ctx, int fd,
                             IOHandler *io_poll_begin,
                             IOHandler *io_poll_end)
@@ -202,9 +244,12 @@ void aio_set_event_notifier(AioContext *ctx,
                             AioPollFn *io_poll,
                             EventNotifierHandler *io_poll_ready)
 {
-    aio_set_fd_handler(ctx, event_notifier_get_fd(notifier),
-                       (IOHandler *)io_read, NULL, io_poll,
-                       (IOHandler *)io_poll_ready, notifier);
+    /* Pipes only wake up pollers when they were empty, eventfds always do */
+    bool is_eventfd = notifier->rfd == notifier->wfd;
+
+    aio_set_handler(ctx, event_notifier_get_fd(notifier),
+                    (IOHandler *)io_read, NULL, io_poll,
+                    (IOHandler *)io_poll_ready, notifier, is_eventfd);
 }
 
 void aio_set_event_notifier_poll(AioContext *ctx,
@@ -267,6 +312,9 @@ bool aio_prepare(AioContext *ctx)
     poll_set_started(ctx, &ready_list, false);
     /* TODO what to do with this list? */
 
+    if (ctx->fdmon_ops->gsource_prepare) {
+        return ctx->fdmon_ops->gsource_prepare(ctx);
+    }
     return false;
 }
 
@@ -275,6 +323,10 @@ bool aio_pending(AioContext *ctx)
     AioHandler *node;
     bool result = false;
 
+    if (ctx->fdmon_ops->gsource_check) {
+        return ctx->fdmon_ops->gsource_check(ctx);
+    }
+
     /*
      * We have to walk very carefully in case aio_set_fd_handler is
      * called while we're walking.
@@ -370,6 +422,15 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
         return node->opaque != &ctx->notifier;
     }
 
+    /*
+     * The handler is not idle just because its events arrived through the
+     * fd rather than through polling: don't let remove_idle_poll_handlers()
+     * drop it, only for the next event to add it back.
+     */
+    if (revents) {
+        node->poll.idle_rounds = 0;
+    }
+
     if (!QLIST_IS_INSERTED(node, node_deleted) &&
         (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) &&
         node->io_read) {
@@ -420,9 +481,21 @@ static bool aio_dispatch_ready_handlers(AioContext *ctx,
 /* Slower than aio_dispatch_ready_handlers() but only used via glib */
 static bool aio_dispatch_handlers(AioContext *ctx)
 {
+    AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
     AioHandler *node, *tmp;
     bool progress = false;
 
+    if (ctx->fdmon_ops->gsource_dispatch) {
+        ctx->fdmon_ops->gsource_dispatch(ctx, &ready_list);
+
+        /* Polling is disabled in glib's event loop, so don't adjust it */
+        while ((node = QLIST_FIRST(&ready_list))) {
+            QLIST_REMOVE(node, node_ready);
+            progress = aio_dispatch_handler(ctx, node) || progress;
+        }
+        return fdmon_io_uring_dispatch(ctx) || progress;
+    }
+
     QLIST_FOREACH_SAFE_RCU(node, &ctx->aio_handlers, node, tmp) {
         progress = aio_dispatch_handler(ctx, node) || progress;
     }
@@ -455,6 +528,7 @@ static bool run_poll_handlers_once(AioContext *ctx,
             aio_add_poll_ready_handler(ready_list, node);
 
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
+            node->poll.idle_rounds = 0;
 
             /*
              * Polling was successful, exit try_poll_mode immediately
@@ -496,11 +570,14 @@ static bool remove_idle_poll_handlers(AioContext *ctx,
     }
 
     QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        node->poll.idle_rounds++;
         if (node->poll_idle_timeout == 0LL) {
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
-        } else if (now >= node->poll_idle_timeout) {
+        } else if (now >= node->poll_idle_timeout ||
+                   node->poll.idle_rounds > POLL_IDLE_ROUNDS) {
             trace_poll_remove(ctx, node, node->pfd.fd);
             node->poll_idle_timeout = 0LL;
+            node->poll.idle_rounds = 0;
             QLIST_SAFE_REMOVE(node, node_poll);
             if (ctx->poll_started && node->io_poll_end) {
                 node->io_poll_end(node->opaque);
@@ -618,9 +695,75 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     return false;
 }
 
+/* Record the latency of an event in the histogram */
+static void poll_hist_add(AioPolledEvent *poll, int64_t block_ns)
+{
+    int bucket = 64 - clz64(block_ns >> POLL_HIST_SHIFT);
+    int i;
+
+    poll->hist[MIN(bucket, AIO_POLL_HIST_BUCKETS - 1)]++;
+    if (++poll->hist_total < POLL_HIST_WINDOW) {
+        return;
+    }
+
+    poll->hist_total = 0;
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        poll->hist[i] /= 2;
+        poll->hist_total += poll->hist[i];
+    }
+}
+
+/*
+ * Choose the shortest polling time that catches POLL_HIT_TARGET percent of
+ * the recent events, as long as polling is worth it at all.  Handlers whose
+ * events rarely arrive within poll_max_ns stop polling.
+ */
+static void adjust_polling_time_adaptive(AioContext *ctx,
+                                         AioPolledEvent *poll)
+{
+    int64_t old = poll->ns;
+    int64_t ns = 0;
+    unsigned covered = 0;
+    int i;
+
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        int64_t limit = 1LL << (i + POLL_HIST_SHIFT);
+
+        covered += poll->hist[i];
+        ns = MIN(limit, ctx->poll_max_ns);
+        if (limit >= ctx->poll_max_ns ||
+            covered * 100 >= poll->hist_total * POLL_HIT_TARGET) {
+            break;
+        }
+    }
+
+    if (covered * 100 < poll->hist_total * POLL_HIT_MIN) {
+        ns = 0;
+    }
+
+    poll->ns = ns;
+    if (ns > old) {
+        trace_poll_grow(ctx, old, ns);
+    } else if (ns < old) {
+        trace_poll_shrink(ctx, old, ns);
+    }
+}
+
 static void adjust_polling_time(AioContext *ctx, AioPolledEvent *poll,
                                 int64_t block_ns)
 {
+    if (block_ns <= poll->ns) {
+        poll->hits++;
+    } else {
+        poll->misses++;
+    }
+    poll_hist_add(poll, block_ns);
+
+    if (!ctx->poll_grow && !ctx->poll_shrink) {
+        adjust_polling_time_adaptive(ctx, poll);
+        return;
+    }
+
     if (block_ns <= poll->ns) {
         /* This is the sweet spot, no adjustment needed */
     } else if (block_ns > ctx->poll_max_ns) {
@@ -745,6 +888,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     progress |= aio_bh_poll(ctx);
     progress |= aio_dispatch_ready_handlers(ctx, &ready_list, block_ns);
+    progress |= fdmon_io_uring_dispatch(ctx);
 
     aio_free_deleted_handlers(ctx);
 
@@ -778,12 +922,11 @@ void aio_context_destroy(AioContext *ctx)
 void aio_context_use_g_source(AioContext *ctx)
 {
     /*
-     * Disable io_uring when the glib main loop is used because it doesn't
-     * support mixed glib/aio_poll() usage. It relies on aio_poll() being
-     * called regularly so that changes to the monitored file descriptors are
-     * submitted, otherwise a list of pending fd handlers builds up.
+     * fdmon-io_uring stays enabled.  Its gsource callbacks submit pending
+     * changes to the monitored file descriptors before glib waits, so mixed
+     * glib/aio_poll() usage works and iothreads keep sharing their ring with
+     * aio_add_sqe() users.
      */
-    fdmon_io_uring_destroy(ctx);
     aio_free_deleted_handlers(ctx);
 }
 
@@ -795,6 +938,8 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     qemu_lockcnt_inc(&ctx->list_lock);
     QLIST_FOREACH(node, &ctx->aio_handlers, node) {
         node->poll.ns = 0;
+        node->poll.hist_total = 0;
+        memset(node->poll.hist, 0, sizeof(node->poll.hist));
     }
     qemu_lockcnt_dec(&ctx->list_lock);
 
@@ -808,6 +953,31 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     aio_notify(ctx);
 }
 
+void aio_context_foreach_poll(AioContext *ctx,
+                              void (*fn)(const AioPollInfo *info,
+                                         void *opaque),
+                              void *opaque)
+{
+    AioHandler *node;
+
+    qemu_lockcnt_inc(&ctx->list_lock);
+    WITH_RCU_READ_LOCK_GUARD() {
+        QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+            AioPollInfo info;
+
+            if (!node->io_poll || QLIST_IS_INSERTED(node, node_deleted)) {
+                continue;
+            }
+
+            info.fd = node->pfd.fd;
+            info.polling = QLIST_IS_INSERTED(node, node_poll);
+            info.poll = node->poll;
+            fn(&info, opaque);
+        }
+    }
+    qemu_lockcnt_dec(&ctx->list_lock);
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
     /*
@@ -36,6 +36,7 @@ struct AioHandler {
     QSLIST_ENTRY(AioHandler) node_submitted;
     unsigned flags; /* see fdmon-io_uring.c */
 #endif
+    bool is_eventfd; /* every write wakes up pollers */
     int64_t poll_idle_timeout; /* when to stop userspace polling */
     bool poll_ready; /* has polling detected an event? */
     AioPolledEvent poll;
@@ -69,6 +70,7 @@ static inline void fdmon_epoll_disable(AioContext *ctx)
 #ifdef CONFIG_LINUX_IO_URING
 bool fdmon_io_uring_setup(AioContext *ctx);
 void fdmon_io_uring_destroy(AioContext *ctx);
+bool fdmon_io_uring_dispatch(AioContext *ctx);
 #else
 static inline bool fdmon_io_uring_setup(AioContext *ctx)
 {
@@ -78,6 +80,11 @@ static inline bool fdmon_io_uring_setup(AioContext *ctx)
 static inline void fdmon_io_uring_destroy(AioContext *ctx)
 {
 }
+
+static inline bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    return false;
+}
 #endif /* !CONFIG_LINUX_IO_URING */
 
 #endif /* AIO_POSIX_H */
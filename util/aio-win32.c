@@ -439,6 +439,13 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     }
 }
 
+void aio_context_foreach_poll(AioContext *ctx,
+                              void (*fn)(const AioPollInfo *info,
+                                         void *opaque),
+                              void *opaque)
+{
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
 }
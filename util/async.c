@@ -387,6 +387,12 @@ aio_ctx_finalize(GSource     *source)
     }
 #endif
 
+    /*
+     * This waits for requests in flight on the fd monitoring ring, whose
+     * callbacks may still need the BHs below.
+     */
+    aio_context_destroy(ctx);
+
     assert(QSLIST_EMPTY(&ctx->scheduled_coroutines));
     qemu_bh_delete(ctx->co_schedule_bh);
 
@@ -418,7 +424,6 @@ aio_ctx_finalize(GSource     *source)
     qemu_lockcnt_destroy(&ctx->list_lock);
     timerlistgroup_deinit(&ctx->tlg);
     unregister_aiocontext(ctx);
-    aio_context_destroy(ctx);
 }
 
 static GSourceFuncs aio_source_funcs = {
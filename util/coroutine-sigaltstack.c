@@ -270,6 +270,13 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+void qemu_coroutine_trim(Coroutine *co_)
+{
+    CoroutineSigAltStack *co = DO_UPCAST(CoroutineSigAltStack, base, co_);
+
+    qemu_trim_stack(co->stack, co->stack_size, COROUTINE_STACK_TRIM_KEEP);
+}
+
 CoroutineAction qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
                                       CoroutineAction action)
 {
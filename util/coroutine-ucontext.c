@@ -299,6 +299,17 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+void qemu_coroutine_trim(Coroutine *co_)
+{
+    CoroutineUContext *co = DO_UPCAST(CoroutineUContext, base, co_);
+
+    qemu_trim_stack(co->stack, co->stack_size, COROUTINE_STACK_TRIM_KEEP);
+#ifdef CONFIG_SAFESTACK
+    qemu_trim_stack(co->unsafe_stack, co->unsafe_stack_size,
+                    COROUTINE_STACK_TRIM_KEEP);
+#endif
+}
+
 /* This function is marked noinline to prevent GCC from inlining it
  * into coroutine_trampoline(). If we allow it to do that then it
  * hoists the code to get the address of the TLS variable "current"
@@ -82,6 +82,11 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+void qemu_coroutine_trim(Coroutine *co_)
+{
+    /* There is no way to give memory back to the host */
+}
+
 CoroutineAction qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
                       CoroutineAction action)
 {
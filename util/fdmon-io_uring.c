@@ -19,13 +19,22 @@
  * 4. Nanosecond timeouts are supported so it requires fewer syscalls than
  *    epoll(7).
  *
- * This code only monitors file descriptors and does not do asynchronous disk
- * I/O.  Implementing disk I/O efficiently has other requirements and should
- * use a separate io_uring so it does not make sense to unify the code.
+ * Other code running in the AioContext can submit its own requests, such as
+ * disk I/O, on the same ring with aio_add_sqe().  Their sqes are submitted by
+ * the io_uring_enter(2) call that waits for file descriptors, and their cqes
+ * are reaped together with the fd monitoring cqes, so the event loop does not
+ * need an extra system call or an extra file descriptor for them.  The cqe
+ * user_data field tells the two kinds of requests apart: a CqeHandler pointer
+ * has FDMON_IO_URING_CQE_HANDLER set in its low bit.
  *
  * File descriptor monitoring is implemented using the following operations:
  *
- * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.
+ * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.  Event
+ *    notifiers backed by an eventfd use multishot polls that stay armed after
+ *    they complete, because every write to an eventfd wakes up its pollers
+ *    even if the counter has not been read yet.  Other file descriptors rely on
+ *    level-triggered semantics, so their one-shot polls are re-armed after
+ *    each completion.
  * 2. IORING_OP_POLL_REMOVE - removes a file descriptor being monitored.  When
  *    the poll mask changes for a file descriptor it is first removed and then
  *    re-added with the new poll mask, so this operation is also used as part
@@ -38,9 +47,16 @@
  * the "cq ring".  Ring entries are called "sqe" and "cqe", respectively.
  *
  * The code is structured so that sq/cq rings are only modified within
- * fdmon_io_uring_wait().  Changes to AioHandlers are made by enqueuing them on
- * ctx->submit_list so that fdmon_io_uring_wait() can submit IORING_OP_POLL_ADD
- * and/or IORING_OP_POLL_REMOVE sqes for them.
+ * fdmon_io_uring_wait(), the gsource callbacks and aio_add_sqe(), which all run
+ * in the AioContext's home thread.  Changes to AioHandlers are made by
+ * enqueuing them on ctx->submit_list so that fdmon_io_uring_wait() or
+ * fdmon_io_uring_gsource_prepare() can submit IORING_OP_POLL_ADD and/or
+ * IORING_OP_POLL_REMOVE sqes for them.
+ *
+ * When the AioContext is used as a GSource, glib polls the ring fd instead of
+ * the file descriptors of the AioHandlers.  The ring fd becomes readable when
+ * cqes are ready, which are then processed by fdmon_io_uring_gsource_dispatch()
+ * just like fdmon_io_uring_wait() would.
  */
 
 #include "qemu/osdep.h"
@@ -55,6 +71,9 @@ enum {
     FDMON_IO_URING_PENDING  = (1 << 0),
     FDMON_IO_URING_ADD      = (1 << 1),
     FDMON_IO_URING_REMOVE   = (1 << 2),
+
+    /* Tag in cqe user_data for requests submitted with aio_add_sqe() */
+    FDMON_IO_URING_CQE_HANDLER = (1 << 0),
 };
 
 static inline int poll_events_from_pfd(int pfd_events)
@@ -75,7 +94,7 @@ static inline int pfd_events_from_poll(int poll_events)
 
 /*
  * Returns an sqe for submitting a request.  Only be called within
- * fdmon_io_uring_wait().
+ * fdmon_io_uring_wait() or aio_add_sqe() in the AioContext's home thread.
  */
 static struct io_uring_sqe *get_sqe(AioContext *ctx)
 {
@@ -171,7 +190,14 @@ static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
     struct io_uring_sqe *sqe = get_sqe(ctx);
     int events = poll_events_from_pfd(node->pfd.events);
 
-    io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+#ifdef HAVE_IO_URING_PREP_POLL_MULTISHOT
+    if (node->is_eventfd && ctx->fdmon_io_uring_multishot) {
+        io_uring_prep_poll_multishot(sqe, node->pfd.fd, events);
+    } else
+#endif
+    {
+        io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+    }
     io_uring_sqe_set_data(sqe, node);
 }
 
@@ -226,14 +252,41 @@ static bool process_cqe(AioContext *ctx,
                         AioHandlerList *ready_list,
                         struct io_uring_cqe *cqe)
 {
-    AioHandler *node = io_uring_cqe_get_data(cqe);
+    uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+    AioHandler *node;
     unsigned flags;
 
     /* poll_timeout and poll_remove have a zero user_data field */
-    if (!node) {
+    if (!data) {
         return false;
     }
 
+    if (data & FDMON_IO_URING_CQE_HANDLER) {
+        CqeHandler *cqe_handler =
+            (CqeHandler *)(data & ~(uintptr_t)FDMON_IO_URING_CQE_HANDLER);
+
+        cqe_handler->cqe = *cqe;
+        QSIMPLEQ_INSERT_TAIL(&ctx->cqe_handler_ready_list, cqe_handler, next);
+        ctx->cqe_handler_in_flight--;
+        return true;
+    }
+
+    node = (AioHandler *)data;
+
+    /*
+     * A multishot IORING_OP_POLL_ADD stays armed while IORING_CQE_F_MORE is
+     * set.  Only its last cqe may delete the handler, earlier ones are
+     * ignored once removal has been requested.
+     */
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        if (qatomic_read(&node->flags) & FDMON_IO_URING_REMOVE) {
+            return false;
+        }
+        aio_add_ready_handler(ready_list, node,
+                              pfd_events_from_poll(cqe->res));
+        return true;
+    }
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
@@ -245,9 +298,20 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    /* Kernels before 5.13 reject multishot polls, fall back to one-shot */
+    if (cqe->res == -EINVAL && node->is_eventfd &&
+        ctx->fdmon_io_uring_multishot) {
+        ctx->fdmon_io_uring_multishot = false;
+        add_poll_add_sqe(ctx, node);
+        return false;
+    }
+
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
-    /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
+    /*
+     * IORING_OP_POLL_ADD is one-shot, or the kernel terminated a multishot
+     * poll, so we must re-arm it
+     */
     add_poll_add_sqe(ctx, node);
     return true;
 }
@@ -278,6 +342,11 @@ static int fdmon_io_uring_wait(AioContext *ctx, AioHandlerList *ready_list,
     unsigned wait_nr = 1; /* block until at least one cqe is ready */
     int ret;
 
+    /* Don't block if a nested aio_poll() still has cqes to dispatch */
+    if (!QSIMPLEQ_EMPTY(&ctx->cqe_handler_ready_list)) {
+        timeout = 0;
+    }
+
     if (timeout == 0) {
         wait_nr = 0; /* non-blocking */
     } else if (timeout > 0) {
@@ -315,12 +384,80 @@ static bool fdmon_io_uring_need_wait(AioContext *ctx)
     return false;
 }
 
+bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    CqeHandler *cqe_handler;
+    bool progress = false;
+
+    /* Handlers may run a nested aio_poll(), so remove them one at a time */
+    while ((cqe_handler = QSIMPLEQ_FIRST(&ctx->cqe_handler_ready_list))) {
+        QSIMPLEQ_REMOVE_HEAD(&ctx->cqe_handler_ready_list, next);
+        cqe_handler->cb(cqe_handler);
+        progress = true;
+    }
+
+    return progress;
+}
+
+/* Is there work for fdmon_io_uring_gsource_dispatch()? */
+static bool fdmon_io_uring_gsource_check(AioContext *ctx)
+{
+    return io_uring_cq_ready(&ctx->fdmon_io_uring) ||
+           !QSIMPLEQ_EMPTY(&ctx->cqe_handler_ready_list);
+}
+
+/* Submit pending sqes because glib, not fdmon_io_uring_wait(), will wait */
+static bool fdmon_io_uring_gsource_prepare(AioContext *ctx)
+{
+    int ret;
+
+    fill_sq_ring(ctx);
+
+    if (io_uring_sq_ready(&ctx->fdmon_io_uring)) {
+        do {
+            ret = io_uring_submit(&ctx->fdmon_io_uring);
+        } while (ret == -EINTR);
+
+        assert(ret >= 0);
+    }
+
+    return fdmon_io_uring_gsource_check(ctx);
+}
+
+static void fdmon_io_uring_gsource_dispatch(AioContext *ctx,
+                                            AioHandlerList *ready_list)
+{
+    process_cq_ring(ctx, ready_list);
+}
+
 static const FDMonOps fdmon_io_uring_ops = {
     .update = fdmon_io_uring_update,
     .wait = fdmon_io_uring_wait,
     .need_wait = fdmon_io_uring_need_wait,
+    .gsource_prepare = fdmon_io_uring_gsource_prepare,
+    .gsource_check = fdmon_io_uring_gsource_check,
+    .gsource_dispatch = fdmon_io_uring_gsource_dispatch,
 };
 
+void aio_add_sqe(void (*prep_sqe)(struct io_uring_sqe *sqe, void *opaque),
+                 void *opaque, CqeHandler *cqe_handler)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    struct io_uring_sqe *sqe = get_sqe(ctx);
+
+    assert(aio_has_io_uring(ctx));
+
+    prep_sqe(sqe, opaque);
+    io_uring_sqe_set_data(sqe, (void *)((uintptr_t)cqe_handler |
+                                        FDMON_IO_URING_CQE_HANDLER));
+    ctx->cqe_handler_in_flight++;
+}
+
+bool aio_has_io_uring(AioContext *ctx)
+{
+    return ctx->fdmon_ops == &fdmon_io_uring_ops;
+}
+
 bool fdmon_io_uring_setup(AioContext *ctx)
 {
     int ret;
@@ -331,31 +468,96 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     }
 
     QSLIST_INIT(&ctx->submit_list);
+    QSIMPLEQ_INIT(&ctx->cqe_handler_ready_list);
+    ctx->cqe_handler_in_flight = 0;
+    ctx->fdmon_io_uring_multishot = true;
+    ctx->fdmon_io_uring_tag = g_source_add_unix_fd(&ctx->source,
+            ctx->fdmon_io_uring.ring_fd, G_IO_IN);
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     return true;
 }
 
+/*
+ * Wait for the aio_add_sqe() requests that are still in flight and call their
+ * ->cb().  Other cqes are dropped, except that AioHandlers due to be removed
+ * go to the deleted list.
+ */
+static void fdmon_io_uring_drain(AioContext *ctx)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    struct io_uring_cqe *cqe;
+    unsigned num_cqes;
+    unsigned head;
+    int ret;
+
+    for (;;) {
+        num_cqes = 0;
+        io_uring_for_each_cqe(ring, head, cqe) {
+            uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+
+            if (data & FDMON_IO_URING_CQE_HANDLER) {
+                process_cqe(ctx, NULL, cqe);
+            } else if (data && !(cqe->flags & IORING_CQE_F_MORE)) {
+                AioHandler *node = (AioHandler *)data;
+                unsigned flags = qatomic_fetch_and(&node->flags,
+                                                   ~FDMON_IO_URING_REMOVE);
+
+                if (flags & FDMON_IO_URING_REMOVE) {
+                    QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                          node_deleted);
+                }
+            }
+            num_cqes++;
+        }
+        io_uring_cq_advance(ring, num_cqes);
+
+        /* The callbacks may submit new requests */
+        fdmon_io_uring_dispatch(ctx);
+
+        if (!ctx->cqe_handler_in_flight) {
+            break;
+        }
+
+        do {
+            ret = io_uring_submit_and_wait(ring, 1);
+        } while (ret == -EINTR);
+
+        assert(ret >= 0);
+    }
+}
+
 void fdmon_io_uring_destroy(AioContext *ctx)
 {
-    if (ctx->fdmon_ops == &fdmon_io_uring_ops) {
-        AioHandler *node;
+    AioHandler *node;
 
-        io_uring_queue_exit(&ctx->fdmon_io_uring);
+    if (ctx->fdmon_ops != &fdmon_io_uring_ops) {
+        return;
+    }
 
-        /* Move handlers due to be removed onto the deleted list */
-        while ((node = QSLIST_FIRST_RCU(&ctx->submit_list))) {
-            unsigned flags = qatomic_fetch_and(&node->flags,
-                    ~(FDMON_IO_URING_PENDING |
-                      FDMON_IO_URING_ADD |
-                      FDMON_IO_URING_REMOVE));
+    fdmon_io_uring_drain(ctx);
+    io_uring_queue_exit(&ctx->fdmon_io_uring);
 
-            if (flags & FDMON_IO_URING_REMOVE) {
-                QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node, node_deleted);
-            }
+    /* Move handlers due to be removed onto the deleted list */
+    while ((node = QSLIST_FIRST_RCU(&ctx->submit_list))) {
+        unsigned flags = qatomic_fetch_and(&node->flags,
+                ~(FDMON_IO_URING_PENDING |
+                  FDMON_IO_URING_ADD |
+                  FDMON_IO_URING_REMOVE));
 
-            QSLIST_REMOVE_HEAD_RCU(&ctx->submit_list, node_submitted);
+        if (flags & FDMON_IO_URING_REMOVE) {
+            QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                  node_deleted);
         }
 
-        ctx->fdmon_ops = &fdmon_poll_ops;
+        QSLIST_REMOVE_HEAD_RCU(&ctx->submit_list, node_submitted);
+    }
+
+    /*
+     * This is only called when the AioContext is destroyed, so the file
+     * descriptors of the AioHandlers are not added back to the GSource.
+     */
+    if (!g_source_is_destroyed(&ctx->source)) {
+        g_source_remove_unix_fd(&ctx->source, ctx->fdmon_io_uring_tag);
     }
+    ctx->fdmon_ops = &fdmon_poll_ops;
 }
@@ -777,6 +777,19 @@ void qemu_free_stack(void *stack, size_t sz)
     munmap(stack, sz);
 }
 
+void qemu_trim_stack(void *stack, size_t sz, size_t keep)
+{
+#ifndef CONFIG_DEBUG_STACK_USAGE
+    size_t pagesz = qemu_real_host_page_size();
+
+    /* Stack grows down -- skip the guard page and keep the top. */
+    keep = ROUND_UP(keep, pagesz);
+    if (sz > pagesz + keep) {
+        qemu_madvise(stack + pagesz, sz - pagesz - keep, QEMU_MADV_DONTNEED);
+    }
+#endif
+}
+
 /*
  * Disable CFI checks.
  * We are going to call a signal handler directly. Such handler may or may not
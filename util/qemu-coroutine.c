@@ -44,6 +44,12 @@ enum {
  * .-------------------.
  * | Batch 1 | Batch 2 | per-thread local_pool (maximum 2 batches)
  * `-------------------'
+ *
+ * Batches only move to the global pool when a thread has more unused
+ * coroutines than its local pool holds, for example after a burst of I/O.
+ * The stacks in such a batch are cold, so most of their memory is given
+ * back to the host before the batch is published; stack pages are committed
+ * again only if a later coroutine goes that deep.
  */
 typedef struct CoroutinePoolBatch {
     /* Batches are kept in a list */
@@ -64,9 +70,51 @@ static CoroutinePool global_pool = QSLIST_HEAD_INITIALIZER(global_pool);
 static unsigned int global_pool_size;
 static unsigned int global_pool_max_size = COROUTINE_POOL_BATCH_MAX_SIZE;
 
+/*
+ * Statistics of a thread's local pool, see
+ * qemu_coroutine_foreach_local_pool()
+ */
+typedef struct CoroutineLocalPoolStats {
+    QSLIST_ENTRY(CoroutineLocalPoolStats) next;
+    int thread_id;
+    unsigned int size;
+    unsigned long reused;
+} CoroutineLocalPoolStats;
+
+/* Protected by global_pool_lock */
+static QSLIST_HEAD(, CoroutineLocalPoolStats) local_pool_stats_list =
+    QSLIST_HEAD_INITIALIZER(local_pool_stats_list);
+
+/* Coroutines that have a stack, whether running or pooled */
+static unsigned long coroutines_allocated;
+
+/* Pooled coroutines whose stack was trimmed */
+static unsigned long coroutines_trimmed;
+
 QEMU_DEFINE_STATIC_CO_TLS(CoroutinePool, local_pool);
+QEMU_DEFINE_STATIC_CO_TLS(CoroutineLocalPoolStats, local_pool_stats);
 QEMU_DEFINE_STATIC_CO_TLS(Notifier, local_pool_cleanup_notifier);
 
+/* Only called by the owner thread, which is the only writer */
+static void local_pool_stats_add(int n)
+{
+    CoroutineLocalPoolStats *stats = get_ptr_local_pool_stats();
+
+    qatomic_set(&stats->size, stats->size + n);
+}
+
+static Coroutine *coroutine_new(void)
+{
+    qatomic_inc(&coroutines_allocated);
+    return qemu_coroutine_new();
+}
+
+static void coroutine_free(Coroutine *co)
+{
+    qemu_coroutine_delete(co);
+    qatomic_dec(&coroutines_allocated);
+}
+
 static CoroutinePoolBatch *coroutine_pool_batch_new(void)
 {
     CoroutinePoolBatch *batch = g_new(CoroutinePoolBatch, 1);
@@ -83,14 +131,25 @@ static void coroutine_pool_batch_delete(CoroutinePoolBatch *batch)
 
     QSLIST_FOREACH_SAFE(co, &batch->list, pool_next, tmp) {
         QSLIST_REMOVE_HEAD(&batch->list, pool_next);
-        qemu_coroutine_delete(co);
+        coroutine_free(co);
     }
     g_free(batch);
 }
 
+static void coroutine_pool_batch_trim(CoroutinePoolBatch *batch)
+{
+    Coroutine *co;
+
+    QSLIST_FOREACH(co, &batch->list, pool_next) {
+        qemu_coroutine_trim(co);
+    }
+    qatomic_add(&coroutines_trimmed, batch->size);
+}
+
 static void local_pool_cleanup(Notifier *n, void *value)
 {
     CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutineLocalPoolStats *stats = get_ptr_local_pool_stats();
     CoroutinePoolBatch *batch;
     CoroutinePoolBatch *tmp;
 
@@ -98,15 +157,27 @@ static void local_pool_cleanup(Notifier *n, void *value)
         QSLIST_REMOVE_HEAD(local_pool, next);
         coroutine_pool_batch_delete(batch);
     }
+
+    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
+        QSLIST_REMOVE(&local_pool_stats_list, stats, CoroutineLocalPoolStats,
+                      next);
+    }
 }
 
-/* Ensure the atexit notifier is registered */
+/* Ensure the atexit notifier and the statistics are registered */
 static void local_pool_cleanup_init_once(void)
 {
     Notifier *notifier = get_ptr_local_pool_cleanup_notifier();
     if (!notifier->notify) {
+        CoroutineLocalPoolStats *stats = get_ptr_local_pool_stats();
+
         notifier->notify = local_pool_cleanup;
         qemu_thread_atexit_add(notifier);
+
+        stats->thread_id = qemu_get_thread_id();
+        WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
+            QSLIST_INSERT_HEAD(&local_pool_stats_list, stats, next);
+        }
     }
 }
 
@@ -124,6 +195,7 @@ static Coroutine *coroutine_pool_get_local(void)
     co = QSLIST_FIRST(&batch->list);
     QSLIST_REMOVE_HEAD(&batch->list, pool_next);
     batch->size--;
+    local_pool_stats_add(-1);
 
     if (batch->size == 0) {
         QSLIST_REMOVE_HEAD(local_pool, next);
@@ -150,27 +222,35 @@ static void coroutine_pool_refill_local(void)
     if (batch) {
         QSLIST_INSERT_HEAD(local_pool, batch, next);
         local_pool_cleanup_init_once();
+        local_pool_stats_add(batch->size);
     }
 }
 
 /* Add a batch of coroutines to the global pool */
 static void coroutine_pool_put_global(CoroutinePoolBatch *batch)
 {
-    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
-        unsigned int max = MIN(global_pool_max_size,
-                               global_pool_hard_max_size);
+    bool full;
 
-        if (global_pool_size < max) {
-            QSLIST_INSERT_HEAD(&global_pool, batch, next);
+    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
+        full = global_pool_size >= MIN(global_pool_max_size,
+                                       global_pool_hard_max_size);
+    }
 
-            /* Overshooting the max pool size is allowed */
-            global_pool_size += batch->size;
-            return;
-        }
+    if (full) {
+        /* The global pool was full, so throw away this batch */
+        coroutine_pool_batch_delete(batch);
+        return;
     }
 
-    /* The global pool was full, so throw away this batch */
-    coroutine_pool_batch_delete(batch);
+    /* Trim outside the lock, only the batches that are kept */
+    coroutine_pool_batch_trim(batch);
+
+    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
+        QSLIST_INSERT_HEAD(&global_pool, batch, next);
+
+        /* Overshooting the max pool size is allowed */
+        global_pool_size += batch->size;
+    }
 }
 
 /* Get the next unused coroutine from the pool or return NULL */
@@ -183,6 +263,11 @@ static Coroutine *coroutine_pool_get(void)
         coroutine_pool_refill_local();
         co = coroutine_pool_get_local();
     }
+    if (co) {
+        CoroutineLocalPoolStats *stats = get_ptr_local_pool_stats();
+
+        qatomic_set(&stats->reused, stats->reused + 1);
+    }
     return co;
 }
 
@@ -203,6 +288,7 @@ static void coroutine_pool_put(Coroutine *co)
         /* Is the local pool full? */
         if (next) {
             QSLIST_REMOVE_HEAD(local_pool, next);
+            local_pool_stats_add(-(int)batch->size);
             coroutine_pool_put_global(batch);
         }
 
@@ -212,6 +298,7 @@ static void coroutine_pool_put(Coroutine *co)
 
     QSLIST_INSERT_HEAD(&batch->list, co, pool_next);
     batch->size++;
+    local_pool_stats_add(1);
 }
 
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
@@ -223,7 +310,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     }
 
     if (!co) {
-        co = qemu_coroutine_new();
+        co = coroutine_new();
     }
 
     co->entry = entry;
@@ -239,7 +326,7 @@ static void coroutine_delete(Coroutine *co)
     if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
         coroutine_pool_put(co);
     } else {
-        qemu_coroutine_delete(co);
+        coroutine_free(co);
     }
 }
 
@@ -361,6 +448,29 @@ void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size)
     global_pool_max_size -= removing_pool_size;
 }
 
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats)
+{
+    QEMU_LOCK_GUARD(&global_pool_lock);
+    stats->stack_size = COROUTINE_STACK_SIZE;
+    stats->allocated = qatomic_read(&coroutines_allocated);
+    stats->trimmed = qatomic_read(&coroutines_trimmed);
+    stats->global_size = global_pool_size;
+    stats->global_max_size = MIN(global_pool_max_size,
+                                 global_pool_hard_max_size);
+}
+
+void qemu_coroutine_foreach_local_pool(CoroutineLocalPoolFunc *fn,
+                                       void *opaque)
+{
+    CoroutineLocalPoolStats *stats;
+
+    QEMU_LOCK_GUARD(&global_pool_lock);
+    QSLIST_FOREACH(stats, &local_pool_stats_list, next) {
+        fn(stats->thread_id, qatomic_read(&stats->size),
+           qatomic_read(&stats->reused), opaque);
+    }
+}
+
 static unsigned int get_global_pool_hard_max_size(void)
 {
 #ifdef __linux__
@@ -26,6 +26,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/timer.h"
 #include "qemu/lockable.h"
+#include "qemu/host-utils.h"
 #include "system/cpu-timers.h"
 #include "exec/icount.h"
 #include "system/replay.h"
@@ -64,6 +65,24 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * reenabling the clock can call all the notifiers.
  */
 
+/*
+ * Only the timers that expire in the current granule of the clock, or
+ * earlier, are kept in the sorted active_timers list.  Later timers go into
+ * a hierarchical timing wheel, so that arming and deleting them is O(1)
+ * however many timers there are.
+ *
+ * Slots are indexed by the absolute granule of the expire time, six bits per
+ * level.  A timer is filed in the level of the most significant digit where
+ * its granule differs from wheel_clk, so the slots of each level that hold
+ * timers all come after the digit of wheel_clk, and all timers of a level
+ * expire before those of the levels above.  When wheel_clk enters a slot,
+ * its timers are filed again, at lower levels or in active_timers.
+ */
+#define TIMER_WHEEL_GRANULE_BITS 16     /* 65.5 us */
+#define TIMER_WHEEL_LEVEL_BITS   6
+#define TIMER_WHEEL_SLOTS        (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS       8      /* 16 + 8 * 6 bits cover INT64_MAX */
+
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
@@ -74,6 +93,14 @@ struct QEMUTimerList {
 
     /* lightweight method to mark the end of timerlist's running */
     QemuEvent timers_done_ev;
+
+    /* Protected by active_timers_lock, see above */
+    uint64_t next_seq;
+    int64_t wheel_clk;              /* granule */
+    unsigned int wheel_count;       /* also read without the lock */
+    QEMUTimer *wheel_first;         /* NULL if unknown */
+    uint64_t wheel_pending[TIMER_WHEEL_LEVELS];
+    QEMUTimer *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
 };
 
 /**
@@ -94,6 +121,216 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+/* Timers with the same expire time run in the order they were armed */
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+static inline int64_t timer_granule(int64_t expire_time)
+{
+    return expire_time >> TIMER_WHEEL_GRANULE_BITS;
+}
+
+static inline int timer_wheel_level(int64_t clk, int64_t granule)
+{
+    return (63 - clz64(clk ^ granule)) / TIMER_WHEEL_LEVEL_BITS;
+}
+
+static inline int timer_wheel_slot(int64_t granule, int level)
+{
+    return (granule >> (level * TIMER_WHEEL_LEVEL_BITS)) &
+           (TIMER_WHEEL_SLOTS - 1);
+}
+
+static void timer_link(QEMUTimer **pt, QEMUTimer *ts)
+{
+    ts->next = *pt;
+    ts->pprev = pt;
+    if (ts->next) {
+        ts->next->pprev = &ts->next;
+    }
+    qatomic_set(pt, ts);
+}
+
+static void timer_unlink(QEMUTimer *ts)
+{
+    if (ts->next) {
+        ts->next->pprev = ts->pprev;
+    }
+    qatomic_set(ts->pprev, ts->next);
+    ts->next = NULL;
+    ts->pprev = NULL;
+}
+
+/* Returns true if @ts is now the first timer of @timer_list */
+static bool timerlist_add_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int64_t granule = timer_granule(ts->expire_time);
+    QEMUTimer **pt;
+    int level, slot;
+
+    if (granule <= timer_list->wheel_clk) {
+        /* add the timer in the sorted list */
+        pt = &timer_list->active_timers;
+        while (*pt && !timer_before(ts, *pt)) {
+            pt = &(*pt)->next;
+        }
+        timer_link(pt, ts);
+        return pt == &timer_list->active_timers;
+    }
+
+    level = timer_wheel_level(timer_list->wheel_clk, granule);
+    slot = timer_wheel_slot(granule, level);
+    timer_link(&timer_list->wheel[level][slot], ts);
+    timer_list->wheel_pending[level] |= 1ULL << slot;
+
+    if (!timer_list->wheel_count) {
+        timer_list->wheel_first = ts;
+    } else if (timer_list->wheel_first &&
+               timer_before(ts, timer_list->wheel_first)) {
+        timer_list->wheel_first = ts;
+    }
+    qatomic_set(&timer_list->wheel_count, timer_list->wheel_count + 1);
+
+    /* If the first timer is unknown, assume the deadline changed */
+    return !timer_list->active_timers &&
+           (!timer_list->wheel_first || timer_list->wheel_first == ts);
+}
+
+static void timerlist_remove_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int64_t granule = timer_granule(ts->expire_time);
+    int level, slot;
+
+    timer_unlink(ts);
+    if (granule <= timer_list->wheel_clk) {
+        return;
+    }
+
+    level = timer_wheel_level(timer_list->wheel_clk, granule);
+    slot = timer_wheel_slot(granule, level);
+    if (!timer_list->wheel[level][slot]) {
+        timer_list->wheel_pending[level] &= ~(1ULL << slot);
+    }
+    if (timer_list->wheel_first == ts) {
+        timer_list->wheel_first = NULL;
+    }
+    qatomic_set(&timer_list->wheel_count, timer_list->wheel_count - 1);
+}
+
+/* The first timer in the wheel is in the first slot of the lowest level */
+static QEMUTimer *timerlist_wheel_first_locked(QEMUTimerList *timer_list)
+{
+    QEMUTimer *ts;
+    int level;
+
+    if (timer_list->wheel_first || !timer_list->wheel_count) {
+        return timer_list->wheel_first;
+    }
+
+    for (level = 0; !timer_list->wheel_pending[level]; level++) {
+        /* nothing */
+    }
+    ts = timer_list->wheel[level][ctz64(timer_list->wheel_pending[level])];
+    timer_list->wheel_first = ts;
+    for (ts = ts->next; ts; ts = ts->next) {
+        if (timer_before(ts, timer_list->wheel_first)) {
+            timer_list->wheel_first = ts;
+        }
+    }
+    return timer_list->wheel_first;
+}
+
+static QEMUTimer *timerlist_first_locked(QEMUTimerList *timer_list)
+{
+    if (timer_list->active_timers) {
+        return timer_list->active_timers;
+    }
+    return timerlist_wheel_first_locked(timer_list);
+}
+
+/* First timer whose attributes are all in @attr_mask */
+static QEMUTimer *timerlist_first_attr_locked(QEMUTimerList *timer_list,
+                                              int attr_mask)
+{
+    QEMUTimer *first = NULL;
+    QEMUTimer *ts;
+    uint64_t pending;
+    int level;
+
+    for (ts = timer_list->active_timers; ts; ts = ts->next) {
+        if (!(ts->attributes & ~attr_mask)) {
+            return ts;
+        }
+    }
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        pending = timer_list->wheel_pending[level];
+        for (; pending; pending &= pending - 1) {
+            ts = timer_list->wheel[level][ctz64(pending)];
+            for (; ts; ts = ts->next) {
+                if (!(ts->attributes & ~attr_mask) &&
+                    (!first || timer_before(ts, first))) {
+                    first = ts;
+                }
+            }
+            if (first) {
+                return first;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Move wheel_clk forward to the granule of @current_time, filing again the
+ * timers of each slot that it enters on the way.
+ */
+static void timerlist_advance_locked(QEMUTimerList *timer_list,
+                                     int64_t current_time)
+{
+    int64_t target = timer_granule(current_time);
+
+    while (timer_list->wheel_clk < target) {
+        int64_t start = INT64_MAX;
+        QEMUTimer *ts, *next;
+        int level, slot = 0;
+        int shift;
+
+        /* Find the earliest slot that holds timers */
+        for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            if (timer_list->wheel_pending[level]) {
+                shift = level * TIMER_WHEEL_LEVEL_BITS;
+                slot = ctz64(timer_list->wheel_pending[level]);
+                start = timer_list->wheel_clk &
+                        ~(((int64_t)TIMER_WHEEL_SLOTS << shift) - 1);
+                start |= (int64_t)slot << shift;
+                break;
+            }
+        }
+
+        /* No slot is entered, so no timer changes level */
+        if (start > target) {
+            timer_list->wheel_clk = target;
+            break;
+        }
+
+        timer_list->wheel_clk = start;
+        ts = timer_list->wheel[level][slot];
+        timer_list->wheel[level][slot] = NULL;
+        timer_list->wheel_pending[level] &= ~(1ULL << slot);
+        timer_list->wheel_first = NULL;
+        for (; ts; ts = next) {
+            next = ts->next;
+            qatomic_set(&timer_list->wheel_count,
+                        timer_list->wheel_count - 1);
+            timerlist_add_locked(timer_list, ts);
+        }
+    }
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -172,7 +409,8 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!qatomic_read(&timer_list->active_timers);
+    return qatomic_read(&timer_list->active_timers) ||
+           qatomic_read(&timer_list->wheel_count);
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -183,17 +421,19 @@ bool qemu_clock_has_timers(QEMUClockType type)
 
 bool timerlist_expired(QEMUTimerList *timer_list)
 {
+    QEMUTimer *ts;
     int64_t expire_time = 0;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return false;
     }
 
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        ts = timerlist_first_locked(timer_list);
+        if (!ts) {
             return false;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = ts->expire_time;
     }
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -212,10 +452,11 @@ bool qemu_clock_expired(QEMUClockType type)
 
 int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
 {
+    QEMUTimer *ts;
     int64_t delta;
     int64_t expire_time = 0;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return -1;
     }
 
@@ -228,10 +469,11 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        ts = timerlist_first_locked(timer_list);
+        if (!ts) {
             return -1;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = ts->expire_time;
     }
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -262,15 +504,12 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
     }
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
-        if (!qatomic_read(&timer_list->active_timers)) {
+        if (!timerlist_has_timers(timer_list)) {
             continue;
         }
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
         /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
-        }
+        ts = timerlist_first_attr_locked(timer_list, attr_mask);
         if (!ts) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
             continue;
@@ -371,41 +610,18 @@ void timer_deinit(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
-
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            qatomic_set(pt, t->next);
-            break;
-        }
-        pt = &t->next;
+    if (timer_pending(ts)) {
+        timerlist_remove_locked(timer_list, ts);
     }
+    ts->expire_time = -1;
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
-    }
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    qatomic_set(pt, ts);
-
-    return pt == &timer_list->active_timers;
+    ts->seq = timer_list->next_seq++;
+    return timerlist_add_locked(timer_list, ts);
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -493,7 +709,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     QEMUTimerCB *cb;
     void *opaque;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return false;
     }
 
@@ -532,6 +748,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
      */
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     qemu_mutex_lock(&timer_list->active_timers_lock);
+    timerlist_advance_locked(timer_list, current_time);
     while ((ts = timer_list->active_timers)) {
         if (!timer_expired_ns(ts, current_time)) {
             /* No expired timers left.  The checkpoint can be skipped
@@ -552,8 +769,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
+        timer_unlink(ts);
         ts->expire_time = -1;
         cb = ts->cb;
         opaque = ts->opaque;
@@ -90,6 +90,17 @@
 #define QHT_BUCKET_ENTRIES 4
 #endif
 
+/*
+ * Lookups compare all the hashes of a bucket at once with a vector compare,
+ * where the host supports it. TSAN cannot see vector loads as atomic, so
+ * it gets the scalar version.
+ */
+#ifdef CONFIG_TSAN
+#include "host/include/generic/host/qht-match.h.inc"
+#else
+#include "host/qht-match.h.inc"
+#endif
+
 enum qht_iter_type {
     QHT_ITER_VOID,    /* do nothing; use retvoid */
     QHT_ITER_RM,      /* remove element if retbool returns true */
@@ -142,9 +153,9 @@ static inline void qht_unlock(struct qht *ht)
  * be grabbed first.
  */
 struct qht_bucket {
+    uint32_t hashes[QHT_BUCKET_ENTRIES]; /* first, for aligned vector loads */
     QemuSpin lock;
     QemuSeqLock sequence;
-    uint32_t hashes[QHT_BUCKET_ENTRIES];
     void *pointers[QHT_BUCKET_ENTRIES];
     struct qht_bucket *next;
 } QEMU_ALIGNED(QHT_BUCKET_ALIGN);
@@ -556,20 +567,20 @@ void *qht_do_lookup(const struct qht_bucket *head, qht_lookup_func_t func,
                     const void *userp, uint32_t hash)
 {
     const struct qht_bucket *b = head;
-    int i;
 
     do {
-        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
-            if (qatomic_read(&b->hashes[i]) == hash) {
-                /* The pointer is dereferenced before seqlock_read_retry,
-                 * so (unlike qht_insert__locked) we need to use
-                 * qatomic_rcu_read here.
-                 */
-                void *p = qatomic_rcu_read(&b->pointers[i]);
-
-                if (likely(p) && likely(func(p, userp))) {
-                    return p;
-                }
+        uint64_t match = qht_hashes_match(b->hashes, hash);
+
+        for (; match; match &= match - 1) {
+            int i = ctz64(match) / QHT_MATCH_STRIDE;
+            /* The pointer is dereferenced before seqlock_read_retry,
+             * so (unlike qht_insert__locked) we need to use
+             * qatomic_rcu_read here.
+             */
+            void *p = qatomic_rcu_read(&b->pointers[i]);
+
+            if (likely(p) && likely(func(p, userp))) {
+                return p;
             }
         }
         b = qatomic_rcu_read(&b->next);
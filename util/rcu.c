@@ -46,10 +46,23 @@
 unsigned long rcu_gp_ctr = RCU_GP_LOCKED;
 
 QemuEvent rcu_gp_event;
-static int in_drain_call_rcu;
+
+/*
+ * Nonzero while drain_call_rcu() waits or an expedited grace period runs:
+ * readers are asked to leave their critical sections through their
+ * force_rcu notifiers, and the call_rcu thread does not wait for
+ * callbacks to pile up.
+ */
+static int rcu_expedited;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/*
+ * Number of grace periods started plus number completed, so that it is
+ * odd while one is in progress.  Written under rcu_sync_lock.
+ */
+static unsigned long rcu_gp_seq;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -106,7 +119,7 @@ static void wait_for_readers(void)
                  * get some extra futex wakeups.
                  */
                 qatomic_set(&index->waiting, false);
-            } else if (qatomic_read(&in_drain_call_rcu)) {
+            } else if (qatomic_read(&rcu_expedited)) {
                 notifier_list_notify(&index->force_rcu, NULL);
             }
         }
@@ -143,8 +156,26 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    unsigned long snap;
+
+    /*
+     * Concurrent callers share grace periods: any grace period that
+     * starts after this point also covers our updates, so wait for the
+     * end of the next one to start (or of the one after, if one is
+     * already in progress).  Order our updates before the read of
+     * rcu_gp_seq, like get_state_synchronize_rcu() in Linux.
+     */
+    smp_mb();
+    snap = (qatomic_read(&rcu_gp_seq) + 3) & ~1UL;
+
     QEMU_LOCK_GUARD(&rcu_sync_lock);
 
+    /* Pairs with qatomic_store_release() below.  */
+    if ((long)(qatomic_load_acquire(&rcu_gp_seq) - snap) >= 0) {
+        return;
+    }
+    qatomic_set(&rcu_gp_seq, rcu_gp_seq + 1);
+
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
      *
@@ -171,6 +202,8 @@ void synchronize_rcu(void)
 
         wait_for_readers();
     }
+
+    qatomic_store_release(&rcu_gp_seq, rcu_gp_seq + 1);
 }
 
 
@@ -178,13 +211,42 @@ void synchronize_rcu(void)
 
 /* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
+ *
+ * There are several queues, so that threads calling call_rcu() at the
+ * same time do not all bounce the same tail pointer.  Each thread always
+ * uses the same queue, so callbacks still run in the order in which a
+ * thread registered them.
  */
-static struct rcu_head dummy;
-static struct rcu_head *head = &dummy, **tail = &dummy.next;
+#define RCU_CALL_QUEUES          8
+
+typedef struct RCUCallQueue {
+    struct rcu_head dummy;
+    struct rcu_head *head, **tail;
+    int count;
+} QEMU_ALIGNED(64) RCUCallQueue;
+
+static RCUCallQueue rcu_call_queues[RCU_CALL_QUEUES];
 static int rcu_call_count;
+/* Set by call_rcu1_expedited(), taken by the call_rcu thread.  */
+static bool rcu_call_expedite;
+static unsigned rcu_call_next_queue;
 static QemuEvent rcu_call_ready_event;
 
-static void enqueue(struct rcu_head *node)
+/* Index in rcu_call_queues plus one, or zero if not chosen yet.  */
+QEMU_DEFINE_STATIC_CO_TLS(unsigned, rcu_call_queue_idx)
+
+static RCUCallQueue *rcu_call_queue(void)
+{
+    unsigned idx = get_rcu_call_queue_idx();
+
+    if (!idx) {
+        idx = qatomic_fetch_inc(&rcu_call_next_queue) % RCU_CALL_QUEUES + 1;
+        set_rcu_call_queue_idx(idx);
+    }
+    return &rcu_call_queues[idx - 1];
+}
+
+static void enqueue(RCUCallQueue *q, struct rcu_head *node)
 {
     struct rcu_head **old_tail;
 
@@ -195,7 +257,7 @@ static void enqueue(struct rcu_head *node)
      * used by further enqueue operations, but it will not
      * be dequeued yet...
      */
-    old_tail = qatomic_xchg(&tail, &node->next);
+    old_tail = qatomic_xchg(&q->tail, &node->next);
 
     /*
      * ... until it is pointed to from another item in the list.
@@ -207,13 +269,13 @@ static void enqueue(struct rcu_head *node)
     qatomic_store_release(old_tail, node);
 }
 
-static struct rcu_head *try_dequeue(void)
+static struct rcu_head *try_dequeue(RCUCallQueue *q)
 {
     struct rcu_head *node, *next;
 
 retry:
     /* Head is only written by this thread, so no need for barriers.  */
-    node = head;
+    node = q->head;
 
     /*
      * If the head node has NULL in its next pointer, the value is
@@ -231,7 +293,7 @@ retry:
      * The tail, because it is the first step in the enqueuing.
      * It is only the next pointers that might be inconsistent.
      */
-    if (head == &dummy && qatomic_read(&tail) == &dummy.next) {
+    if (q->head == &q->dummy && qatomic_read(&q->tail) == &q->dummy.next) {
         abort();
     }
 
@@ -241,11 +303,11 @@ retry:
      * dummy node, and the one being removed.  So we do not need to update
      * the tail pointer.
      */
-    head = next;
+    q->head = next;
 
     /* If we dequeued the dummy node, add it back at the end and retry.  */
-    if (node == &dummy) {
-        enqueue(node);
+    if (node == &q->dummy) {
+        enqueue(q, node);
         goto retry;
     }
 
@@ -259,14 +321,19 @@ static void *call_rcu_thread(void *opaque)
     rcu_register_thread();
 
     for (;;) {
+        int counts[RCU_CALL_QUEUES];
         int tries = 0;
         int n = qatomic_read(&rcu_call_count);
+        bool expedite;
+        int i;
 
-        /* Heuristically wait for a decent number of callbacks to pile up.
-         * Fetch rcu_call_count now, we only must process elements that were
-         * added before synchronize_rcu() starts.
+        /*
+         * Heuristically wait for a decent number of callbacks to pile up,
+         * unless somebody is waiting for them.
          */
-        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
+        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5 &&
+                          !qatomic_read(&rcu_expedited) &&
+                          !qatomic_read(&rcu_call_expedite))) {
             g_usleep(10000);
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
@@ -281,48 +348,98 @@ static void *call_rcu_thread(void *opaque)
             n = qatomic_read(&rcu_call_count);
         }
 
-        qatomic_sub(&rcu_call_count, n);
-        synchronize_rcu();
+        /*
+         * Fetch the counts now, we only must process elements that were
+         * added before synchronize_rcu() starts.  Take the expedite
+         * request first: the callbacks queued before it are then
+         * included in the counts.
+         */
+        expedite = qatomic_xchg(&rcu_call_expedite, false);
+        for (i = 0; i < RCU_CALL_QUEUES; i++) {
+            counts[i] = qatomic_read(&rcu_call_queues[i].count);
+            qatomic_sub(&rcu_call_queues[i].count, counts[i]);
+            qatomic_sub(&rcu_call_count, counts[i]);
+        }
+        if (expedite) {
+            qatomic_inc(&rcu_expedited);
+            synchronize_rcu();
+            qatomic_dec(&rcu_expedited);
+        } else {
+            synchronize_rcu();
+        }
         bql_lock();
-        while (n > 0) {
-            node = try_dequeue();
-            while (!node) {
-                bql_unlock();
-                qemu_event_reset(&rcu_call_ready_event);
-                node = try_dequeue();
-                if (!node) {
-                    qemu_event_wait(&rcu_call_ready_event);
-                    node = try_dequeue();
+        for (i = 0; i < RCU_CALL_QUEUES; i++) {
+            RCUCallQueue *q = &rcu_call_queues[i];
+
+            for (n = counts[i]; n > 0; n--) {
+                node = try_dequeue(q);
+                while (!node) {
+                    bql_unlock();
+                    qemu_event_reset(&rcu_call_ready_event);
+                    node = try_dequeue(q);
+                    if (!node) {
+                        qemu_event_wait(&rcu_call_ready_event);
+                        node = try_dequeue(q);
+                    }
+                    bql_lock();
                 }
-                bql_lock();
-            }
 
-            n--;
-            node->func(node);
+                node->func(node);
+            }
         }
         bql_unlock();
     }
     abort();
 }
 
-void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
+static void call_rcu_on_queue(RCUCallQueue *q, struct rcu_head *node,
+                              RCUCBFunc *func)
 {
     node->func = func;
-    enqueue(node);
+    enqueue(q, node);
+    qatomic_inc(&q->count);
     qatomic_inc(&rcu_call_count);
     qemu_event_set(&rcu_call_ready_event);
 }
 
+void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
+{
+    call_rcu_on_queue(rcu_call_queue(), node, func);
+}
 
-struct rcu_drain {
+void call_rcu1_expedited(struct rcu_head *node,
+                         void (*func)(struct rcu_head *node))
+{
+    call_rcu_on_queue(rcu_call_queue(), node, func);
+
+    /*
+     * After the counts are incremented, so that the batch that takes the
+     * request also runs the callback; see call_rcu_thread().
+     */
+    qatomic_set(&rcu_call_expedite, true);
+}
+
+
+struct rcu_drain_node {
     struct rcu_head rcu;
+    struct rcu_drain *drain;
+};
+
+struct rcu_drain {
+    struct rcu_drain_node nodes[RCU_CALL_QUEUES];
+    int pending;
     QemuEvent drain_complete_event;
 };
 
 static void drain_rcu_callback(struct rcu_head *node)
 {
-    struct rcu_drain *event = (struct rcu_drain *)node;
-    qemu_event_set(&event->drain_complete_event);
+    struct rcu_drain *drain = container_of(node, struct rcu_drain_node,
+                                           rcu)->drain;
+
+    /* Callbacks run in the call_rcu thread, no need for atomics.  */
+    if (--drain->pending == 0) {
+        qemu_event_set(&drain->drain_complete_event);
+    }
 }
 
 /*
@@ -338,9 +455,11 @@ void drain_call_rcu(void)
 {
     struct rcu_drain rcu_drain;
     bool locked = bql_locked();
+    int i;
 
     memset(&rcu_drain, 0, sizeof(struct rcu_drain));
     qemu_event_init(&rcu_drain.drain_complete_event, false);
+    rcu_drain.pending = RCU_CALL_QUEUES;
 
     if (locked) {
         bql_unlock();
@@ -349,20 +468,24 @@ void drain_call_rcu(void)
 
     /*
      * RCU callbacks are invoked in the same order as in which they
-     * are registered, thus we can be sure that when 'drain_rcu_callback'
-     * is called, all RCU callbacks that were registered on this thread
-     * prior to calling this function are completed.
+     * are registered on each queue, thus we can be sure that when
+     * 'drain_rcu_callback' has been called on all queues, all RCU
+     * callbacks that were registered on this thread prior to calling
+     * this function are completed.
      *
-     * Note that since we have only one global queue of the RCU callbacks,
-     * we also end up waiting for most of RCU callbacks that were registered
-     * on the other threads, but this is a side effect that shouldn't be
-     * assumed.
+     * Note that since we go through all the queues, we also end up
+     * waiting for RCU callbacks that were registered on the other
+     * threads, but this is a side effect that shouldn't be assumed.
      */
 
-    qatomic_inc(&in_drain_call_rcu);
-    call_rcu1(&rcu_drain.rcu, drain_rcu_callback);
+    qatomic_inc(&rcu_expedited);
+    for (i = 0; i < RCU_CALL_QUEUES; i++) {
+        rcu_drain.nodes[i].drain = &rcu_drain;
+        call_rcu_on_queue(&rcu_call_queues[i], &rcu_drain.nodes[i].rcu,
+                          drain_rcu_callback);
+    }
     qemu_event_wait(&rcu_drain.drain_complete_event);
-    qatomic_dec(&in_drain_call_rcu);
+    qatomic_dec(&rcu_expedited);
 
     if (locked) {
         bql_lock();
@@ -464,6 +587,12 @@ static void rcu_init_child(void)
 
 static void __attribute__((__constructor__)) rcu_init(void)
 {
+    int i;
+
+    for (i = 0; i < RCU_CALL_QUEUES; i++) {
+        rcu_call_queues[i].head = &rcu_call_queues[i].dummy;
+        rcu_call_queues[i].tail = &rcu_call_queues[i].dummy.next;
+    }
     smp_mb_global_init();
 #ifdef CONFIG_POSIX
     pthread_atfork(rcu_init_lock, rcu_init_unlock, rcu_init_child);
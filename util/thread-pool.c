@@ -27,29 +27,46 @@ static void do_spawn_thread(ThreadPoolAio *pool);
 
 typedef struct ThreadPoolElementAio ThreadPoolElementAio;
 
+/*
+ * Requests are spread over several queues so that submitters and workers
+ * rarely contend on the same lock.  Each worker has a home queue, and steals
+ * from the other queues when its home queue is empty.
+ */
+#define THREAD_POOL_QUEUES 8
+
 enum ThreadState {
     THREAD_QUEUED,
     THREAD_ACTIVE,
     THREAD_DONE,
 };
 
+typedef struct ThreadPoolQueue {
+    QemuMutex lock;
+    QTAILQ_HEAD(, ThreadPoolElementAio) request_list;
+} ThreadPoolQueue;
+
 struct ThreadPoolElementAio {
     BlockAIOCB common;
     ThreadPoolAio *pool;
     ThreadPoolFunc *func;
     void *arg;
 
-    /* Moving state out of THREAD_QUEUED is protected by lock.  After
-     * that, only the worker thread can write to it.  Reads and writes
-     * of state and ret are ordered with memory barriers.
+    /*
+     * Moving state out of THREAD_QUEUED is protected by queue->lock.  After
+     * that, only the worker thread can write to it.
      */
     enum ThreadState state;
     int ret;
 
-    /* Access to this list is protected by lock.  */
+    /* Access to this list is protected by queue->lock.  */
+    ThreadPoolQueue *queue;
     QTAILQ_ENTRY(ThreadPoolElementAio) reqs;
 
-    /* This list is only written by the thread pool's mother thread.  */
+    /* Pushed atomically by the thread that completes the request.  */
+    QSLIST_ENTRY(ThreadPoolElementAio) completed;
+
+    /* These lists are only accessed by the thread pool's mother thread.  */
+    QSIMPLEQ_ENTRY(ThreadPoolElementAio) ready;
     QLIST_ENTRY(ThreadPoolElementAio) all;
 };
 
@@ -63,35 +80,106 @@ struct ThreadPoolAio {
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElementAio) head;
+    QSIMPLEQ_HEAD(, ThreadPoolElementAio) ready_list;
+    unsigned next_queue;
 
-    /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElementAio) request_list;
+    /* Requests whose result is ready, most recent first.  */
+    QSLIST_HEAD(, ThreadPoolElementAio) completed_list;
+
+    /*
+     * Number of requests on the queues.  Written with the queue's lock taken
+     * and read atomically.
+     */
+    int queued;
+    ThreadPoolQueue queues[THREAD_POOL_QUEUES];
+
+    /*
+     * The following variables are protected by lock.  cur_threads and
+     * idle_threads are also read without it, so they are written atomically.
+     */
     int cur_threads;
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
     int pending_threads; /* threads created but not running yet */
     int min_threads;
     int max_threads;
+    unsigned next_home;  /* home queue for the next worker */
 };
 
+/*
+ * Take the oldest request from the @home queue, or from another queue if that
+ * one is empty.  Returns NULL if all queues are empty.
+ */
+static ThreadPoolElementAio *thread_pool_take_request(ThreadPoolAio *pool,
+                                                      unsigned home)
+{
+    ThreadPoolElementAio *req = NULL;
+    unsigned i;
+
+    for (i = 0; i < THREAD_POOL_QUEUES && qatomic_read(&pool->queued); i++) {
+        ThreadPoolQueue *queue = &pool->queues[(home + i) % THREAD_POOL_QUEUES];
+
+        qemu_mutex_lock(&queue->lock);
+        req = QTAILQ_FIRST(&queue->request_list);
+        if (req) {
+            QTAILQ_REMOVE(&queue->request_list, req, reqs);
+            req->state = THREAD_ACTIVE;
+            qatomic_dec(&pool->queued);
+        }
+        qemu_mutex_unlock(&queue->lock);
+
+        if (req) {
+            break;
+        }
+    }
+
+    return req;
+}
+
+/* Hand a request back to the pool's AioContext */
+static void thread_pool_complete(ThreadPoolAio *pool, ThreadPoolElementAio *req)
+{
+    ThreadPoolElementAio *old;
+
+    do {
+        old = qatomic_read(&pool->completed_list.slh_first);
+        req->completed.sle_next = old;
+    } while (qatomic_cmpxchg(&pool->completed_list.slh_first, old, req) != old);
+
+    /* Requests that complete while the bottom half is pending are batched */
+    if (!old) {
+        qemu_bh_schedule(pool->completion_bh);
+    }
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPoolAio *pool = opaque;
+    unsigned home;
 
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
     do_spawn_thread(pool);
+    home = pool->next_home++ % THREAD_POOL_QUEUES;
 
     while (pool->cur_threads <= pool->max_threads) {
         ThreadPoolElementAio *req;
         int ret;
 
-        if (QTAILQ_EMPTY(&pool->request_list)) {
-            pool->idle_threads++;
-            ret = qemu_cond_timedwait(&pool->request_cond, &pool->lock, 10000);
-            pool->idle_threads--;
+        if (!qatomic_read(&pool->queued)) {
+            qatomic_set(&pool->idle_threads, pool->idle_threads + 1);
+
+            /* Write idle_threads before reading queued, pairs with submit */
+            smp_mb();
+
+            ret = 1;
+            if (!qatomic_read(&pool->queued)) {
+                ret = qemu_cond_timedwait(&pool->request_cond, &pool->lock,
+                                          10000);
+            }
+            qatomic_set(&pool->idle_threads, pool->idle_threads - 1);
             if (ret == 0 &&
-                QTAILQ_EMPTY(&pool->request_list) &&
+                !qatomic_read(&pool->queued) &&
                 pool->cur_threads > pool->min_threads) {
                 /* Timed out + no work to do + no need for warm threads = exit.  */
                 break;
@@ -103,23 +191,17 @@ static void *worker_thread(void *opaque)
             continue;
         }
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
-        req->state = THREAD_ACTIVE;
+        /* Run requests until the queues are empty without taking lock */
         qemu_mutex_unlock(&pool->lock);
-
-        ret = req->func(req->arg);
-
-        req->ret = ret;
-        /* Write ret before state.  */
-        smp_wmb();
-        req->state = THREAD_DONE;
-
-        qemu_bh_schedule(pool->completion_bh);
+        while ((req = thread_pool_take_request(pool, home))) {
+            req->ret = req->func(req->arg);
+            req->state = THREAD_DONE;
+            thread_pool_complete(pool, req);
+        }
         qemu_mutex_lock(&pool->lock);
     }
 
-    pool->cur_threads--;
+    qatomic_set(&pool->cur_threads, pool->cur_threads - 1);
     qemu_cond_signal(&pool->worker_stopped);
 
     /*
@@ -157,7 +239,7 @@ static void spawn_thread_bh_fn(void *opaque)
 
 static void spawn_thread(ThreadPoolAio *pool)
 {
-    pool->cur_threads++;
+    qatomic_set(&pool->cur_threads, pool->cur_threads + 1);
     pool->new_threads++;
     /* If there are threads being created, they will spawn new workers, so
      * we don't spend time creating many threads in a loop holding a mutex or
@@ -174,24 +256,35 @@ static void spawn_thread(ThreadPoolAio *pool)
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPoolAio *pool = opaque;
-    ThreadPoolElementAio *elem, *next;
+    ThreadPoolElementAio *elem;
 
     defer_call_begin(); /* cb() may use defer_call() to coalesce work */
 
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
+    for (;;) {
+        elem = QSIMPLEQ_FIRST(&pool->ready_list);
+        if (!elem) {
+            QSLIST_HEAD(, ThreadPoolElementAio) completed;
+
+            /* The xchg pairs with the cmpxchg in thread_pool_complete() */
+            QSLIST_MOVE_ATOMIC(&completed, &pool->completed_list);
+            if (QSLIST_EMPTY(&completed)) {
+                break;
+            }
+
+            /* Reverse the list so that callbacks run in completion order */
+            while ((elem = QSLIST_FIRST(&completed))) {
+                QSLIST_REMOVE_HEAD(&completed, completed);
+                QSIMPLEQ_INSERT_HEAD(&pool->ready_list, elem, ready);
+            }
             continue;
         }
 
+        QSIMPLEQ_REMOVE_HEAD(&pool->ready_list, ready);
         trace_thread_pool_complete_aio(pool, elem, elem->common.opaque,
                                        elem->ret);
         QLIST_REMOVE(elem, all);
 
         if (elem->common.cb) {
-            /* Read state before ret.  */
-            smp_rmb();
-
             /* Schedule ourselves in case elem->common.cb() calls aio_poll() to
              * wait for another request that completed at the same time.
              */
@@ -200,16 +293,12 @@ restart:
             elem->common.cb(elem->common.opaque, elem->ret);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because the loop checks for
+             * new completions before returning.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
         }
+        qemu_aio_unref(elem);
     }
 
     defer_call_end();
@@ -219,16 +308,18 @@ static void thread_pool_cancel(BlockAIOCB *acb)
 {
     ThreadPoolElementAio *elem = (ThreadPoolElementAio *)acb;
     ThreadPoolAio *pool = elem->pool;
+    ThreadPoolQueue *queue = elem->queue;
 
     trace_thread_pool_cancel_aio(elem, elem->common.opaque);
 
-    QEMU_LOCK_GUARD(&pool->lock);
+    QEMU_LOCK_GUARD(&queue->lock);
     if (elem->state == THREAD_QUEUED) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
+        QTAILQ_REMOVE(&queue->request_list, elem, reqs);
+        qatomic_dec(&pool->queued);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        thread_pool_complete(pool, elem);
     }
 
 }
@@ -242,29 +333,51 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
                                    BlockCompletionFunc *cb, void *opaque)
 {
     ThreadPoolElementAio *req;
+    ThreadPoolQueue *queue;
     AioContext *ctx = qemu_get_current_aio_context();
     ThreadPoolAio *pool = aio_get_thread_pool(ctx);
 
     /* Assert that the thread submitting work is the same running the pool */
     assert(pool->ctx == qemu_get_current_aio_context());
 
+    queue = &pool->queues[pool->next_queue++ % THREAD_POOL_QUEUES];
+
     req = qemu_aio_get(&thread_pool_aiocb_info, NULL, cb, opaque);
     req->func = func;
     req->arg = arg;
     req->state = THREAD_QUEUED;
     req->pool = pool;
+    req->queue = queue;
 
     QLIST_INSERT_HEAD(&pool->head, req, all);
 
     trace_thread_pool_submit_aio(pool, req, arg);
 
-    qemu_mutex_lock(&pool->lock);
-    if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
-        spawn_thread(pool);
+    qemu_mutex_lock(&queue->lock);
+    QTAILQ_INSERT_TAIL(&queue->request_list, req, reqs);
+    qatomic_inc(&pool->queued);
+    qemu_mutex_unlock(&queue->lock);
+
+    /* Write queued before reading idle_threads, pairs with worker_thread() */
+    smp_mb();
+
+    /*
+     * Busy workers find the request without help, only take the lock to
+     * wake up an idle worker or to add one.
+     */
+    if (qatomic_read(&pool->idle_threads)) {
+        qemu_mutex_lock(&pool->lock);
+        qemu_cond_signal(&pool->request_cond);
+        qemu_mutex_unlock(&pool->lock);
+    } else if (qatomic_read(&pool->cur_threads) <
+               qatomic_read(&pool->max_threads)) {
+        qemu_mutex_lock(&pool->lock);
+        if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
+            spawn_thread(pool);
+        }
+        qemu_mutex_unlock(&pool->lock);
+        qemu_cond_signal(&pool->request_cond);
     }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
-    qemu_mutex_unlock(&pool->lock);
-    qemu_cond_signal(&pool->request_cond);
     return &req->common;
 }
 
@@ -295,7 +408,7 @@ void thread_pool_update_params(ThreadPoolAio *pool, AioContext *ctx)
     qemu_mutex_lock(&pool->lock);
 
     pool->min_threads = ctx->thread_pool_min;
-    pool->max_threads = ctx->thread_pool_max;
+    qatomic_set(&pool->max_threads, ctx->thread_pool_max);
 
     /*
      * We either have to:
@@ -332,7 +445,12 @@ static void thread_pool_init_one(ThreadPoolAio *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    QSIMPLEQ_INIT(&pool->ready_list);
+    QSLIST_INIT(&pool->completed_list);
+    for (int i = 0; i < THREAD_POOL_QUEUES; i++) {
+        qemu_mutex_init(&pool->queues[i].lock);
+        QTAILQ_INIT(&pool->queues[i].request_list);
+    }
 
     thread_pool_update_params(pool, ctx);
 }
@@ -356,11 +474,11 @@ void thread_pool_free_aio(ThreadPoolAio *pool)
 
     /* Stop new threads from spawning */
     qemu_bh_delete(pool->new_thread_bh);
-    pool->cur_threads -= pool->new_threads;
+    qatomic_set(&pool->cur_threads, pool->cur_threads - pool->new_threads);
     pool->new_threads = 0;
 
     /* Wait for worker threads to terminate */
-    pool->max_threads = 0;
+    qatomic_set(&pool->max_threads, 0);
     qemu_cond_broadcast(&pool->request_cond);
     while (pool->cur_threads > 0) {
         qemu_cond_wait(&pool->worker_stopped, &pool->lock);
@@ -369,6 +487,9 @@ void thread_pool_free_aio(ThreadPoolAio *pool)
     qemu_mutex_unlock(&pool->lock);
 
     qemu_bh_delete(pool->completion_bh);
+    for (int i = 0; i < THREAD_POOL_QUEUES; i++) {
+        qemu_mutex_destroy(&pool->queues[i].lock);
+    }
     qemu_cond_destroy(&pool->request_cond);
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);